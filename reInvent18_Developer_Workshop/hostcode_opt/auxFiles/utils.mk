@@ -24,10 +24,13 @@ ifeq ($(DEBUG), yes)
 CLFLAGS += --dk protocol:all:all:all
 endif
 
-#Checks for XILINX_SDX
+#Checks for XILINX_SDX (not needed by the software stand-in targets)
+SW_GOALS := bufSw bufSwRun bufSwSweep streamSw streamSwRun
 ifndef XILINX_SDX
+ifneq ($(filter-out $(SW_GOALS),$(or $(MAKECMDGOALS),all)),)
 $(error XILINX_SDX variable is not set, please set correctly and rerun)
 endif
+endif
 
 #   sanitize_dsa - create a filesystem friendly name from dsa name
 #   $(1) - name of dsa
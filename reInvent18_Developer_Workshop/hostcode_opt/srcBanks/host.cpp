@@ -0,0 +1,128 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <string>
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "CL/opencl.h"
+
+#include "ApiHandle.h"
+#include "Task.h"
+
+int main(int argc, char* argv[]) {
+
+  // -- Environment / Usage Check -------------------------------------------
+
+  char *xcl_mode = getenv("XCL_EMULATION_MODE");
+
+  if (argc < 4 || argc > 5) {
+    printf("\nUsage: %s "
+	   "./xclbin/pass.<emulation_mode>.<dsa>.xclbin <numCUs> <numBanks> [rr|ll]\n"
+	   "\n Where numCUs and numBanks match the NK and NB values the xclbin was linked with,"
+	   "\n and rr (round-robin, default) or ll (least-loaded) selects the bank placement policy.\n" ,
+	   argv[0]);
+    return EXIT_FAILURE;
+  }
+  char*        binaryName   = argv[1];
+
+  // -- Common Parameters ---------------------------------------------------
+
+  unsigned int numBuffers               = 100;
+  bool         oooQueue                 = true;
+  unsigned int processDelay             = 1;
+  unsigned int bufferSize               = 1 << 14;
+  unsigned int numCus                   = atoi(argv[2]);
+  unsigned int numBanks                 = atoi(argv[3]);
+  bool         leastLoaded              = (argc > 4) && std::string(argv[4]) == "ll";
+  unsigned int softwarePipelineInterval = 3;
+
+  // -- Setup ---------------------------------------------------------------
+
+  ApiHandle api(binaryName, oooQueue, numCus);
+  api.setBankPlacement(leastLoaded ? BankPolicy::LeastLoaded : BankPolicy::RoundRobin,
+		       numBanks);
+
+  std::cout << std::endl;
+  std::cout << std::endl;
+  std::cout << " Total number of buffers: " << numBuffers   << std::endl;
+  std::cout << "              BufferSize: " << bufferSize   << std::endl;
+  std::cout << "        Bits per Element: " << 512          << std::endl;
+  std::cout << "      Bytes per Transfer: " << bufferSize*512/8 << std::endl;
+  std::cout << "            processDelay: " << processDelay << std::endl;
+  std::cout << "           Compute Units: " << numCus       << std::endl;
+  std::cout << "               DDR Banks: " << numBanks     << std::endl;
+  std::cout << "        Placement Policy: " << (leastLoaded ? "least-loaded" : "round-robin") << std::endl;
+  for(unsigned int cu=0; cu < numCus; cu++) {
+    std::cout << "                   CU " << cu << ": bank" << api.getInBank(cu)
+	      << " -> bank" << api.getOutBank(cu) << std::endl;
+  }
+  std::cout << std::boolalpha;
+  std::cout << "      Out of Order Queue: " << oooQueue << std::endl;
+  std::cout << std::noboolalpha;
+  std::cout << std::endl;
+
+  // Each round adds one compute unit, and with it up to two more banks.
+  bool outputOk = true;
+  for(unsigned int activeCus=1; activeCus <= numCus; activeCus++) {
+    api.setActiveCus(activeCus);
+
+    std::vector<bool> bankUsed(numBanks, false);
+    for(unsigned int cu=0; cu < activeCus; cu++) {
+      bankUsed[api.getInBank(cu)]  = true;
+      bankUsed[api.getOutBank(cu)] = true;
+    }
+    unsigned int banksUsed = 0;
+    for(unsigned int b=0; b < numBanks; b++) {
+      banksUsed += bankUsed[b] ? 1 : 0;
+    }
+
+    std::vector<Task> tasks(numBuffers, Task(bufferSize, processDelay));
+
+    std::cout << "Running FPGA on " << activeCus << " CUs / "
+	      << banksUsed << " banks" << std::endl;
+    auto fpga_begin = std::chrono::high_resolution_clock::now();
+
+    // -- Execution ---------------------------------------------------------
+
+    unsigned int inFlight = softwarePipelineInterval * activeCus;
+    for(unsigned int i=0; i < numBuffers; i++) {
+      if(i < inFlight) {
+	tasks[i].run(api);
+      } else {
+	tasks[i].run(api, tasks[i-inFlight].getDoneEv());
+      }
+    }
+    clFinish(api.getQueue());
+
+    // -- Testing -----------------------------------------------------------
+
+    auto fpga_end = std::chrono::high_resolution_clock::now();
+
+    for(unsigned int i=0; i < numBuffers; i++) {
+      outputOk = tasks[i].outputOk() && outputOk;
+    }
+
+    // -- Performance Statistics --------------------------------------------
+
+    if (xcl_mode == NULL) {
+      std::chrono::duration<double> fpga_duration = fpga_end - fpga_begin;
+
+      double total = (double) bufferSize * numBuffers * 512 / (1024.0*1024.0);
+      std::cout << "           FPGA Time: " << fpga_duration.count()
+		<< " s" << std::endl;
+      std::cout << "     FPGA Throughput: "
+		<< total / fpga_duration.count()
+		<< " MBits/s" << std::endl;
+      std::cout << " Aggregate Bandwidth: "
+		<< (2*total) / fpga_duration.count()
+		<< " MBits/s" << std::endl;
+      std::cout << std::endl;
+    }
+  }
+  if(!outputOk) {
+    std::cout << "FAIL: Output Corrupted" << std::endl;
+    return 1;
+  }
+  std::cout << "\nPASS: Simulation" << std::endl;
+
+ return 0;
+}
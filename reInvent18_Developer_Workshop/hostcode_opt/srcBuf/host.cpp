@@ -1,11 +1,104 @@
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <chrono>
+#include <string>
+
+#ifdef PASS_SW
+#include "SwPass.h"
+typedef SwApiHandle ApiHandle;
+typedef SwTask      Task;
+#else
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #include "CL/opencl.h"
 
 #include "ApiHandle.h"
 #include "Task.h"
+#endif
+
+// Runs numBuffers invocations of bufferSize words each, reusing a ring of
+// inFlight tasks. Returns the FPGA throughput in MBits/s.
+double runSize(ApiHandle &api, unsigned int bufferSize, unsigned int numBuffers,
+	       unsigned int inFlight, unsigned int processDelay, bool &outputOk) {
+  std::vector<Task> tasks(inFlight, Task(bufferSize, processDelay));
+
+  auto fpga_begin = std::chrono::high_resolution_clock::now();
+  for(unsigned int i=0; i < numBuffers; i++) {
+    tasks[i % inFlight].run(api);
+  }
+  clFinish(api.getQueue());
+  auto fpga_end = std::chrono::high_resolution_clock::now();
+
+  for(unsigned int i=0; i < inFlight; i++) {
+    outputOk = tasks[i].outputOk() && outputOk;
+  }
+  std::chrono::duration<double> fpga_duration = fpga_end - fpga_begin;
+  double total = (double) bufferSize * numBuffers * 512 / (1024.0*1024.0);
+  return total / fpga_duration.count();
+}
+
+// Sweeps pow(2,minLog2) .. pow(2,maxLog2) words per invocation, writes
+// results.csv (same layout as auxFiles/run.py) and reports the knee, the
+// smallest buffer reaching 90% of the peak throughput.
+int sweep(ApiHandle &api, unsigned int minLog2, unsigned int maxLog2,
+	  unsigned int inFlight, unsigned int processDelay) {
+  std::vector<unsigned long long> bytes;
+  std::vector<double>             throughput;
+  bool outputOk = true;
+
+  std::cout << std::endl;
+  std::cout << " Sweeping buffer sizes 2^" << minLog2 << " .. 2^" << maxLog2
+	    << " with " << inFlight << " buffers in flight" << std::endl;
+  std::cout << std::endl;
+
+  for(unsigned int log2 = minLog2; log2 <= maxLog2; log2++) {
+    unsigned int       bufferSize = 1 << log2;
+    unsigned long long bufBytes   = (unsigned long long)bufferSize*512/8;
+
+    // At least 100 invocations for small buffers, but keep the data moved
+    // per point around 1 GByte so large buffers finish in reasonable time.
+    unsigned int numBuffers = (unsigned int)((1 << 30) / bufBytes);
+    if(numBuffers > 100)          numBuffers = 100;
+    if(numBuffers < 2*inFlight)   numBuffers = 2*inFlight;
+
+    double mbits = runSize(api, bufferSize, numBuffers, inFlight, processDelay, outputOk);
+    bytes.push_back(bufBytes);
+    throughput.push_back(mbits);
+    std::cout << "  Bytes per Transfer: " << bufBytes
+	      << "  FPGA Throughput: " << mbits << " MBits/s" << std::endl;
+  }
+  if(!outputOk) {
+    std::cout << "FAIL: Output Corrupted" << std::endl;
+    return 1;
+  }
+
+  std::ofstream out("results.csv");
+  out << "\"Bytes per Transfer\", \"FPGA Throughput\"" << std::endl;
+  for(unsigned int i=0; i < bytes.size(); i++) {
+    out << bytes[i] << ", " << throughput[i] << std::endl;
+  }
+
+  double peak = 0;
+  for(unsigned int i=0; i < throughput.size(); i++) {
+    if(throughput[i] > peak) peak = throughput[i];
+  }
+  unsigned int knee = 0;
+  while(throughput[knee] < 0.9*peak) knee++;
+
+  // Plain text plot for machines without gnuplot
+  std::cout << std::endl;
+  for(unsigned int i=0; i < throughput.size(); i++) {
+    std::cout.width(12);
+    std::cout << bytes[i] << " |" << std::string((size_t)(60*throughput[i]/peak), '#')
+	      << (i == knee ? "  <- knee" : "") << std::endl;
+  }
+  std::cout << std::endl;
+  std::cout << "       Peak Throughput: " << peak << " MBits/s" << std::endl;
+  std::cout << "                  Knee: " << bytes[knee] << " Bytes per Transfer ("
+	    << throughput[knee] << " MBits/s)" << std::endl;
+  std::cout << "\nPASS: Simulation" << std::endl;
+  return 0;
+}
 
 int main(int argc, char* argv[]) {
 
@@ -13,11 +106,13 @@ int main(int argc, char* argv[]) {
 
   char *xcl_mode = getenv("XCL_EMULATION_MODE");
 
-  if (argc != 3) {
+  if (argc < 3) {
     printf("\nUsage: %s "
 	   "./xclbin/pass.<emulation_mode>.<dsa>.xclbin <bufSize>\n"
+	   "       %s "
+	   "./xclbin/pass.<emulation_mode>.<dsa>.xclbin sweep [minSize] [maxSize] [inFlight]\n"
 	   "\n Where pow(2,<bufferSize>) determines the number of 512-bit values written/read per accelerator invocation.\n" ,
-	   argv[0]);
+	   argv[0], argv[0]);
     return EXIT_FAILURE;
   }
   char*        binaryName   = argv[1];
@@ -27,6 +122,15 @@ int main(int argc, char* argv[]) {
   unsigned int numBuffers               = 100;
   bool         oooQueue                 = true;
   unsigned int processDelay             = 1;
+
+  if(std::string(argv[2]) == "sweep") {
+    unsigned int minLog2  = (argc > 3) ? atoi(argv[3]) : 6;
+    unsigned int maxLog2  = (argc > 4) ? atoi(argv[4]) : 22;
+    unsigned int inFlight = (argc > 5) ? atoi(argv[5]) : 4;
+    ApiHandle api(binaryName, oooQueue);
+    return sweep(api, minLog2, maxLog2, inFlight, processDelay);
+  }
+
   unsigned int bufferSize               = 1 << atoi(argv[2]);
 
   // -- Setup ---------------------------------------------------------------
@@ -5,147 +5,191 @@
 #include <string.h>
 #include <iostream>
 #include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
 
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #include "CL/opencl.h"
 
+#include "XclbinLoader.h"
 
-class ApiHandle {
 
-  void* smalloc(size_t size) {
-    void* ptr;
-    
-    ptr = malloc(size);
-    
-    if (ptr == NULL) {
-      printf("Error: Cannot allocate memory\n");
-      exit(EXIT_FAILURE);
-    }
-    
-    return ptr;
-  }
-
-
-  int load_file_to_memory(const char *filename, char **result) {
-    unsigned int size;
-    
-    FILE *f = fopen(filename, "rb");
-    if (f == NULL) {
-      *result = NULL;
-      printf("Error: Could not read file %s\n", filename);
-      exit(EXIT_FAILURE);
-    }
-
-    fseek(f, 0, SEEK_END);
-    size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    *result = (char *) smalloc(sizeof(char)*(size+1));
-    
-    if (size != fread(*result, sizeof(char), size, f)) {
-      free(*result);
-      printf("Error: read of kernel failed\n");
-      exit(EXIT_FAILURE);
-    }
+// How Tasks are spread over the pass compute units, and thus over the DDR
+// bank pairs the compute units are connected to.
+enum class BankPolicy {
+  RoundRobin,   // cycle through the active compute units
+  LeastLoaded,  // pick the CU whose banks hold the fewest in-flight bytes
+  Explicit      // the Task names its compute unit
+};
 
-    fclose(f);
-    (*result)[size] = 0;
+class ApiHandle {
 
-    return size;
-  }
+  // One kernel object per compute unit and in-flight slot. Arguments set
+  // on a cl_kernel are shared state, so a slot is owned by a single caller
+  // between acquireKernel and releaseKernel.
+  struct KernelSlot {
+    cl_kernel    kernel;
+    unsigned int cu;
+    bool         busy;
+  };
 
   cl_context       m_context;
   cl_program       m_program;
   cl_device_id     m_device_id;
-  cl_kernel        m_kernel;
   cl_command_queue m_queue;
+
+  std::vector<KernelSlot>  m_slots;
+  unsigned int             m_numCus;
+  unsigned int             m_nextSlot;
+  std::mutex               m_poolMutex;
+  std::condition_variable  m_poolCv;
+
+  // Compute unit k is linked with its input port on bank (2k)%numBanks and
+  // its output port on bank (2k+1)%numBanks, see LDCLFLAGS in the Makefile.
+  BankPolicy               m_policy;
+  unsigned int             m_numBanks;
+  unsigned int             m_activeCus;
+  unsigned int             m_nextCu;
+  size_t                   m_bankLoad[4];
   
 public:
 
   cl_command_queue& getQueue()  { return m_queue;  }
   cl_context&       getContext(){ return m_context; }
-  cl_kernel&        getKernel() { return m_kernel; }
-  
-  ApiHandle(char* binaryName, bool oooQueue) {
-    // *********** OpenCL Host Code Setup **********
+  cl_kernel&        getKernel() { return m_slots[0].kernel; }
+  unsigned int      getNumCus() { return m_numCus; }
 
-    // Connect to first platform
-    int err;
-    char cl_platform_vendor[1001];
-    char cl_platform_name[1001];
-    char cl_device_name[1001];
-    
-    cl_uint platform_count;
-    
-    // Get number of platforms
-    err = clGetPlatformIDs(0, nullptr, &platform_count);
-    if(err !=CL_SUCCESS) {
-    	std::cout << "PlatformID error" << std::endl;
-    	exit(1);
+  static unsigned int bankFlag(unsigned int bank) {
+    const unsigned int flags[4] = { XCL_MEM_DDR_BANK0, XCL_MEM_DDR_BANK1,
+				    XCL_MEM_DDR_BANK2, XCL_MEM_DDR_BANK3 };
+    return flags[bank];
+  }
+  unsigned int getInBank(unsigned int cu)  { return (2*cu)   % m_numBanks; }
+  unsigned int getOutBank(unsigned int cu) { return (2*cu+1) % m_numBanks; }
+  unsigned int getNumBanks() { return m_numBanks; }
+
+  // numBanks has to match the NB value the xclbin was linked with.
+  void setBankPlacement(BankPolicy policy, unsigned int numBanks) {
+    if(numBanks != 1 && numBanks != 2 && numBanks != 4) {
+      std::cout << "FAILED TEST - Unsupported number of DDR banks" << std::endl;
+      exit(EXIT_FAILURE);
     }
-    
-    // get all platforms
-    cl_platform_id platform_id;         // platform id
-    std::vector<cl_platform_id> platforms(platform_count);
-    clGetPlatformIDs(platform_count, platforms.data(), nullptr);
-    
-    bool found = false;
-    for (int p = 0; p < (int)platform_count; ++p) {  
-      platform_id = platforms[p];
-      clGetPlatformInfo(platform_id,CL_PLATFORM_VENDOR,1000,
-			(void *)cl_platform_vendor,
-			NULL);
-      clGetPlatformInfo(platform_id,CL_PLATFORM_NAME,1000,
-			(void *)cl_platform_name,
-			NULL);
-      if(!strcmp(cl_platform_vendor,"Xilinx")) {
-	found = true;
-	break;
+    m_policy   = policy;
+    m_numBanks = numBanks;
+  }
+
+  // Restricts placement to compute units 0 .. activeCus-1.
+  void setActiveCus(unsigned int activeCus) {
+    m_activeCus = (activeCus < 1) ? 1 : (activeCus > m_numCus ? m_numCus : activeCus);
+  }
+
+  // Chooses the compute unit (and with it the bank pair) for a task moving
+  // inBytes to the device and outBytes back. The bytes are accounted to the
+  // banks until retireTask is called for the same task.
+  unsigned int placeTask(size_t inBytes, size_t outBytes, int cu = -1) {
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    unsigned int chosen = 0;
+    if(cu >= 0) {
+      chosen = (unsigned int)cu % m_numCus;
+    } else if(m_policy == BankPolicy::LeastLoaded) {
+      size_t best = 0;
+      for(unsigned int c = 0; c < m_activeCus; c++) {
+	size_t load = m_bankLoad[getInBank(c)] + m_bankLoad[getOutBank(c)];
+	if(c == 0 || load < best) {
+	  best   = load;
+	  chosen = c;
+	}
       }
+    } else if(m_policy == BankPolicy::RoundRobin) {
+      chosen = m_nextCu++ % m_activeCus;
+    } else {
+      std::cout << "FAILED TEST - Explicit placement without compute unit" << std::endl;
+      exit(EXIT_FAILURE);
     }
-    if (!found){
-      std::cout << "Platform Not Found" << std::endl;
-      exit(err);
-    }
-    
-    err = clGetDeviceIDs(platform_id,
-			 CL_DEVICE_TYPE_ACCELERATOR,
-			 1,
-			 &m_device_id,
-			 NULL);
-    if (err != CL_SUCCESS) {
-      std::cout << "FAILED TEST - Device" << std::endl;
-      exit(err);
+    m_bankLoad[getInBank(chosen)]  += inBytes;
+    m_bankLoad[getOutBank(chosen)] += outBytes;
+    return chosen;
+  }
+
+  void retireTask(unsigned int cu, size_t inBytes, size_t outBytes) {
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    m_bankLoad[getInBank(cu)]  -= inBytes;
+    m_bankLoad[getOutBank(cu)] -= outBytes;
+  }
+
+  // Blocks until a kernel slot is free. With cu < 0 any compute unit is
+  // acceptable and slots are handed out round-robin, otherwise only slots
+  // bound to the given compute unit are considered.
+  cl_kernel acquireKernel(int cu = -1) {
+    std::unique_lock<std::mutex> lock(m_poolMutex);
+    while(true) {
+      for(unsigned int n = 0; n < m_slots.size(); n++) {
+	unsigned int s = (m_nextSlot + n) % m_slots.size();
+	if(!m_slots[s].busy && (cu < 0 || m_slots[s].cu == (unsigned int)cu)) {
+	  m_slots[s].busy = true;
+	  m_nextSlot = s + 1;
+	  return m_slots[s].kernel;
+	}
+      }
+      m_poolCv.wait(lock);
     }
-    
-    m_context = clCreateContext(0, 1, &m_device_id, NULL, NULL, &err);
-    if (err != CL_SUCCESS) {
-      std::cout << "FAILED TEST - Context" << std::endl;
-      exit(err);
+  }
+
+  // The enqueue captures the argument values, so a slot can be released as
+  // soon as clEnqueueTask has returned.
+  void releaseKernel(cl_kernel kernel) {
+    {
+      std::lock_guard<std::mutex> lock(m_poolMutex);
+      for(unsigned int s = 0; s < m_slots.size(); s++) {
+	if(m_slots[s].kernel == kernel) {
+	  m_slots[s].busy = false;
+	}
+      }
     }
-    
-    clGetDeviceInfo(m_device_id, CL_DEVICE_NAME, 1000, (void*)cl_device_name, NULL);
-    
-    std::cout << "DEVICE: " << cl_device_name << std::endl;
-    
-    std::cout << "Loading Bitstream: " << binaryName << std::endl; 
-    char *krnl_bin;
-    size_t krnl_size;
-    krnl_size = load_file_to_memory(binaryName, &krnl_bin);
-    
-    std::cout << "INFO: Loaded file" << std::endl;
-    
-    m_program = clCreateProgramWithBinary(m_context, 1,
-					  (const cl_device_id* ) &m_device_id,
-					  &krnl_size,
-					  (const unsigned char**) &krnl_bin,
-					  NULL, &err);
-
-    std::cout << "Create Kernel: pass" << std::endl;
-    m_kernel = clCreateKernel(m_program, "pass", &err);
-    if (err != CL_SUCCESS) {
-      std::cout << "FAILED TEST - Kernel Creation" << std::endl;
-      exit(err);
+    m_poolCv.notify_all();
+  }
+  
+  ApiHandle(char* binaryName, bool oooQueue,
+	    unsigned int numCus = 1, unsigned int slotsPerCu = 1):
+    m_numCus(numCus),
+    m_nextSlot(0),
+    m_policy(BankPolicy::RoundRobin),
+    m_numBanks(2),
+    m_activeCus(numCus),
+    m_nextCu(0),
+    m_bankLoad{0, 0, 0, 0}
+  {
+    // *********** OpenCL Host Code Setup **********
+
+    // Device, context and program are shared by all handles of the process
+    int err;
+    XclbinLoader::Program prog = XclbinLoader::get(binaryName);
+    m_device_id = prog.device;
+    m_context   = prog.context;
+    m_program   = prog.program;
+
+    // A single compute unit keeps the plain kernel name, otherwise each
+    // slot is bound to its CU (pass_1, pass_2, ...) so the runtime does
+    // not pick the CU behind our back.
+    for(unsigned int cu = 0; cu < numCus; cu++) {
+      std::string name = "pass";
+      if(numCus > 1) {
+	name += ":{pass_" + std::to_string(cu+1) + "}";
+      }
+      std::cout << "Create Kernel: " << name
+		<< " (" << slotsPerCu << " slots)" << std::endl;
+      for(unsigned int s = 0; s < slotsPerCu; s++) {
+	KernelSlot slot;
+	slot.kernel = clCreateKernel(m_program, name.c_str(), &err);
+	slot.cu     = cu;
+	slot.busy   = false;
+	if (err != CL_SUCCESS) {
+	  std::cout << "FAILED TEST - Kernel Creation" << std::endl;
+	  exit(err);
+	}
+	m_slots.push_back(slot);
+      }
     }
 
     if(oooQueue) {
@@ -171,8 +215,10 @@ public:
   }
   
   ~ApiHandle() {
+    for(unsigned int s = 0; s < m_slots.size(); s++) {
+      clReleaseKernel(m_slots[s].kernel);
+    }
     clReleaseProgram(m_program);
-    clReleaseKernel(m_kernel);
     clReleaseCommandQueue(m_queue);
     clReleaseContext(m_context);
   }
@@ -0,0 +1,62 @@
+#ifndef __SPSCQUEUE_H__
+#define __SPSCQUEUE_H__
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+
+/* ***************************************************************************
+
+SpscQueue
+
+Bounded lock-free queue for exactly one producer thread and one consumer
+thread. The capacity is rounded up to a power of two. push and pop never
+block, they return false when the queue is full or empty respectively.
+
+Head and tail live on separate cache lines so producer and consumer do not
+invalidate each other's line on every operation.
+
+*************************************************************************** */
+template <typename T>
+class SpscQueue
+{
+  std::vector<T>                   m_ring;
+  size_t                           m_mask;
+  alignas(64) std::atomic<size_t>  m_head;  // next slot to pop, owned by consumer
+  alignas(64) std::atomic<size_t>  m_tail;  // next slot to push, owned by producer
+
+public:
+  SpscQueue(size_t capacity) :
+    m_head(0),
+    m_tail(0)
+  {
+    size_t size = 1;
+    while(size < capacity) size <<= 1;
+    m_ring.resize(size);
+    m_mask = size - 1;
+  }
+
+  bool push(const T &value) {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if(tail - m_head.load(std::memory_order_acquire) > m_mask) {
+      return false;
+    }
+    m_ring[tail & m_mask] = value;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &value) {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if(head == m_tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = m_ring[head & m_mask];
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+
+#endif
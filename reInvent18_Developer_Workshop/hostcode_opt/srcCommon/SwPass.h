@@ -0,0 +1,341 @@
+#ifndef __SWPASS_H__
+#define __SWPASS_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+#include "AlignedAllocator.h"
+
+/* ***************************************************************************
+
+SwPass
+
+Software stand-in for the pass kernel and for the small part of the
+OpenCL runtime used by the hostcode_opt hosts. It allows the scheduling
+logic of a host to be built, run and profiled on a machine without an
+FPGA (compile the host with -DPASS_SW).
+
+The device is modelled as three engines working concurrently: a host to
+card DMA engine, the compute unit(s) and a card to host DMA engine. Each
+engine executes its commands in submission order once their dependencies
+have completed, and every command takes at least its modelled time:
+
+  migrate : dmaUs    + bytes / (pcieGBps * 1000)            [us]
+  kernel  : launchUs + numInputs * processDelay / clockMHz  [us]
+
+The model parameters are read from the environment (PASS_SW_LAUNCH_US,
+PASS_SW_DMA_US, PASS_SW_PCIE_GBPS, PASS_SW_CLOCK_MHZ) and default to
+values in the range observed on F1.
+
+*************************************************************************** */
+
+// 512-bit word, the software counterpart of ap_int<512>
+struct SwWord {
+  uint64_t m_w[8];
+
+  SwWord(uint64_t v = 0) : m_w{v, 0, 0, 0, 0, 0, 0, 0} {}
+
+  SwWord& operator+=(uint64_t v) {
+    for(unsigned int i = 0; i < 8 && v != 0; i++) {
+      uint64_t prev = m_w[i];
+      m_w[i] += v;
+      v = (m_w[i] < prev) ? 1 : 0;
+    }
+    return *this;
+  }
+  bool operator==(const SwWord &o) const {
+    for(unsigned int i = 0; i < 8; i++) {
+      if(m_w[i] != o.m_w[i]) return false;
+    }
+    return true;
+  }
+  bool operator!=(const SwWord &o) const { return !(*this == o); }
+  SwWord operator+(uint64_t v) const {
+    SwWord r = *this;
+    r += v;
+    return r;
+  }
+};
+
+
+class SwEventState {
+  std::mutex              m_mutex;
+  std::condition_variable m_cv;
+  bool                    m_done;
+
+public:
+  typedef std::chrono::steady_clock::time_point time_point;
+
+  time_point m_queued;
+  time_point m_start;
+  time_point m_end;
+
+  SwEventState() : m_done(false), m_queued(std::chrono::steady_clock::now()) {}
+
+  bool isDone() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_done;
+  }
+  void wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]{ return m_done; });
+  }
+  void complete() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_done = true;
+    }
+    m_cv.notify_all();
+  }
+};
+typedef std::shared_ptr<SwEventState> SwEvent;
+
+
+struct SwCommand {
+  std::vector<SwEvent>  m_deps;
+  SwEvent               m_ev;
+  double                m_modelUs;
+  std::function<void()> m_work;
+};
+
+
+class SwEngine {
+  std::deque<SwCommand>   m_cmds;
+  std::mutex              m_mutex;
+  std::condition_variable m_cv;
+  bool                    m_stop;
+  std::thread             m_thread;
+
+  void loop() {
+    while(true) {
+      SwCommand cmd;
+      {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cv.wait(lock, [this]{ return m_stop || !m_cmds.empty(); });
+	if(m_cmds.empty()) return;
+	cmd = m_cmds.front();
+	m_cmds.pop_front();
+      }
+      for(unsigned int i = 0; i < cmd.m_deps.size(); i++) {
+	cmd.m_deps[i]->wait();
+      }
+      cmd.m_ev->m_start = std::chrono::steady_clock::now();
+      if(cmd.m_work) cmd.m_work();
+      std::this_thread::sleep_until(cmd.m_ev->m_start +
+				    std::chrono::nanoseconds((long long)(cmd.m_modelUs*1000)));
+      cmd.m_ev->m_end = std::chrono::steady_clock::now();
+      cmd.m_ev->complete();
+    }
+  }
+
+public:
+  SwEngine() : m_stop(false), m_thread(&SwEngine::loop, this) {}
+  ~SwEngine() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+  }
+  void submit(const SwCommand &cmd) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_cmds.push_back(cmd);
+    }
+    m_cv.notify_all();
+  }
+};
+
+
+class SwQueue {
+  bool                  m_ooo;
+  std::mutex            m_mutex;
+  std::vector<SwEvent>  m_pending;
+  SwEvent               m_last;
+
+public:
+  SwEngine                               m_h2c;
+  SwEngine                               m_c2h;
+  std::vector<std::unique_ptr<SwEngine>> m_cus;
+
+  SwQueue(bool ooo, unsigned int numCus) : m_ooo(ooo) {
+    for(unsigned int cu = 0; cu < numCus; cu++) {
+      m_cus.emplace_back(new SwEngine());
+    }
+  }
+
+  // An in-order queue adds the previously enqueued command as an implicit
+  // dependency, exactly like a sequential OpenCL command queue.
+  SwEvent enqueue(SwEngine &engine, const SwEvent *waitList, unsigned int numWait,
+		  double modelUs, std::function<void()> work) {
+    SwCommand cmd;
+    cmd.m_ev      = std::make_shared<SwEventState>();
+    cmd.m_modelUs = modelUs;
+    cmd.m_work    = work;
+    for(unsigned int i = 0; i < numWait; i++) {
+      cmd.m_deps.push_back(waitList[i]);
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if(!m_ooo && m_last) cmd.m_deps.push_back(m_last);
+      m_last = cmd.m_ev;
+      m_pending.push_back(cmd.m_ev);
+    }
+    engine.submit(cmd);
+    return cmd.m_ev;
+  }
+
+  void finish() {
+    std::vector<SwEvent> pending;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      pending.swap(m_pending);
+    }
+    for(unsigned int i = 0; i < pending.size(); i++) {
+      pending[i]->wait();
+    }
+  }
+};
+
+inline int clFinish(SwQueue &q) {
+  q.finish();
+  return 0;
+}
+
+inline int clWaitForEvents(unsigned int numEvents, const SwEvent *events) {
+  for(unsigned int i = 0; i < numEvents; i++) {
+    events[i]->wait();
+  }
+  return 0;
+}
+
+
+class SwApiHandle {
+  double       m_launchUs;
+  double       m_dmaUs;
+  double       m_pcieGBps;
+  double       m_clockMHz;
+  unsigned int m_numCus;
+  unsigned int m_nextCu;
+  std::mutex   m_cuMutex;
+  SwQueue      m_queue;
+
+  static double envOr(const char *name, double dflt) {
+    char *v = getenv(name);
+    return (v == NULL) ? dflt : atof(v);
+  }
+
+public:
+  SwQueue& getQueue() { return m_queue; }
+
+  double migrateUs(size_t bytes) { return m_dmaUs + bytes / (m_pcieGBps * 1000.0); }
+  double kernelUs(unsigned int numInputs, unsigned int processDelay) {
+    return m_launchUs + (double)numInputs * (processDelay ? processDelay : 1) / m_clockMHz;
+  }
+  unsigned int nextCu() {
+    std::lock_guard<std::mutex> lock(m_cuMutex);
+    return m_nextCu++ % m_numCus;
+  }
+
+  SwApiHandle(char* binaryName, bool oooQueue, unsigned int numCus = 1):
+    m_launchUs(envOr("PASS_SW_LAUNCH_US", 40.0)),
+    m_dmaUs(envOr("PASS_SW_DMA_US", 15.0)),
+    m_pcieGBps(envOr("PASS_SW_PCIE_GBPS", 10.0)),
+    m_clockMHz(envOr("PASS_SW_CLOCK_MHZ", 250.0)),
+    m_numCus(numCus),
+    m_nextCu(0),
+    m_queue(oooQueue, numCus)
+  {
+    std::cout << "DEVICE: software pass model (" << binaryName << " not loaded)" << std::endl;
+    std::cout << "  launch overhead: " << m_launchUs << " us" << std::endl;
+    std::cout << "  DMA overhead   : " << m_dmaUs    << " us" << std::endl;
+    std::cout << "  PCIe bandwidth : " << m_pcieGBps << " GB/s" << std::endl;
+    std::cout << "  kernel clock   : " << m_clockMHz << " MHz" << std::endl;
+    std::cout << (oooQueue ? "Create Out of Order Queue" : "Create Sequential Queue") << std::endl;
+    std::cout << "Setup Complete" << std::endl;
+  }
+};
+
+
+class SwTask {
+  std::vector< SwWord, AlignedAllocator< SwWord >> m_in;
+  std::vector< SwWord, AlignedAllocator< SwWord >> m_out;
+  unsigned int      m_bufferSize;
+  unsigned int      m_processDelay;
+
+  SwEvent           m_inEv;
+  SwEvent           m_outEv;
+  SwEvent           m_doneEv;
+
+  bool              m_hasRun;
+
+public:
+  SwEvent*     getDoneEv()  { return &m_doneEv;  }
+  SwWord*      getInput()   { return m_in.data(); }
+  SwWord*      getOutput()  { return m_out.data(); }
+  unsigned int getBufferSize() { return m_bufferSize; }
+
+  SwTask(unsigned int bufferSize, unsigned int processDelay, int cu = -1):
+    m_in(bufferSize, 0),
+    m_out(bufferSize),
+    m_bufferSize(bufferSize),
+    m_processDelay(processDelay),
+    m_hasRun(false)
+  {}
+  SwTask(const SwTask &t):
+    m_in(t.m_bufferSize, 0),
+    m_out(t.m_bufferSize),
+    m_bufferSize(t.m_bufferSize),
+    m_processDelay(t.m_processDelay),
+    m_hasRun(false)
+  {}
+
+  // Same contract as Task::run, including waiting for the previous run of
+  // this task before its buffers are reused.
+  void run(SwApiHandle &api, SwEvent *prevEvent = nullptr) {
+    if(m_hasRun) {
+      m_doneEv->wait();
+    }
+    size_t bytes = m_bufferSize*sizeof(SwWord);
+    SwQueue &q = api.getQueue();
+
+    m_inEv = q.enqueue(q.m_h2c, prevEvent, prevEvent ? 1 : 0,
+		       api.migrateUs(bytes), nullptr);
+
+    m_outEv = q.enqueue(*q.m_cus[api.nextCu()], &m_inEv, 1,
+			api.kernelUs(m_bufferSize, m_processDelay),
+			[this]() {
+			  for(unsigned int i = 0; i < m_bufferSize; i++) {
+			    SwWord w = m_in[i];
+			    for(unsigned int d = 0; d < m_processDelay; d++) {
+			      w += 1;
+			    }
+			    m_out[i] = w;
+			  }
+			});
+
+    m_doneEv = q.enqueue(q.m_c2h, &m_outEv, 1, api.migrateUs(bytes), nullptr);
+    m_hasRun = true;
+  }
+  bool outputOk() {
+    for(unsigned int i=0; i < m_bufferSize; i++) {
+      if(m_out[i] != m_in[i] + m_processDelay) {
+	std::cout << "Output Error" << std::endl;
+	return false;
+      }
+    }
+    return true;
+  }
+};
+
+#endif
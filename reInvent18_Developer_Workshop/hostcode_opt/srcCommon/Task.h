@@ -27,16 +27,41 @@ class Task {
   cl_mem            m_inBuffer[1];
   cl_mem            m_outBuffer[1];
 
+  int               m_requestedCu;
+  unsigned int      m_cu;
+
   bool              m_hasRun;
+
+  // Runs on a runtime thread once the output is back on the host; the
+  // task no longer occupies its DDR banks. The callback may fire after
+  // clFinish has returned, so it must not touch the Task itself.
+  struct Placement {
+    ApiHandle*   api;
+    unsigned int cu;
+    size_t       bytes;
+  };
+  static void CL_CALLBACK retire(cl_event ev, cl_int status, void* data) {
+    Placement* p = static_cast<Placement*>(data);
+    p->api->retireTask(p->cu, p->bytes, p->bytes);
+    delete p;
+  }
   
 public:
-  cl_event* getDoneEv()  { return &m_doneEv;  }
+  cl_event*    getDoneEv()  { return &m_doneEv;  }
+  unsigned int getCu()      { return m_cu; }
+  ap_int<512>* getInput()   { return m_in.data(); }
+  ap_int<512>* getOutput()  { return m_out.data(); }
+  unsigned int getBufferSize() { return m_bufferSize; }
 
-  Task(unsigned int bufferSize, unsigned int processDelay):
+  // cu selects the compute unit explicitly, -1 leaves the choice to the
+  // bank placement policy of the ApiHandle.
+  Task(unsigned int bufferSize, unsigned int processDelay, int cu = -1):
     m_in(bufferSize, 0),
     m_out(bufferSize),
     m_bufferSize(bufferSize),
     m_processDelay(processDelay),
+    m_requestedCu(cu),
+    m_cu(0),
     m_hasRun(false)
   {
     m_inExt.flags  = XCL_MEM_DDR_BANK0;
@@ -52,6 +77,8 @@ public:
     m_out(t.m_bufferSize),
     m_bufferSize(t.m_bufferSize),
     m_processDelay(t.m_processDelay),
+    m_requestedCu(t.m_requestedCu),
+    m_cu(0),
     m_hasRun(false)
   {
     m_inExt.flags  = XCL_MEM_DDR_BANK0;
@@ -63,6 +90,9 @@ public:
     m_outExt.param = 0;
   }
   ~Task() {
+    release();
+  }
+  void release() {
     if(m_hasRun) {
       clReleaseMemObject(m_inBuffer[0]);
       clReleaseMemObject(m_outBuffer[0]);
@@ -70,10 +100,22 @@ public:
       clReleaseEvent(m_inEv);
       clReleaseEvent(m_outEv);
       clReleaseEvent(m_doneEv);
+      m_hasRun = false;
     }
   }
+  // A task can be run again; the host then waits for its previous run to
+  // complete before the buffers are reused.
   void run(ApiHandle &api, cl_event *prevEvent = nullptr) {
     int err;
+    if(m_hasRun) {
+      clWaitForEvents(1, &m_doneEv);
+      release();
+    }
+    size_t bytes = m_bufferSize*sizeof(ap_int<512>);
+    m_cu = api.placeTask(bytes, bytes, m_requestedCu);
+    m_inExt.flags  = ApiHandle::bankFlag(api.getInBank(m_cu));
+    m_outExt.flags = ApiHandle::bankFlag(api.getOutBank(m_cu));
+
     m_inBuffer[0] = clCreateBuffer(api.getContext(),
 				   CL_MEM_EXT_PTR_XILINX |
 				     CL_MEM_USE_HOST_PTR |
@@ -96,21 +138,25 @@ public:
 				 0, 0, nullptr, &m_inEv);
     }
 
-    clSetKernelArg(api.getKernel(), 0, sizeof(cl_mem), &m_inBuffer[0]);
-    clSetKernelArg(api.getKernel(), 1, sizeof(cl_mem), &m_outBuffer[0]);
-    clSetKernelArg(api.getKernel(), 2, sizeof(unsigned int), &m_bufferSize);
-    clSetKernelArg(api.getKernel(), 3, sizeof(unsigned int), &m_processDelay);
+    cl_kernel kernel = api.acquireKernel(m_cu);
+    clSetKernelArg(kernel, 0, sizeof(cl_mem), &m_inBuffer[0]);
+    clSetKernelArg(kernel, 1, sizeof(cl_mem), &m_outBuffer[0]);
+    clSetKernelArg(kernel, 2, sizeof(unsigned int), &m_bufferSize);
+    clSetKernelArg(kernel, 3, sizeof(unsigned int), &m_processDelay);
 
-    clEnqueueTask(api.getQueue(), api.getKernel(), 1, &m_inEv, &m_outEv);
+    clEnqueueTask(api.getQueue(), kernel, 1, &m_inEv, &m_outEv);
+    api.releaseKernel(kernel);
     
     clEnqueueMigrateMemObjects(api.getQueue(), 1, &m_outBuffer[0],
 			       CL_MIGRATE_MEM_OBJECT_HOST,
 			       1, &m_outEv, &m_doneEv);
+    clSetEventCallback(m_doneEv, CL_COMPLETE, retire,
+		       new Placement{&api, m_cu, bytes});
     m_hasRun = true;
   }
   bool outputOk() {
     for(unsigned int i=0; i < m_bufferSize; i++) {
-      if(m_out[i] != m_processDelay) {
+      if(m_out[i] != m_in[i] + m_processDelay) {
 	std::cout << "Output Error" << std::endl;
 	return false;
       }
@@ -0,0 +1,352 @@
+#ifndef __TASKGRAPH_H__
+#define __TASKGRAPH_H__
+
+#include <iostream>
+#include <vector>
+#include <functional>
+
+#include "ApiHandle.h"
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "CL/opencl.h"
+
+
+/* ***************************************************************************
+
+TaskGraph
+
+Declarative version of the event chains Task::run wires by hand. A graph
+is built once from nodes
+
+  MigrateIn    : move one or more graph buffers to the device
+  Kernel       : run a kernel, arguments are graph buffers or fixed scalars
+  MigrateOut   : move one or more graph buffers back to the host
+  HostCallback : run a host function once its predecessors are complete
+
+and edges between them. finalize() sorts the nodes and removes every edge
+that is implied by another path (transitive reduction), so each enqueue
+waits on the smallest possible event list.
+
+A GraphInstance binds the graph buffers to cl_mem objects and enqueues the
+whole graph on the (out of order) queue of the ApiHandle. Instances can be
+run again with new buffers; everything needed per run is allocated when
+the instance is created, so a run only issues the OpenCL calls.
+
+*************************************************************************** */
+class TaskGraph
+{
+public:
+  enum NodeType { MigrateIn, Kernel, MigrateOut, HostCallback };
+
+  // Kernel argument: either a graph buffer, bound per run, or a scalar
+  // fixed when the graph is built.
+  struct Arg {
+    int                        buffer;   // -1 for scalars
+    std::vector<unsigned char> value;
+  };
+  static Arg buf(unsigned int buffer) {
+    return Arg{(int)buffer, std::vector<unsigned char>()};
+  }
+  template <typename T>
+  static Arg scalar(const T &value) {
+    const unsigned char *p = (const unsigned char*)&value;
+    return Arg{-1, std::vector<unsigned char>(p, p+sizeof(T))};
+  }
+
+  // Called on a runtime thread with the user pointer given to the run.
+  typedef std::function<void(void*)> Callback;
+
+private:
+  struct Node {
+    NodeType                  type;
+    std::vector<unsigned int> buffers;   // MigrateIn / MigrateOut
+    std::vector<Arg>          args;      // Kernel
+    int                       cu;        // Kernel, -1 for any compute unit
+    Callback                  fn;        // HostCallback
+    std::vector<unsigned int> preds;     // declared edges
+    std::vector<unsigned int> wait;      // edges left after the reduction
+  };
+
+  ApiHandle&                m_api;
+  unsigned int              m_numBuffers;
+  std::vector<Node>         m_nodes;
+  std::vector<unsigned int> m_order;     // topological order
+  std::vector<unsigned int> m_sinks;
+  bool                      m_finalized;
+
+  friend class GraphInstance;
+
+  unsigned int addNode(NodeType type) {
+    if(m_finalized) {
+      std::cout << "FAILED TEST - Graph modified after finalize" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    Node node;
+    node.type = type;
+    node.cu   = -1;
+    m_nodes.push_back(node);
+    return m_nodes.size() - 1;
+  }
+
+public:
+  TaskGraph(ApiHandle &api) :
+    m_api(api),
+    m_numBuffers(0),
+    m_finalized(false)
+  {}
+
+  ApiHandle&   getApi()        { return m_api; }
+  unsigned int getNumBuffers() { return m_numBuffers; }
+  unsigned int getNumNodes()   { return m_nodes.size(); }
+
+  unsigned int addBuffer() { return m_numBuffers++; }
+
+  unsigned int addMigrateIn(const std::vector<unsigned int> &buffers) {
+    unsigned int n = addNode(MigrateIn);
+    m_nodes[n].buffers = buffers;
+    return n;
+  }
+  unsigned int addKernel(const std::vector<Arg> &args, int cu = -1) {
+    unsigned int n = addNode(Kernel);
+    m_nodes[n].args = args;
+    m_nodes[n].cu   = cu;
+    return n;
+  }
+  unsigned int addMigrateOut(const std::vector<unsigned int> &buffers) {
+    unsigned int n = addNode(MigrateOut);
+    m_nodes[n].buffers = buffers;
+    return n;
+  }
+  unsigned int addCallback(Callback fn) {
+    unsigned int n = addNode(HostCallback);
+    m_nodes[n].fn = fn;
+    return n;
+  }
+
+  // to starts only after from has completed
+  void addEdge(unsigned int from, unsigned int to) {
+    if(m_finalized || from >= m_nodes.size() || to >= m_nodes.size() || from == to) {
+      std::cout << "FAILED TEST - Invalid graph edge" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    m_nodes[to].preds.push_back(from);
+  }
+
+  unsigned int getNumEdges() {
+    unsigned int edges = 0;
+    for(unsigned int n = 0; n < m_nodes.size(); n++) edges += m_nodes[n].preds.size();
+    return edges;
+  }
+  unsigned int getNumWaits() {
+    unsigned int waits = 0;
+    for(unsigned int n = 0; n < m_nodes.size(); n++) waits += m_nodes[n].wait.size();
+    return waits;
+  }
+
+  void finalize() {
+    unsigned int numNodes = m_nodes.size();
+
+    // Topological order (Kahn), a leftover node means a cycle
+    std::vector<std::vector<unsigned int>> succs(numNodes);
+    std::vector<unsigned int> inDegree(numNodes, 0);
+    for(unsigned int n = 0; n < numNodes; n++) {
+      for(unsigned int p : m_nodes[n].preds) {
+	succs[p].push_back(n);
+	inDegree[n]++;
+      }
+    }
+    m_order.clear();
+    for(unsigned int n = 0; n < numNodes; n++) {
+      if(inDegree[n] == 0) m_order.push_back(n);
+    }
+    for(unsigned int i = 0; i < m_order.size(); i++) {
+      for(unsigned int s : succs[m_order[i]]) {
+	if(--inDegree[s] == 0) m_order.push_back(s);
+      }
+    }
+    if(m_order.size() != numNodes) {
+      std::cout << "FAILED TEST - Graph has a cycle" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    // reach[u][v]: v can be reached from u through at least one edge
+    std::vector<std::vector<bool>> reach(numNodes, std::vector<bool>(numNodes, false));
+    for(unsigned int i = numNodes; i-- > 0; ) {
+      unsigned int u = m_order[i];
+      for(unsigned int s : succs[u]) {
+	reach[u][s] = true;
+	for(unsigned int v = 0; v < numNodes; v++) {
+	  if(reach[s][v]) reach[u][v] = true;
+	}
+      }
+    }
+
+    // Keep an edge p -> n only if no other predecessor of n already
+    // depends on p.
+    m_sinks.clear();
+    for(unsigned int n = 0; n < numNodes; n++) {
+      std::vector<unsigned int> &preds = m_nodes[n].preds;
+      m_nodes[n].wait.clear();
+      for(unsigned int i = 0; i < preds.size(); i++) {
+	bool implied = false;
+	for(unsigned int j = 0; j < preds.size() && !implied; j++) {
+	  implied = (preds[j] == preds[i]) ? (j < i) : reach[preds[i]][preds[j]];
+	}
+	if(!implied) m_nodes[n].wait.push_back(preds[i]);
+      }
+      if(succs[n].empty()) m_sinks.push_back(n);
+    }
+    m_finalized = true;
+  }
+};
+
+
+class GraphInstance
+{
+  struct CallbackCtx {
+    const TaskGraph::Callback* fn;
+    void*                      user;
+    cl_event                   ev;
+  };
+
+  TaskGraph&               m_graph;
+  std::vector<cl_event>    m_events;    // completion event per node
+  std::vector<cl_event>    m_markers;   // per node, only for callbacks
+  std::vector<CallbackCtx> m_ctx;
+  std::vector<cl_event>    m_waitList;
+  std::vector<cl_mem>      m_memList;
+  cl_event                 m_doneEv;
+  bool                     m_hasRun;
+
+  static void CL_CALLBACK hostCallback(cl_event ev, cl_int status, void* data) {
+    CallbackCtx* ctx = static_cast<CallbackCtx*>(data);
+    (*ctx->fn)(ctx->user);
+    clSetUserEventStatus(ctx->ev, CL_COMPLETE);
+  }
+
+  // Gathers the events node n has to wait for into m_waitList
+  unsigned int gatherWait(unsigned int n, unsigned int numWait, const cl_event *waitList) {
+    const std::vector<unsigned int> &wait = m_graph.m_nodes[n].wait;
+    unsigned int count = 0;
+    if(wait.empty()) {
+      for(unsigned int i = 0; i < numWait; i++) m_waitList[count++] = waitList[i];
+    } else {
+      for(unsigned int i = 0; i < wait.size(); i++) m_waitList[count++] = m_events[wait[i]];
+    }
+    return count;
+  }
+
+public:
+  GraphInstance(TaskGraph &graph) :
+    m_graph(graph),
+    m_hasRun(false)
+  {
+    if(!graph.m_finalized) {
+      std::cout << "FAILED TEST - Graph not finalized" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    unsigned int numNodes = graph.m_nodes.size();
+    m_events.resize(numNodes, nullptr);
+    m_markers.resize(numNodes, nullptr);
+    m_ctx.resize(numNodes);
+    m_waitList.resize(numNodes > graph.m_sinks.size() ? numNodes : graph.m_sinks.size());
+    m_memList.resize(graph.m_numBuffers > 1 ? graph.m_numBuffers : 1);
+  }
+  GraphInstance(const GraphInstance &g) : GraphInstance(g.m_graph) {}
+  ~GraphInstance() {
+    release();
+  }
+
+  cl_event* getDoneEv() { return &m_doneEv; }
+
+  // Waits for the previous run to complete (callbacks included) and
+  // releases its events.
+  void release() {
+    if(m_hasRun) {
+      clWaitForEvents(1, &m_doneEv);
+      for(unsigned int n = 0; n < m_events.size(); n++) {
+	clReleaseEvent(m_events[n]);
+	if(m_markers[n] != nullptr) {
+	  clReleaseEvent(m_markers[n]);
+	  m_markers[n] = nullptr;
+	}
+      }
+      clReleaseEvent(m_doneEv);
+      m_hasRun = false;
+    }
+  }
+
+  // Enqueues the graph with buffers[b] bound to graph buffer b. Nodes
+  // without predecessors wait on the optional external wait list, user is
+  // handed to the host callbacks.
+  void run(const cl_mem *buffers, void *user = nullptr,
+	   unsigned int numWait = 0, const cl_event *waitList = nullptr) {
+    release();
+    if(numWait > m_waitList.size()) m_waitList.resize(numWait);
+
+    ApiHandle &api = m_graph.m_api;
+    int err;
+    for(unsigned int n : m_graph.m_order) {
+      const TaskGraph::Node &node = m_graph.m_nodes[n];
+      unsigned int count = gatherWait(n, numWait, waitList);
+      const cl_event *wait = count ? m_waitList.data() : nullptr;
+
+      switch(node.type) {
+      case TaskGraph::MigrateIn:
+      case TaskGraph::MigrateOut:
+	for(unsigned int i = 0; i < node.buffers.size(); i++) {
+	  m_memList[i] = buffers[node.buffers[i]];
+	}
+	clEnqueueMigrateMemObjects(api.getQueue(), node.buffers.size(), m_memList.data(),
+				   node.type == TaskGraph::MigrateOut ? CL_MIGRATE_MEM_OBJECT_HOST : 0,
+				   count, wait, &m_events[n]);
+	break;
+
+      case TaskGraph::Kernel: {
+	cl_kernel kernel = api.acquireKernel(node.cu);
+	for(unsigned int a = 0; a < node.args.size(); a++) {
+	  const TaskGraph::Arg &arg = node.args[a];
+	  if(arg.buffer >= 0) {
+	    clSetKernelArg(kernel, a, sizeof(cl_mem), &buffers[arg.buffer]);
+	  } else {
+	    clSetKernelArg(kernel, a, arg.value.size(), arg.value.data());
+	  }
+	}
+	clEnqueueTask(api.getQueue(), kernel, count, wait, &m_events[n]);
+	api.releaseKernel(kernel);
+	break;
+      }
+
+      case TaskGraph::HostCallback:
+	m_ctx[n].fn   = &node.fn;
+	m_ctx[n].user = user;
+	m_ctx[n].ev   = clCreateUserEvent(api.getContext(), &err);
+	m_events[n]   = m_ctx[n].ev;
+	if(count == 0) {
+	  hostCallback(nullptr, CL_COMPLETE, &m_ctx[n]);
+	} else if(count == 1) {
+	  clSetEventCallback(m_waitList[0], CL_COMPLETE, hostCallback, &m_ctx[n]);
+	} else {
+	  // A marker turns several predecessors into the single event the
+	  // callback can be attached to.
+	  clEnqueueMarkerWithWaitList(api.getQueue(), count, wait, &m_markers[n]);
+	  clSetEventCallback(m_markers[n], CL_COMPLETE, hostCallback, &m_ctx[n]);
+	}
+	break;
+      }
+    }
+
+    const std::vector<unsigned int> &sinks = m_graph.m_sinks;
+    if(sinks.size() == 1) {
+      m_doneEv = m_events[sinks[0]];
+      clRetainEvent(m_doneEv);
+    } else {
+      for(unsigned int i = 0; i < sinks.size(); i++) m_waitList[i] = m_events[sinks[i]];
+      clEnqueueMarkerWithWaitList(api.getQueue(), sinks.size(), m_waitList.data(), &m_doneEv);
+    }
+    m_hasRun = true;
+  }
+};
+
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef __TASKSTREAM_H__
+#define __TASKSTREAM_H__
+
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "SpscQueue.h"
+
+
+/* ***************************************************************************
+
+TaskStream
+
+Runs an unbounded stream of tasks through a fixed set of slots (Task
+objects) instead of building every Task up front.
+
+A producer thread takes a free slot, lets the caller fill its input
+buffer, and runs the task. A consumer thread waits for submitted slots in
+order, hands each completed task to the caller, and returns the slot to
+the producer. The two threads are joined by two bounded lock-free queues:
+
+   free slots:      consumer -> producer
+   submitted slots: producer -> consumer
+
+Both queues hold at most numSlots entries, so push never fails and at
+most numSlots tasks are in flight at any time.
+
+The class is templated on the handle and task types, so it works with
+ApiHandle/Task as well as with the SwApiHandle/SwTask software model.
+
+*************************************************************************** */
+template <typename Api, typename TaskT>
+class TaskStream
+{
+  Api&                     m_api;
+  std::vector<TaskT>       m_slots;
+  SpscQueue<unsigned int>  m_free;
+  SpscQueue<unsigned int>  m_submitted;
+
+  unsigned long long       m_producerStalls;
+  unsigned long long       m_consumerStalls;
+  double                   m_producerWait;
+  double                   m_consumerWait;
+
+  // Pops the next slot from q, yielding while it is empty. A pop that has
+  // to wait counts as one stall, and the time it waited is added to wait.
+  static unsigned int waitPop(SpscQueue<unsigned int> &q,
+			      unsigned long long &stalls, double &wait) {
+    unsigned int s;
+    if(q.pop(s)) return s;
+    stalls++;
+    std::chrono::high_resolution_clock::time_point begin =
+      std::chrono::high_resolution_clock::now();
+    while(!q.pop(s)) {
+      std::this_thread::yield();
+    }
+    wait += std::chrono::duration<double>(
+      std::chrono::high_resolution_clock::now() - begin).count();
+    return s;
+  }
+
+public:
+  TaskStream(Api &api, unsigned int numSlots,
+	     unsigned int bufferSize, unsigned int processDelay) :
+    m_api(api),
+    m_slots(numSlots, TaskT(bufferSize, processDelay)),
+    m_free(numSlots),
+    m_submitted(numSlots),
+    m_producerStalls(0),
+    m_consumerStalls(0),
+    m_producerWait(0),
+    m_consumerWait(0)
+  {
+    for(unsigned int s = 0; s < numSlots; s++) {
+      m_free.push(s);
+    }
+  }
+
+  // Number of times the producer found no free slot, i.e. the device or the
+  // consumer was the bottleneck, and the number of times the consumer found
+  // nothing submitted, i.e. the producer was the bottleneck. The wait
+  // times are the seconds spent in those stalls.
+  unsigned long long getProducerStalls() { return m_producerStalls; }
+  unsigned long long getConsumerStalls() { return m_consumerStalls; }
+  double             getProducerWait()   { return m_producerWait; }
+  double             getConsumerWait()   { return m_consumerWait; }
+
+  // fill(TaskT&, seq) prepares the input of task number seq, consume(TaskT&,
+  // seq) is called once its output is back on the host. fill runs on the
+  // producer thread, consume on the calling thread.
+  template <typename Fill, typename Consume>
+  void run(unsigned long long numTasks, Fill fill, Consume consume) {
+    m_producerStalls = 0;
+    m_consumerStalls = 0;
+    m_producerWait   = 0;
+    m_consumerWait   = 0;
+
+    std::thread producer([&]() {
+      for(unsigned long long seq = 0; seq < numTasks; seq++) {
+	unsigned int s = waitPop(m_free, m_producerStalls, m_producerWait);
+	fill(m_slots[s], seq);
+	m_slots[s].run(m_api);
+	m_submitted.push(s);
+      }
+    });
+
+    for(unsigned long long seq = 0; seq < numTasks; seq++) {
+      unsigned int s = waitPop(m_submitted, m_consumerStalls, m_consumerWait);
+      clWaitForEvents(1, m_slots[s].getDoneEv());
+      consume(m_slots[s], seq);
+      m_free.push(s);
+    }
+    producer.join();
+  }
+};
+
+
+#endif
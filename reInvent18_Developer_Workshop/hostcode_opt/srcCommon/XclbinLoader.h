@@ -0,0 +1,218 @@
+#ifndef __XCLBINLOADER_H__
+#define __XCLBINLOADER_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <chrono>
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "CL/opencl.h"
+
+
+/* ***************************************************************************
+
+XclbinLoader
+
+Process wide startup path for the hostcode_opt hosts. The first request
+for an xclbin
+
+  1. finds the Xilinx platform and its accelerator device
+  2. creates the context
+  3. maps the xclbin file (mmap, no copy into a host buffer)
+  4. creates the program, which downloads the bitstream
+
+and reports the time spent in each phase. The context and program are
+cached under the xclbin UUID, so every further ApiHandle in the process
+(whatever path it was given) shares them and starts without touching the
+device. Across processes, XRT itself skips the download when the device
+already holds an xclbin with the same UUID.
+
+Users retain the context and program they get and release them when done;
+the cache keeps its own reference until the process exits.
+
+*************************************************************************** */
+class XclbinLoader
+{
+public:
+  struct Program {
+    cl_device_id device;
+    cl_context   context;
+    cl_program   program;
+    std::string  uuid;
+  };
+
+private:
+  typedef std::chrono::high_resolution_clock hr_clock;
+
+  std::mutex                     m_mutex;
+  std::map<std::string, Program> m_programs;   // by UUID
+  bool                           m_hasDevice;
+  cl_device_id                   m_device;
+  cl_context                     m_context;
+
+  XclbinLoader() : m_hasDevice(false) {}
+  ~XclbinLoader() {
+    for(auto &p : m_programs) {
+      clReleaseProgram(p.second.program);
+    }
+    if(m_hasDevice) {
+      clReleaseContext(m_context);
+    }
+  }
+
+  static double msSince(hr_clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(hr_clock::now() - begin).count();
+  }
+
+  // Read only view of the xclbin file
+  struct Mapping {
+    void*  data;
+    size_t size;
+
+    Mapping(const char *filename) : data(MAP_FAILED), size(0) {
+      int fd = open(filename, O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0) {
+	printf("Error: Could not read file %s\n", filename);
+	exit(EXIT_FAILURE);
+      }
+      size = st.st_size;
+      data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (data == MAP_FAILED) {
+	printf("Error: Could not map file %s\n", filename);
+	exit(EXIT_FAILURE);
+      }
+    }
+    ~Mapping() {
+      munmap(data, size);
+    }
+  };
+
+  // The UUID lives in the axlf header at offset 416 of an "xclbin2" file.
+  // Older formats have none, the file name is used as key instead.
+  static std::string readUuid(const Mapping &m, const char *filename) {
+    const unsigned char *p = static_cast<const unsigned char*>(m.data);
+    if (m.size < 432 || memcmp(p, "xclbin2", 8) != 0) {
+      return std::string("file:") + filename;
+    }
+    char uuid[33];
+    for(unsigned int i = 0; i < 16; i++) {
+      sprintf(&uuid[2*i], "%02x", p[416+i]);
+    }
+    return std::string(uuid);
+  }
+
+  void openDevice() {
+    int err;
+    char cl_platform_vendor[1001];
+    char cl_device_name[1001];
+    cl_uint platform_count;
+
+    err = clGetPlatformIDs(0, nullptr, &platform_count);
+    if(err !=CL_SUCCESS) {
+      std::cout << "PlatformID error" << std::endl;
+      exit(1);
+    }
+    std::vector<cl_platform_id> platforms(platform_count);
+    clGetPlatformIDs(platform_count, platforms.data(), nullptr);
+
+    cl_platform_id platform_id;
+    bool found = false;
+    for (int p = 0; p < (int)platform_count; ++p) {
+      platform_id = platforms[p];
+      clGetPlatformInfo(platform_id,CL_PLATFORM_VENDOR,1000,
+			(void *)cl_platform_vendor,
+			NULL);
+      if(!strcmp(cl_platform_vendor,"Xilinx")) {
+	found = true;
+	break;
+      }
+    }
+    if (!found){
+      std::cout << "Platform Not Found" << std::endl;
+      exit(err);
+    }
+
+    err = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ACCELERATOR, 1, &m_device, NULL);
+    if (err != CL_SUCCESS) {
+      std::cout << "FAILED TEST - Device" << std::endl;
+      exit(err);
+    }
+    clGetDeviceInfo(m_device, CL_DEVICE_NAME, 1000, (void*)cl_device_name, NULL);
+    std::cout << "DEVICE: " << cl_device_name << std::endl;
+  }
+
+  Program& load(const char *binaryName) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int err;
+    double tDevice = 0, tContext = 0, tMap = 0, tProgram = 0;
+
+    if(!m_hasDevice) {
+      auto begin = hr_clock::now();
+      openDevice();
+      tDevice = msSince(begin);
+
+      begin = hr_clock::now();
+      m_context = clCreateContext(0, 1, &m_device, NULL, NULL, &err);
+      if (err != CL_SUCCESS) {
+	std::cout << "FAILED TEST - Context" << std::endl;
+	exit(err);
+      }
+      tContext = msSince(begin);
+      m_hasDevice = true;
+    }
+
+    auto begin = hr_clock::now();
+    Mapping file(binaryName);
+    std::string uuid = readUuid(file, binaryName);
+    tMap = msSince(begin);
+
+    auto cached = m_programs.find(uuid);
+    if(cached != m_programs.end()) {
+      std::cout << "Reusing Bitstream: " << binaryName << " (" << uuid << ")" << std::endl;
+      return cached->second;
+    }
+
+    std::cout << "Loading Bitstream: " << binaryName << " (" << uuid << ")" << std::endl;
+    begin = hr_clock::now();
+    const unsigned char *bin = static_cast<const unsigned char*>(file.data);
+    Program prog;
+    prog.device  = m_device;
+    prog.context = m_context;
+    prog.uuid    = uuid;
+    prog.program = clCreateProgramWithBinary(m_context, 1, &m_device, &file.size,
+					     &bin, NULL, &err);
+    if (err != CL_SUCCESS) {
+      std::cout << "FAILED TEST - Program Creation" << std::endl;
+      exit(err);
+    }
+    tProgram = msSince(begin);
+
+    std::cout << "Startup [ms]: device " << tDevice << ", context " << tContext
+	      << ", map xclbin " << tMap << ", program " << tProgram << std::endl;
+    return m_programs[uuid] = prog;
+  }
+
+public:
+  // Context and program for binaryName; both are retained for the caller.
+  static Program get(const char *binaryName) {
+    static XclbinLoader loader;
+    Program prog = loader.load(binaryName);
+    clRetainContext(prog.context);
+    clRetainProgram(prog.program);
+    return prog;
+  }
+};
+
+
+#endif
@@ -0,0 +1,197 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <atomic>
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "CL/opencl.h"
+
+#include "AlignedAllocator.h"
+#include "ApiHandle.h"
+#include "Task.h"
+#include "TaskGraph.h"
+
+// Host side buffers of one in-flight graph instance. The cl_mem objects
+// are created once and rebound on every run.
+struct Slot {
+  std::vector< ap_int<512>, AlignedAllocator< ap_int<512> >> m_in;
+  std::vector< ap_int<512>, AlignedAllocator< ap_int<512> >> m_out;
+  cl_mem_ext_ptr_t  m_inExt;
+  cl_mem_ext_ptr_t  m_outExt;
+  cl_mem            m_buffers[2];
+
+  Slot(ApiHandle &api, unsigned int bufferSize, unsigned int seed) :
+    m_in(bufferSize),
+    m_out(bufferSize)
+  {
+    int err;
+    for(unsigned int i=0; i < bufferSize; i++) {
+      m_in[i] = seed + i;
+    }
+    m_inExt.flags  = ApiHandle::bankFlag(api.getInBank(0));
+    m_inExt.obj    = m_in.data();
+    m_inExt.param  = 0;
+    m_outExt.flags = ApiHandle::bankFlag(api.getOutBank(0));
+    m_outExt.obj   = m_out.data();
+    m_outExt.param = 0;
+
+    m_buffers[0] = clCreateBuffer(api.getContext(),
+				  CL_MEM_EXT_PTR_XILINX | CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+				  bufferSize*sizeof(ap_int<512>), &m_inExt, &err);
+    m_buffers[1] = clCreateBuffer(api.getContext(),
+				  CL_MEM_EXT_PTR_XILINX | CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+				  bufferSize*sizeof(ap_int<512>), &m_outExt, &err);
+    if (err != CL_SUCCESS) {
+      std::cout << "FAILED TEST - Buffer Creation" << std::endl;
+      exit(err);
+    }
+  }
+  ~Slot() {
+    clReleaseMemObject(m_buffers[0]);
+    clReleaseMemObject(m_buffers[1]);
+  }
+};
+
+int main(int argc, char* argv[]) {
+
+  // -- Environment / Usage Check -------------------------------------------
+
+  char *xcl_mode = getenv("XCL_EMULATION_MODE");
+
+  if (argc < 2 || argc > 5) {
+    printf("\nUsage: %s "
+	   "./xclbin/pass.<emulation_mode>.<dsa>.xclbin [numRuns] [bufSize] [inFlight]\n"
+	   "\n Where the migrate/execute/read/check graph runs numRuns times on pow(2,<bufSize>) 512-bit values.\n" ,
+	   argv[0]);
+    return EXIT_FAILURE;
+  }
+  char*        binaryName   = argv[1];
+
+  // -- Common Parameters ---------------------------------------------------
+
+  unsigned int numRuns                  = (argc > 2) ? atoi(argv[2]) : 1000;
+  bool         oooQueue                 = true;
+  unsigned int processDelay             = 1;
+  unsigned int bufferSize               = 1 << ((argc > 3) ? atoi(argv[3]) : 10);
+  unsigned int inFlight                 = (argc > 4) ? atoi(argv[4]) : 4;
+
+  // -- Setup ---------------------------------------------------------------
+
+  ApiHandle api(binaryName, oooQueue);
+
+  std::cout << std::endl;
+  std::cout << std::endl;
+  std::cout << "    Total number of runs: " << numRuns      << std::endl;
+  std::cout << "              BufferSize: " << bufferSize   << std::endl;
+  std::cout << "      Bytes per Transfer: " << bufferSize*512/8 << std::endl;
+  std::cout << "            processDelay: " << processDelay << std::endl;
+  std::cout << "                inFlight: " << inFlight     << std::endl;
+  std::cout << std::endl;
+
+  // The check reads both buffers, so it is declared to depend on the input
+  // migration as well; that edge is implied by the chain and is dropped.
+  std::atomic<unsigned int> failures(0);
+  TaskGraph graph(api);
+  unsigned int in     = graph.addBuffer();
+  unsigned int out    = graph.addBuffer();
+  unsigned int write  = graph.addMigrateIn({in});
+  unsigned int exec   = graph.addKernel({TaskGraph::buf(in), TaskGraph::buf(out),
+					 TaskGraph::scalar(bufferSize),
+					 TaskGraph::scalar(processDelay)});
+  unsigned int read   = graph.addMigrateOut({out});
+  unsigned int check  = graph.addCallback([&](void *user) {
+      Slot *slot = static_cast<Slot*>(user);
+      for(unsigned int i=0; i < slot->m_in.size(); i++) {
+	if(slot->m_out[i] != slot->m_in[i] + processDelay) {
+	  failures++;
+	  return;
+	}
+      }
+    });
+  graph.addEdge(write, exec);
+  graph.addEdge(exec,  read);
+  graph.addEdge(read,  check);
+  graph.addEdge(write, check);
+  graph.finalize();
+
+  std::cout << "   Graph nodes / edges: " << graph.getNumNodes() << " / "
+	    << graph.getNumEdges() << " declared, " << graph.getNumWaits()
+	    << " after reduction" << std::endl;
+
+  std::vector<Slot*>         slots;
+  std::vector<GraphInstance> instances(inFlight, GraphInstance(graph));
+  for(unsigned int s=0; s < inFlight; s++) {
+    slots.push_back(new Slot(api, bufferSize, s*bufferSize));
+  }
+
+  // -- Execution -----------------------------------------------------------
+
+  // Only the time spent inside run() is accounted as submission overhead,
+  // waiting for a slot to become free is excluded for both variants.
+  std::cout << "Running graph" << std::endl;
+  std::chrono::duration<double> graph_submit(0);
+  auto graph_begin = std::chrono::high_resolution_clock::now();
+  for(unsigned int i=0; i < numRuns; i++) {
+    unsigned int s = i % inFlight;
+    if(i >= inFlight) {
+      instances[s].release();
+    }
+    auto submit_begin = std::chrono::high_resolution_clock::now();
+    instances[s].run(slots[s]->m_buffers, slots[s]);
+    graph_submit += std::chrono::high_resolution_clock::now() - submit_begin;
+  }
+  for(unsigned int s=0; s < inFlight; s++) {
+    instances[s].release();
+  }
+  auto graph_end = std::chrono::high_resolution_clock::now();
+
+  std::cout << "Running Task" << std::endl;
+  std::vector<Task> tasks(inFlight, Task(bufferSize, processDelay));
+  std::chrono::duration<double> task_submit(0);
+  auto task_begin = std::chrono::high_resolution_clock::now();
+  for(unsigned int i=0; i < numRuns; i++) {
+    unsigned int s = i % inFlight;
+    if(i >= inFlight) {
+      clWaitForEvents(1, tasks[s].getDoneEv());
+    }
+    auto submit_begin = std::chrono::high_resolution_clock::now();
+    tasks[s].run(api);
+    task_submit += std::chrono::high_resolution_clock::now() - submit_begin;
+  }
+  clFinish(api.getQueue());
+  auto task_end = std::chrono::high_resolution_clock::now();
+
+  // -- Testing -------------------------------------------------------------
+
+  bool outputOk = (failures == 0);
+  for(unsigned int s=0; s < inFlight; s++) {
+    outputOk = tasks[s].outputOk() && outputOk;
+    delete slots[s];
+  }
+  if(!outputOk) {
+    std::cout << "FAIL: Output Corrupted" << std::endl;
+    return 1;
+  }
+
+  // -- Performance Statistics ----------------------------------------------
+
+  if (xcl_mode == NULL) {
+    std::chrono::duration<double> graph_duration = graph_end - graph_begin;
+    std::chrono::duration<double> task_duration  = task_end  - task_begin;
+
+    double total = (double) bufferSize * numRuns * 512 / (1024.0*1024.0);
+    std::cout << std::endl;
+    std::cout << "          Total data: " << total << " MBits" << std::endl;
+    std::cout << "    Graph Throughput: " << total / graph_duration.count()
+	      << " MBits/s" << std::endl;
+    std::cout << "     Task Throughput: " << total / task_duration.count()
+	      << " MBits/s" << std::endl;
+    std::cout << "Graph Submit per Run: " << 1e6 * graph_submit.count() / numRuns
+	      << " us" << std::endl;
+    std::cout << " Task Submit per Run: " << 1e6 * task_submit.count() / numRuns
+	      << " us" << std::endl;
+  }
+  std::cout << "\nPASS: Simulation" << std::endl;
+
+ return 0;
+}
@@ -0,0 +1,289 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <ap_int.h>
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "CL/opencl.h"
+
+#include "AlignedAllocator.h"
+#include "ApiHandle.h"
+
+typedef std::chrono::high_resolution_clock hr_clock;
+
+// How the host learns that the kernel has completed
+enum Notify { Wait, Poll, Callback };
+const char* notifyName[] = { "wait", "poll", "callback" };
+
+// One invocation split into the host API time (set args, enqueue, flush),
+// the time from queued to start and the kernel execution as reported by
+// the profiling counters, and whatever is left until the host noticed.
+struct Sample {
+  double api;
+  double queueToStart;
+  double exec;
+  double detect;
+  double total;
+};
+
+struct Completion {
+  std::mutex              m_mutex;
+  std::condition_variable m_cv;
+  bool                    m_done;
+};
+
+static void CL_CALLBACK notifyDone(cl_event ev, cl_int status, void* data) {
+  Completion* c = static_cast<Completion*>(data);
+  {
+    std::lock_guard<std::mutex> lock(c->m_mutex);
+    c->m_done = true;
+  }
+  c->m_cv.notify_one();
+}
+
+double profile(cl_event ev, cl_profiling_info from, cl_profiling_info to) {
+  cl_ulong t0, t1;
+  clGetEventProfilingInfo(ev, from, sizeof(cl_ulong), &t0, nullptr);
+  clGetEventProfilingInfo(ev, to,   sizeof(cl_ulong), &t1, nullptr);
+  return (t1 - t0) / 1000.0;
+}
+
+// Issues numRuns kernel invocations one after the other, each one only
+// after the previous one was seen to complete.
+std::vector<Sample> measure(ApiHandle &api, Notify mode, cl_mem in, cl_mem out,
+			    unsigned int bufferSize, unsigned int processDelay,
+			    unsigned int numRuns, unsigned int numWarmup) {
+  std::vector<Sample> samples;
+  samples.reserve(numRuns);
+  Completion completion;
+
+  for(unsigned int i=0; i < numWarmup + numRuns; i++) {
+    cl_event ev;
+    auto begin = hr_clock::now();
+    cl_kernel kernel = api.acquireKernel();
+    clSetKernelArg(kernel, 0, sizeof(cl_mem), &in);
+    clSetKernelArg(kernel, 1, sizeof(cl_mem), &out);
+    clSetKernelArg(kernel, 2, sizeof(unsigned int), &bufferSize);
+    clSetKernelArg(kernel, 3, sizeof(unsigned int), &processDelay);
+    clEnqueueTask(api.getQueue(), kernel, 0, nullptr, &ev);
+    api.releaseKernel(kernel);
+    if(mode == Callback) {
+      {
+	std::lock_guard<std::mutex> lock(completion.m_mutex);
+	completion.m_done = false;
+      }
+      clSetEventCallback(ev, CL_COMPLETE, notifyDone, &completion);
+    }
+    clFlush(api.getQueue());
+    auto submitted = hr_clock::now();
+
+    if(mode == Wait) {
+      clWaitForEvents(1, &ev);
+    } else if(mode == Poll) {
+      // CL_COMPLETE is 0, the other states are positive and an event
+      // that ended with an error has a negative status
+      cl_int status = CL_QUEUED;
+      while(status > CL_COMPLETE) {
+	cl_int err = clGetEventInfo(ev, CL_EVENT_COMMAND_EXECUTION_STATUS,
+				    sizeof(cl_int), &status, nullptr);
+	if(err != CL_SUCCESS) {
+	  std::cout << "FAILED TEST - Event Status Query" << std::endl;
+	  exit(err);
+	}
+      }
+      if(status < 0) {
+	std::cout << "FAILED TEST - Kernel Execution (" << status << ")" << std::endl;
+	exit(status);
+      }
+    } else {
+      std::unique_lock<std::mutex> lock(completion.m_mutex);
+      completion.m_cv.wait(lock, [&]{ return completion.m_done; });
+    }
+    auto end = hr_clock::now();
+
+    if(i >= numWarmup) {
+      Sample s;
+      s.api          = std::chrono::duration<double, std::micro>(submitted - begin).count();
+      s.total        = std::chrono::duration<double, std::micro>(end - begin).count();
+      s.queueToStart = profile(ev, CL_PROFILING_COMMAND_QUEUED, CL_PROFILING_COMMAND_START);
+      s.exec         = profile(ev, CL_PROFILING_COMMAND_START,  CL_PROFILING_COMMAND_END);
+      s.detect       = s.total - s.api - s.queueToStart - s.exec;
+      if(s.detect < 0) s.detect = 0;
+      samples.push_back(s);
+    }
+    clReleaseEvent(ev);
+  }
+  return samples;
+}
+
+double percentile(std::vector<double> v, double p) {
+  if(v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+std::vector<double> column(const std::vector<Sample> &samples, double Sample::*field) {
+  std::vector<double> v;
+  for(unsigned int i=0; i < samples.size(); i++) v.push_back(samples[i].*field);
+  return v;
+}
+
+// Log2 buckets in us, printed as a bar per bucket
+void histogram(const std::vector<Sample> &samples) {
+  std::vector<unsigned int> buckets(24, 0);
+  unsigned int peak = 1;
+  for(unsigned int i=0; i < samples.size(); i++) {
+    unsigned int b = 0;
+    while(b < buckets.size()-1 && samples[i].total >= (double)(2 << b)) b++;
+    peak = std::max(peak, ++buckets[b]);
+  }
+  for(unsigned int b=0; b < buckets.size(); b++) {
+    if(buckets[b] == 0) continue;
+    std::cout.width(10);
+    std::cout << (b ? (1 << b) : 0) << " us |"
+	      << std::string((size_t)(50.0*buckets[b]/peak), '#')
+	      << " " << buckets[b] << std::endl;
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  // -- Environment / Usage Check -------------------------------------------
+
+  if (argc < 2 || argc > 5) {
+    printf("\nUsage: %s "
+	   "./xclbin/pass.<emulation_mode>.<dsa>.xclbin [numRuns] [bufSize] [wait|poll|callback|all]\n"
+	   "\n Where numRuns back to back invocations on pow(2,<bufSize>) 512-bit values are timed.\n" ,
+	   argv[0]);
+    return EXIT_FAILURE;
+  }
+  char*        binaryName   = argv[1];
+
+  // -- Common Parameters ---------------------------------------------------
+
+  unsigned int numRuns                  = (argc > 2) ? atoi(argv[2]) : 1000;
+  unsigned int numWarmup                = 10;
+  bool         oooQueue                 = false;
+  unsigned int processDelay             = 1;
+  unsigned int bufferSize               = 1 << ((argc > 3) ? atoi(argv[3]) : 0);
+  std::string  modeArg                  = (argc > 4) ? argv[4] : "all";
+
+  std::vector<Notify> modes;
+  for(int m = Wait; m <= Callback; m++) {
+    if(modeArg == "all" || modeArg == notifyName[m]) modes.push_back((Notify)m);
+  }
+  if(modes.empty()) {
+    std::cout << "Unknown notification mode: " << modeArg << std::endl;
+    return EXIT_FAILURE;
+  }
+  if(numRuns == 0) {
+    std::cout << "At least one run is needed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // -- Setup ---------------------------------------------------------------
+
+  ApiHandle api(binaryName, oooQueue);
+
+  std::cout << std::endl;
+  std::cout << std::endl;
+  std::cout << "    Total number of runs: " << numRuns      << std::endl;
+  std::cout << "              BufferSize: " << bufferSize   << std::endl;
+  std::cout << "      Bytes per Transfer: " << bufferSize*512/8 << std::endl;
+  std::cout << "            processDelay: " << processDelay << std::endl;
+  std::cout << std::endl;
+
+  // The buffers stay on the device, only the kernel launch is timed
+  int err;
+  std::vector< ap_int<512>, AlignedAllocator< ap_int<512> >> hostIn(bufferSize, 0);
+  std::vector< ap_int<512>, AlignedAllocator< ap_int<512> >> hostOut(bufferSize);
+  cl_mem_ext_ptr_t inExt  = { ApiHandle::bankFlag(api.getInBank(0)),  hostIn.data(),  0 };
+  cl_mem_ext_ptr_t outExt = { ApiHandle::bankFlag(api.getOutBank(0)), hostOut.data(), 0 };
+  cl_mem in  = clCreateBuffer(api.getContext(),
+			      CL_MEM_EXT_PTR_XILINX | CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+			      bufferSize*sizeof(ap_int<512>), &inExt, &err);
+  cl_mem out = clCreateBuffer(api.getContext(),
+			      CL_MEM_EXT_PTR_XILINX | CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+			      bufferSize*sizeof(ap_int<512>), &outExt, &err);
+  if (err != CL_SUCCESS) {
+    std::cout << "FAILED TEST - Buffer Creation" << std::endl;
+    exit(err);
+  }
+  cl_mem buffers[2] = { in, out };
+  clEnqueueMigrateMemObjects(api.getQueue(), 2, buffers, 0, 0, nullptr, nullptr);
+  clFinish(api.getQueue());
+
+  // -- Execution -----------------------------------------------------------
+
+  std::vector<std::vector<Sample>> results;
+  for(unsigned int m = 0; m < modes.size(); m++) {
+    std::cout << "Running " << notifyName[modes[m]] << std::endl;
+    results.push_back(measure(api, modes[m], in, out, bufferSize, processDelay,
+			      numRuns, numWarmup));
+  }
+
+  clEnqueueMigrateMemObjects(api.getQueue(), 1, &out, CL_MIGRATE_MEM_OBJECT_HOST,
+			     0, nullptr, nullptr);
+  clFinish(api.getQueue());
+  clReleaseMemObject(in);
+  clReleaseMemObject(out);
+
+  // -- Testing -------------------------------------------------------------
+
+  for(unsigned int i=0; i < bufferSize; i++) {
+    if(hostOut[i] != hostIn[i] + processDelay) {
+      std::cout << "FAIL: Output Corrupted" << std::endl;
+      return 1;
+    }
+  }
+
+  // -- Performance Statistics ----------------------------------------------
+
+  struct Row { const char* name; double Sample::*field; };
+  const Row rows[] = {
+    { "    host API (p50)", &Sample::api          },
+    { "queue->start (p50)", &Sample::queueToStart },
+    { "   execution (p50)", &Sample::exec         },
+    { "   detection (p50)", &Sample::detect       },
+    { "       total (p50)", &Sample::total        },
+  };
+
+  std::cout << std::endl;
+  std::cout << "               [us]";
+  for(unsigned int m = 0; m < modes.size(); m++) {
+    std::cout.width(12);
+    std::cout << notifyName[modes[m]];
+  }
+  std::cout << std::endl;
+  for(const Row &row : rows) {
+    std::cout << row.name;
+    for(unsigned int m = 0; m < modes.size(); m++) {
+      std::cout.width(12);
+      std::cout << percentile(column(results[m], row.field), 0.5);
+    }
+    std::cout << std::endl;
+  }
+  const double pct[] = { 0.9, 0.99, 1.0 };
+  const char*  pctName[] = { "       total (p90)", "       total (p99)", "       total (max)" };
+  for(unsigned int p = 0; p < 3; p++) {
+    std::cout << pctName[p];
+    for(unsigned int m = 0; m < modes.size(); m++) {
+      std::cout.width(12);
+      std::cout << percentile(column(results[m], &Sample::total), pct[p]);
+    }
+    std::cout << std::endl;
+  }
+
+  for(unsigned int m = 0; m < modes.size(); m++) {
+    std::cout << std::endl << " Latency histogram (" << notifyName[modes[m]] << ")" << std::endl;
+    histogram(results[m]);
+  }
+  std::cout << "\nPASS: Simulation" << std::endl;
+
+ return 0;
+}
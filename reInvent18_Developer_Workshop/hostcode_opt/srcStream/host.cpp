@@ -0,0 +1,111 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+
+#ifdef PASS_SW
+#include "SwPass.h"
+typedef SwApiHandle ApiHandle;
+typedef SwTask      Task;
+#else
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "CL/opencl.h"
+
+#include "ApiHandle.h"
+#include "Task.h"
+#endif
+#include "TaskStream.h"
+
+int main(int argc, char* argv[]) {
+
+  // -- Environment / Usage Check -------------------------------------------
+
+  char *xcl_mode = getenv("XCL_EMULATION_MODE");
+
+  if (argc < 2 || argc > 5) {
+    printf("\nUsage: %s "
+	   "./xclbin/pass.<emulation_mode>.<dsa>.xclbin [numTasks] [bufSize] [numSlots]\n"
+	   "\n Where numTasks buffers of pow(2,<bufSize>) 512-bit values are streamed through numSlots buffers.\n" ,
+	   argv[0]);
+    return EXIT_FAILURE;
+  }
+  char*        binaryName   = argv[1];
+
+  // -- Common Parameters ---------------------------------------------------
+
+  unsigned long long numTasks           = (argc > 2) ? atoll(argv[2]) : 1000;
+  bool         oooQueue                 = true;
+  unsigned int processDelay             = 1;
+  unsigned int bufferSize               = 1 << ((argc > 3) ? atoi(argv[3]) : 14);
+  unsigned int numSlots                 = (argc > 4) ? atoi(argv[4]) : 4;
+
+  // -- Setup ---------------------------------------------------------------
+
+  ApiHandle api(binaryName, oooQueue);
+
+  std::cout << std::endl;
+  std::cout << std::endl;
+  std::cout << "   Total number of tasks: " << numTasks     << std::endl;
+  std::cout << "              BufferSize: " << bufferSize   << std::endl;
+  std::cout << "        Bits per Element: " << 512          << std::endl;
+  std::cout << "      Bytes per Transfer: " << bufferSize*512/8 << std::endl;
+  std::cout << "            processDelay: " << processDelay << std::endl;
+  std::cout << "         Buffers (slots): " << numSlots     << std::endl;
+  std::cout << std::boolalpha;
+  std::cout << "      Out of Order Queue: " << oooQueue << std::endl;
+  std::cout << std::noboolalpha;
+  std::cout << std::endl;
+
+  TaskStream<ApiHandle, Task> stream(api, numSlots, bufferSize, processDelay);
+
+  std::cout << "Running FPGA" << std::endl;
+  auto fpga_begin = std::chrono::high_resolution_clock::now();
+
+  // -- Execution -----------------------------------------------------------
+
+  // The producer generates fresh input for every task, the consumer checks
+  // each output as soon as it is back; both are part of the measured time.
+  unsigned long long failures = 0;
+  stream.run(numTasks,
+	     [&](Task &task, unsigned long long seq) {
+	       auto *in = task.getInput();
+	       for(unsigned int i=0; i < bufferSize; i++) {
+		 in[i] = seq*bufferSize + i;
+	       }
+	     },
+	     [&](Task &task, unsigned long long seq) {
+	       if(!task.outputOk()) {
+		 failures++;
+	       }
+	     });
+
+  // -- Testing -------------------------------------------------------------
+
+  auto fpga_end = std::chrono::high_resolution_clock::now();
+
+  if(failures != 0) {
+    std::cout << "FAIL: Output Corrupted (" << failures << " tasks)" << std::endl;
+    return 1;
+  }
+
+  // -- Performance Statistics ----------------------------------------------
+
+  if (xcl_mode == NULL) {
+    std::chrono::duration<double> fpga_duration = fpga_end - fpga_begin;
+
+    double total = (double) bufferSize * numTasks * 512 / (1024.0*1024.0);
+    std::cout << std::endl;
+    std::cout << "          Total data: " << total << " MBits" << std::endl;
+    std::cout << "           FPGA Time: " << fpga_duration.count()
+	      << " s" << std::endl;
+    std::cout << "Sustained Throughput: "
+	      << total / fpga_duration.count()
+	      << " MBits/s" << std::endl;
+    std::cout << "     Producer Stalls: " << stream.getProducerStalls()
+	      << " (" << stream.getProducerWait() << " s)" << std::endl;
+    std::cout << "     Consumer Stalls: " << stream.getConsumerStalls()
+	      << " (" << stream.getConsumerWait() << " s)" << std::endl;
+  }
+  std::cout << "\nPASS: Simulation" << std::endl;
+
+ return 0;
+}
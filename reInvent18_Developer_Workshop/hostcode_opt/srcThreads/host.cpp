@@ -0,0 +1,117 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "CL/opencl.h"
+
+#include "ApiHandle.h"
+#include "Task.h"
+
+int main(int argc, char* argv[]) {
+
+  // -- Environment / Usage Check -------------------------------------------
+
+  char *xcl_mode = getenv("XCL_EMULATION_MODE");
+
+  if (argc < 2 || argc > 4) {
+    printf("\nUsage: %s "
+	   "./xclbin/pass.<emulation_mode>.<dsa>.xclbin [numThreads] [numCUs]\n"
+	   "\n Where numThreads host threads submit tasks concurrently onto numCUs pass compute units.\n" ,
+	   argv[0]);
+    return EXIT_FAILURE;
+  }
+  char*        binaryName   = argv[1];
+
+  // -- Common Parameters ---------------------------------------------------
+
+  unsigned int numBuffers               = 100;
+  bool         oooQueue                 = true;
+  unsigned int processDelay             = 1;
+  unsigned int bufferSize               = 1 << 14;
+  unsigned int numThreads               = (argc > 2) ? atoi(argv[2]) : 2;
+  unsigned int numCus                   = (argc > 3) ? atoi(argv[3]) : 1;
+  unsigned int softwarePipelineInterval = 3;
+
+  // -- Setup ---------------------------------------------------------------
+
+  // Two slots per CU so a thread can set up the next invocation while the
+  // previous one is still being enqueued by another thread.
+  ApiHandle api(binaryName, oooQueue, numCus, 2);
+
+  std::cout << std::endl;
+  std::cout << std::endl;
+  std::cout << " Total number of buffers: " << numBuffers   << std::endl;
+  std::cout << "              BufferSize: " << bufferSize   << std::endl;
+  std::cout << "        Bits per Element: " << 512          << std::endl;
+  std::cout << "      Bytes per Transfer: " << bufferSize*512/8 << std::endl;
+  std::cout << "            processDelay: " << processDelay << std::endl;
+  std::cout << "            Host Threads: " << numThreads   << std::endl;
+  std::cout << "           Compute Units: " << numCus       << std::endl;
+  std::cout << std::boolalpha;
+  std::cout << "      Out of Order Queue: " << oooQueue << std::endl;
+  std::cout << std::noboolalpha;
+  std::cout << std::endl;
+
+  std::vector<Task> tasks(numBuffers, Task(bufferSize, processDelay));
+
+  std::cout << "Running FPGA" << std::endl;
+  auto fpga_begin = std::chrono::high_resolution_clock::now();
+
+  // -- Execution -----------------------------------------------------------
+
+  // Thread t owns tasks t, t+numThreads, ... and only synchronizes on its
+  // own earlier tasks, so no thread ever waits on an event that another
+  // thread has not created yet.
+  std::vector<std::thread> submitters;
+  for(unsigned int t=0; t < numThreads; t++) {
+    submitters.emplace_back([&, t]() {
+      unsigned int stride = numThreads * softwarePipelineInterval;
+      for(unsigned int i=t; i < numBuffers; i += numThreads) {
+	if(i < stride) {
+	  tasks[i].run(api);
+	} else {
+	  tasks[i].run(api, tasks[i-stride].getDoneEv());
+	}
+      }
+    });
+  }
+  for(unsigned int t=0; t < numThreads; t++) {
+    submitters[t].join();
+  }
+  clFinish(api.getQueue());
+
+  // -- Testing -------------------------------------------------------------
+
+  auto fpga_end = std::chrono::high_resolution_clock::now();
+
+  bool outputOk = true;
+  for(unsigned int i=0; i < numBuffers; i++) {
+    outputOk = tasks[i].outputOk() && outputOk;
+  }
+  if(!outputOk) {
+    std::cout << "FAIL: Output Corrupted" << std::endl;
+    return 1;
+  }
+
+  // -- Performance Statistics ----------------------------------------------
+
+  if (xcl_mode == NULL) {
+    std::chrono::duration<double> fpga_duration = fpga_end - fpga_begin;
+
+    double total = (double) bufferSize * numBuffers * 512 / (1024.0*1024.0);
+    std::cout << std::endl;
+    std::cout << "          Total data: " << total << " MBits" << std::endl;
+    std::cout << "           FPGA Time: " << fpga_duration.count()
+	      << " s" << std::endl;
+    std::cout << "     FPGA Throughput: "
+	      << total / fpga_duration.count()
+	      << " MBits/s" << std::endl;
+    std::cout << "FPGA PCIe Throughput: "
+	      << (2*total) / fpga_duration.count()
+	      << " MBits/s" << std::endl;
+  }
+  std::cout << "\nPASS: Simulation" << std::endl;
+
+ return 0;
+}
@@ -0,0 +1,124 @@
+#include<cstdio>
+#include<cstdlib>
+#include<vector>
+#include<chrono>
+
+#include"sizes.h"
+#include"common.h"
+
+// Measures the false-positive rate of the standard and the blocked bloom
+// filter layouts, for every hash policy of hash_policy.h. All use the
+// original filter size and hash count (the default BloomConfig) and are
+// filled with the same profile as in setupData. With a target
+// false-positive rate, the configurations BloomConfig::fromTarget derives
+// for it are measured as well. The queries are random word ids that are
+// not in the profile.
+//
+// The throughput columns are single-threaded scalar code: the fused dual
+// hash of every query alone, and the full lookup (hash and probes).
+//
+// Usage: ./bloom_fpr [profile_entries] [num_queries] [target_fpr]
+
+struct FprResult {
+    unsigned long false_positives;
+    double        bits_set;
+    double        hash_rate;
+    double        lookup_rate;
+};
+
+static double millionsPerSecond(unsigned long count, std::chrono::high_resolution_clock::time_point t1)
+{
+    std::chrono::duration<double> sec = std::chrono::high_resolution_clock::now() - t1;
+    return count / sec.count() / 1e6;
+}
+
+template <class Hash>
+static FprResult measureFpr(const BloomConfig& bloom, const std::vector<unsigned>& entries,
+                            const std::vector<unsigned>& queries)
+{
+    std::vector<unsigned int> bloom_filter(bloom.numWords(), 0);
+
+    for (unsigned i = 0; i < entries.size(); i++) {
+        bloom.insertWith<Hash>(bloom_filter.data(), entries[i]);
+    }
+
+    FprResult result = { 0, 0.0, 0.0, 0.0 };
+    for (unsigned i = 0; i < bloom_filter.size(); i++) {
+        result.bits_set += __builtin_popcount(bloom_filter[i]);
+    }
+    result.bits_set /= 32.0 * bloom_filter.size();
+
+    std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+    unsigned int sum = 0;
+    for (unsigned q = 0; q < queries.size(); q++) {
+        HashPair h = Hash::dual(queries[q], bloom.seed_pu, bloom.seed_lu);
+        sum += h.pu ^ h.lu;
+    }
+    result.hash_rate = millionsPerSecond(queries.size(), t1);
+    // Keeps the hash loop from being optimized away
+    if (sum == 1) printf(" ");
+
+    t1 = std::chrono::high_resolution_clock::now();
+    for (unsigned q = 0; q < queries.size(); q++) {
+        if (bloom.containsWith<Hash>(bloom_filter.data(), queries[q])) {
+            result.false_positives++;
+        }
+    }
+    result.lookup_rate = millionsPerSecond(queries.size(), t1);
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned num_entries = (argc > 1) ? atoi(argv[1]) : 16384;
+    unsigned num_queries = (argc > 2) ? atoi(argv[2]) : 10000000;
+    double   target_fpr  = (argc > 3) ? atof(argv[3]) : 0;
+
+    std::vector<unsigned> entries;
+    std::vector<bool> in_profile(1 << 24, false);
+    for (unsigned i = 0; i < num_entries; i++) {
+        unsigned entry = (rand()%(1<<24));
+        entries.push_back(entry);
+        in_profile[entry] = true;
+    }
+
+    std::vector<unsigned> queries;
+    srand(2);
+    while (queries.size() < num_queries) {
+        unsigned word_id = rand()%(1<<24);
+        if (!in_profile[word_id]) queries.push_back(word_id);
+    }
+
+    std::vector<BloomConfig> configs;
+    for (int h = HashMurmur2; h <= HashMultiplyShift; h++) {
+        BloomHash hash = (BloomHash)h;
+        configs.push_back(BloomConfig(BloomStandard, hash));
+        configs.push_back(BloomConfig(BloomBlocked, hash));
+        if (target_fpr > 0) {
+            configs.push_back(BloomConfig::fromTarget(target_fpr, num_entries, BloomStandard, hash));
+            configs.push_back(BloomConfig::fromTarget(target_fpr, num_entries, BloomBlocked, hash));
+        }
+    }
+
+    printf("%u profile entries, %u queries\n", num_entries, num_queries);
+    printf("--------------------------------------------------------------------------------------------------\n");
+    printf(" Hash     | Layout   | Size (KB) | Hashes | Lines/lookup | Bits set |  Expected |     FPR | Hash M/s | Lookup M/s\n");
+
+    for (unsigned c = 0; c < configs.size(); c++) {
+        const BloomConfig& bloom = configs[c];
+        FprResult r;
+        switch (bloom.hash) {
+          case HashXXH32:         r = measureFpr<XXHash32>(bloom, entries, queries); break;
+          case HashMultiplyShift: r = measureFpr<MultiplyShiftHash>(bloom, entries, queries); break;
+          default:                r = measureFpr<Murmur2Hash>(bloom, entries, queries); break;
+        }
+        printf(" %-8s | %-8s | %9.1f | %6u | %12u | %7.2f%% | %8.4f%% | %6.4f%% | %8.0f | %10.0f\n",
+               BloomConfig::hashName(bloom.hash), bloom.layout == BloomBlocked ? "blocked" : "standard",
+               bloom.numWords() * sizeof(unsigned int) / 1024.0, bloom.num_hashes,
+               bloom.layout == BloomBlocked ? 1 : bloom.num_hashes, 100.0 * r.bits_set,
+               100.0 * bloom.expectedFpr(num_entries), 100.0 * r.false_positives / num_queries,
+               r.hash_rate, r.lookup_rate);
+    }
+
+    return 0;
+}
@@ -1,7 +1,31 @@
 #pragma once
 
+#include "sizes.h"
+#include "bloom_config.h"
+#include "weight_store.h"
+#include "top_k.h"
+#include "multi_profile.h"
+#include "posting_index.h"
+
 unsigned int MurmurHash2(const void* key ,int len,unsigned int seed);
 
+void computeHashFlags(
+    const unsigned int* input_doc_words,
+    const unsigned int* bloom_filter,
+    unsigned char*      inh_flags,
+    unsigned int        num_words,
+    const BloomConfig&  bloom);
+
+template <class Store>
+unsigned long computeScore(
+    const unsigned int* input_doc_words,
+    const unsigned int* bloom_filter,
+    const Store&        weights,
+    unsigned int        num_words,
+    const BloomConfig&  bloom);
+
+const char* computeHashFlagsIsa(const BloomConfig& bloom);
+
 void runOnCPU (
     unsigned int*  doc_sizes,
     unsigned int*  input_doc_words,
@@ -9,5 +33,74 @@ void runOnCPU (
     unsigned long* profile_weights,
     unsigned long* profile_score,
     unsigned int   total_num_docs,
-    unsigned int   total_size);
+    unsigned int   total_size,
+    const BloomConfig& bloom,
+    bool           split_timing = false);
+
+
+void runOnCPUScaling (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    unsigned int   max_threads,
+    const BloomConfig& bloom);
+
+void runOnCPUWeightStores (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    const BloomConfig& bloom);
+
+void runOnCPUPackedFlags (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    unsigned int   total_size,
+    const BloomConfig& bloom);
+
+std::vector<DocScore> topKOnCPU (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned int   total_num_docs,
+    unsigned int   top_k,
+    unsigned int   num_threads,
+    const BloomConfig& bloom);
 
+void runOnCPUTopK (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    unsigned int   top_k,
+    unsigned int   num_threads,
+    const BloomConfig& bloom);
+
+void runOnCPUMultiProfile (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    const ProfileBatch& batch);
+
+void runOnCPURescore (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    const std::vector<WeightChange>& changes,
+    const BloomConfig& bloom);
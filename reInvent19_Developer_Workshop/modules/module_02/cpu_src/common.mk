@@ -4,10 +4,17 @@ host: $(SRCDIR)/*.cpp $(SRCDIR)/*.c $(SRCDIR)/*.h
 		-I$(SRCDIR) \
 		-O3 -Wall -fmessage-length=0 -std=c++11\
 		$(SRCDIR)/compute_score_host.cpp \
+		$(SRCDIR)/compute_hash_simd.cpp \
 		$(SRCDIR)/MurmurHash2.c \
 		$(SRCDIR)/main.cpp \
+		-lpthread \
 		-o ./host
 
+bloom_fpr: $(SRCDIR)/bloom_fpr.cpp $(SRCDIR)/MurmurHash2.c $(SRCDIR)/*.h
+	g++ -I$(SRCDIR) -O3 -Wall -fmessage-length=0 -std=c++11 \
+		$(SRCDIR)/bloom_fpr.cpp \
+		$(SRCDIR)/MurmurHash2.c \
+		-o ./bloom_fpr
 
 clean:
-	rm -rf temp_dir log_dir report_dir *log host runOnfpga* *.csv *summary .run .Xil vitis* *jou xilinx*
+	rm -rf temp_dir log_dir report_dir *log host bloom_fpr runOnfpga* *.csv *summary .run .Xil vitis* *jou xilinx*
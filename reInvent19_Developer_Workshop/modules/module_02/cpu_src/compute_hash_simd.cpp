@@ -0,0 +1,346 @@
+#include<cstdlib>
+#include<cstring>
+#include<immintrin.h>
+
+#include"sizes.h"
+#include"common.h"
+#include"weight_store.h"
+
+// Vectorized version of the hash / bloom filter probe of runOnCPU. The
+// word ids are hashed 8 (AVX2) or 16 (AVX-512) at a time with the steps
+// and constants of Murmur2Hash (hash_policy.h), and the bloom filter
+// words of every probe are fetched with a gather. The flags are
+// bit-identical to the scalar code, which is kept as fallback and for
+// the tail of the input. Any BloomConfig (size, hash count, seeds,
+// layout) is supported; the other hash policies run the scalar code,
+// templated on the policy.
+//
+// computeScore fuses the probe with the scoring: only the (rare) words
+// that hit the bloom filter are looked up in the weight store. The score
+// loops are templated on the store (see weight_store.h).
+
+template <class Hash>
+static void hashFlagsScalar(const unsigned int* input_doc_words,
+                            const unsigned int* bloom_filter,
+                            unsigned char* inh_flags,
+                            unsigned int num_words,
+                            const BloomConfig& bloom)
+{
+    for (unsigned i = 0; i < num_words; i++)
+    {
+        unsigned curr_entry = input_doc_words[i];
+        unsigned word_id = curr_entry >> 8;
+        bool doc_end = (word_id==docTag);
+        bool inh = (!doc_end) && bloom.containsWith<Hash>(bloom_filter, word_id);
+
+        inh_flags[i] = inh ? 1 : 0;
+    }
+}
+
+template <class Hash, class Store>
+static unsigned long scoreWordsScalar(const unsigned int* input_doc_words,
+                                      const unsigned int* bloom_filter,
+                                      const Store& weights,
+                                      unsigned int num_words,
+                                      const BloomConfig& bloom)
+{
+    unsigned long score = 0;
+    for (unsigned i = 0; i < num_words; i++)
+    {
+        unsigned curr_entry = input_doc_words[i];
+        unsigned word_id = curr_entry >> 8;
+        bool doc_end = (word_id==docTag);
+        bool inh = (!doc_end) && bloom.containsWith<Hash>(bloom_filter, word_id);
+
+        if (inh) {
+            unsigned frequency = curr_entry & 0x00ff;
+            score += weights.weight(word_id) * (unsigned long)frequency;
+        }
+    }
+    return score;
+}
+
+// Adds the weighted frequency of every word whose bit is set in mask
+template <class Store>
+static inline unsigned long scoreMatches(const unsigned int* input_doc_words,
+                                         const Store& weights,
+                                         unsigned int mask)
+{
+    unsigned long score = 0;
+    while (mask)
+    {
+        unsigned curr_entry = input_doc_words[__builtin_ctz(mask)];
+        score += weights.weight(curr_entry >> 8) * (unsigned long)(curr_entry & 0x00ff);
+        mask &= mask - 1;
+    }
+    return score;
+}
+
+// Murmur2Hash::keyed on 8 lanes: MurmurHash2 with len=3 reads the three
+// low bytes of word_id, which is the whole 24-bit id
+__attribute__((target("avx2")))
+static inline __m256i murmur2Avx2(__m256i word_id, unsigned int seed)
+{
+    const __m256i m = _mm256_set1_epi32(Murmur2Hash::m);
+    __m256i h = _mm256_xor_si256(_mm256_set1_epi32(Murmur2Hash::init(seed)), word_id);
+    h = _mm256_mullo_epi32(h, m);
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, Murmur2Hash::r1));
+    h = _mm256_mullo_epi32(h, m);
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, Murmur2Hash::r2));
+    return h;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i probeAvx2(const unsigned int* bloom_filter, __m256i hash)
+{
+    __m256i word = _mm256_i32gather_epi32((const int*)bloom_filter, _mm256_srli_epi32(hash, 5), 4);
+    __m256i bit  = _mm256_and_si256(hash, _mm256_set1_epi32(0x1f));
+    return _mm256_and_si256(_mm256_srlv_epi32(word, bit), _mm256_set1_epi32(1));
+}
+
+// 0/1 per lane, set when the word is in the bloom filter
+__attribute__((target("avx2")))
+static inline __m256i inHashAvx2(const unsigned int* input_doc_words, const unsigned int* bloom_filter,
+                                 const BloomConfig& bloom)
+{
+    const __m256i mask = _mm256_set1_epi32(bloom.mask());
+    const __m256i tag  = _mm256_set1_epi32(docTag);
+    __m256i word_id = _mm256_srli_epi32(_mm256_loadu_si256((const __m256i*)input_doc_words), 8);
+    __m256i hash_pu = murmur2Avx2(word_id, bloom.seed_pu);
+    __m256i hash_lu = murmur2Avx2(word_id, bloom.seed_lu);
+    __m256i inh = _mm256_set1_epi32(1);
+    if (bloom.layout == BloomBlocked) {
+        const __m256i bits = _mm256_set1_epi32(bloom_block_mask);
+        __m256i block = _mm256_andnot_si256(bits, _mm256_and_si256(hash_pu, mask));
+        for (unsigned int k = 0; k < bloom.num_hashes; k++) {
+            __m256i hash = _mm256_or_si256(block, _mm256_and_si256(hash_lu, bits));
+            inh = _mm256_and_si256(inh, probeAvx2(bloom_filter, hash));
+            hash_lu = _mm256_srli_epi32(hash_lu, bloom_block_bits);
+        }
+    } else {
+        for (unsigned int k = 0; k < bloom.num_hashes; k++) {
+            inh = _mm256_and_si256(inh, probeAvx2(bloom_filter, _mm256_and_si256(hash_pu, mask)));
+            hash_pu = _mm256_add_epi32(hash_pu, hash_lu);
+        }
+    }
+    return _mm256_andnot_si256(_mm256_cmpeq_epi32(word_id, tag), inh);
+}
+
+__attribute__((target("avx2")))
+static void hashFlagsAvx2(const unsigned int* input_doc_words,
+                          const unsigned int* bloom_filter,
+                          unsigned char* inh_flags,
+                          unsigned int num_words,
+                          const BloomConfig& bloom)
+{
+    unsigned i = 0;
+
+    for (; i + 8 <= num_words; i += 8)
+    {
+        __m256i inh = inHashAvx2(&input_doc_words[i], bloom_filter, bloom);
+
+        // 8 x 32-bit 0/1 -> 8 bytes; the packs work per 128-bit half
+        __m256i packed = _mm256_packs_epi32(inh, inh);
+        packed = _mm256_packs_epi16(packed, packed);
+        int lo = _mm_cvtsi128_si32(_mm256_castsi256_si128(packed));
+        int hi = _mm_cvtsi128_si32(_mm256_extracti128_si256(packed, 1));
+        memcpy(&inh_flags[i],     &lo, 4);
+        memcpy(&inh_flags[i + 4], &hi, 4);
+    }
+    hashFlagsScalar<Murmur2Hash>(&input_doc_words[i], bloom_filter, &inh_flags[i], num_words - i, bloom);
+}
+
+template <class Store>
+__attribute__((target("avx2")))
+static unsigned long scoreWordsAvx2(const unsigned int* input_doc_words,
+                                    const unsigned int* bloom_filter,
+                                    const Store& weights,
+                                    unsigned int num_words,
+                                    const BloomConfig& bloom)
+{
+    unsigned long score = 0;
+    unsigned i = 0;
+
+    for (; i + 8 <= num_words; i += 8)
+    {
+        __m256i inh = inHashAvx2(&input_doc_words[i], bloom_filter, bloom);
+        unsigned int matches = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(inh, 31)));
+        score += scoreMatches(&input_doc_words[i], weights, matches);
+    }
+    return score + scoreWordsScalar<Murmur2Hash>(&input_doc_words[i], bloom_filter, weights, num_words - i, bloom);
+}
+
+// The unmasked forms of these AVX-512 intrinsics pass an undefined vector
+// as the unused merge operand, which GCC reports as maybe-uninitialized.
+// The zero-masking forms with every lane enabled take zero instead.
+__attribute__((target("avx512f")))
+static inline __m512i srli512(__m512i a, unsigned int n) { return _mm512_maskz_srli_epi32(0xffff, a, n); }
+
+__attribute__((target("avx512f")))
+static inline __m512i srlv512(__m512i a, __m512i n) { return _mm512_maskz_srlv_epi32(0xffff, a, n); }
+
+__attribute__((target("avx512f")))
+static inline __m512i andnot512(__m512i a, __m512i b) { return _mm512_maskz_andnot_epi32(0xffff, a, b); }
+
+// Murmur2Hash::keyed on 16 lanes
+__attribute__((target("avx512f")))
+static inline __m512i murmur2Avx512(__m512i word_id, unsigned int seed)
+{
+    const __m512i m = _mm512_set1_epi32(Murmur2Hash::m);
+    __m512i h = _mm512_xor_si512(_mm512_set1_epi32(Murmur2Hash::init(seed)), word_id);
+    h = _mm512_mullo_epi32(h, m);
+    h = _mm512_xor_si512(h, srli512(h, Murmur2Hash::r1));
+    h = _mm512_mullo_epi32(h, m);
+    h = _mm512_xor_si512(h, srli512(h, Murmur2Hash::r2));
+    return h;
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i probeAvx512(const unsigned int* bloom_filter, __m512i hash)
+{
+    __m512i word = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), 0xffff, srli512(hash, 5), (const int*)bloom_filter, 4);
+    __m512i bit  = _mm512_and_si512(hash, _mm512_set1_epi32(0x1f));
+    return _mm512_and_si512(srlv512(word, bit), _mm512_set1_epi32(1));
+}
+
+// Lane mask of the words that are in the bloom filter
+__attribute__((target("avx512f")))
+static inline __mmask16 inHashAvx512(const unsigned int* input_doc_words, const unsigned int* bloom_filter,
+                                     const BloomConfig& bloom)
+{
+    const __m512i mask = _mm512_set1_epi32(bloom.mask());
+    const __m512i tag  = _mm512_set1_epi32(docTag);
+    __m512i word_id = srli512(_mm512_loadu_si512(input_doc_words), 8);
+    __m512i hash_pu = murmur2Avx512(word_id, bloom.seed_pu);
+    __m512i hash_lu = murmur2Avx512(word_id, bloom.seed_lu);
+    __m512i inh = _mm512_set1_epi32(1);
+    if (bloom.layout == BloomBlocked) {
+        const __m512i bits = _mm512_set1_epi32(bloom_block_mask);
+        __m512i block = andnot512(bits, _mm512_and_si512(hash_pu, mask));
+        for (unsigned int k = 0; k < bloom.num_hashes; k++) {
+            __m512i hash = _mm512_or_si512(block, _mm512_and_si512(hash_lu, bits));
+            inh = _mm512_and_si512(inh, probeAvx512(bloom_filter, hash));
+            hash_lu = srli512(hash_lu, bloom_block_bits);
+        }
+    } else {
+        for (unsigned int k = 0; k < bloom.num_hashes; k++) {
+            inh = _mm512_and_si512(inh, probeAvx512(bloom_filter, _mm512_and_si512(hash_pu, mask)));
+            hash_pu = _mm512_add_epi32(hash_pu, hash_lu);
+        }
+    }
+    return _mm512_test_epi32_mask(inh, inh) & _mm512_cmpneq_epi32_mask(word_id, tag);
+}
+
+__attribute__((target("avx512f")))
+static void hashFlagsAvx512(const unsigned int* input_doc_words,
+                            const unsigned int* bloom_filter,
+                            unsigned char* inh_flags,
+                            unsigned int num_words,
+                            const BloomConfig& bloom)
+{
+    unsigned i = 0;
+
+    for (; i + 16 <= num_words; i += 16)
+    {
+        __mmask16 inh = inHashAvx512(&input_doc_words[i], bloom_filter, bloom);
+        __m512i flags = _mm512_maskz_mov_epi32(inh, _mm512_set1_epi32(1));
+        _mm_storeu_si128((__m128i*)&inh_flags[i], _mm512_maskz_cvtepi32_epi8(0xffff, flags));
+    }
+    hashFlagsScalar<Murmur2Hash>(&input_doc_words[i], bloom_filter, &inh_flags[i], num_words - i, bloom);
+}
+
+template <class Store>
+__attribute__((target("avx512f")))
+static unsigned long scoreWordsAvx512(const unsigned int* input_doc_words,
+                                      const unsigned int* bloom_filter,
+                                      const Store& weights,
+                                      unsigned int num_words,
+                                      const BloomConfig& bloom)
+{
+    unsigned long score = 0;
+    unsigned i = 0;
+
+    for (; i + 16 <= num_words; i += 16)
+    {
+        __mmask16 inh = inHashAvx512(&input_doc_words[i], bloom_filter, bloom);
+        score += scoreMatches(&input_doc_words[i], weights, inh);
+    }
+    return score + scoreWordsScalar<Murmur2Hash>(&input_doc_words[i], bloom_filter, weights, num_words - i, bloom);
+}
+
+typedef void (*HashFlagsFn)(const unsigned int*, const unsigned int*, unsigned char*, unsigned int, const BloomConfig&);
+
+enum HashIsa { IsaScalar, IsaAvx2, IsaAvx512 };
+
+struct HashFlagsImpl {
+    const char*  name;
+    HashFlagsFn  flags;
+    HashIsa      isa;
+};
+
+// Picks the widest ISA the CPU supports. HASH_ISA=scalar|avx2|avx512
+// forces a narrower one, e.g. to compare against the scalar code.
+static HashFlagsImpl selectHashFlags()
+{
+    const char* force = getenv("HASH_ISA");
+    __builtin_cpu_init();
+    bool avx512 = __builtin_cpu_supports("avx512f");
+    bool avx2   = __builtin_cpu_supports("avx2");
+
+    if (force) {
+        if (!strcmp(force, "scalar")) { avx512 = false; avx2 = false; }
+        if (!strcmp(force, "avx2"))   { avx512 = false; }
+    }
+    if (avx512) return { "avx512", hashFlagsAvx512, IsaAvx512 };
+    if (avx2)   return { "avx2",   hashFlagsAvx2,   IsaAvx2 };
+    return { "scalar", hashFlagsScalar<Murmur2Hash>, IsaScalar };
+}
+
+static const HashFlagsImpl& hashFlagsImpl()
+{
+    static const HashFlagsImpl impl = selectHashFlags();
+    return impl;
+}
+
+const char* computeHashFlagsIsa(const BloomConfig& bloom)
+{
+    return (bloom.hash == HashMurmur2) ? hashFlagsImpl().name : "scalar";
+}
+
+void computeHashFlags(
+    const unsigned int* input_doc_words,
+    const unsigned int* bloom_filter,
+    unsigned char*      inh_flags,
+    unsigned int        num_words,
+    const BloomConfig&  bloom)
+{
+    switch (bloom.hash) {
+      case HashXXH32:         hashFlagsScalar<XXHash32>(input_doc_words, bloom_filter, inh_flags, num_words, bloom); break;
+      case HashMultiplyShift: hashFlagsScalar<MultiplyShiftHash>(input_doc_words, bloom_filter, inh_flags, num_words, bloom); break;
+      default:                hashFlagsImpl().flags(input_doc_words, bloom_filter, inh_flags, num_words, bloom); break;
+    }
+}
+
+template <class Store>
+unsigned long computeScore(
+    const unsigned int* input_doc_words,
+    const unsigned int* bloom_filter,
+    const Store&        weights,
+    unsigned int        num_words,
+    const BloomConfig&  bloom)
+{
+    switch (bloom.hash) {
+      case HashXXH32:         return scoreWordsScalar<XXHash32>(input_doc_words, bloom_filter, weights, num_words, bloom);
+      case HashMultiplyShift: return scoreWordsScalar<MultiplyShiftHash>(input_doc_words, bloom_filter, weights, num_words, bloom);
+      default:                break;
+    }
+    switch (hashFlagsImpl().isa) {
+      case IsaAvx512: return scoreWordsAvx512(input_doc_words, bloom_filter, weights, num_words, bloom);
+      case IsaAvx2:   return scoreWordsAvx2(input_doc_words, bloom_filter, weights, num_words, bloom);
+      default:        return scoreWordsScalar<Murmur2Hash>(input_doc_words, bloom_filter, weights, num_words, bloom);
+    }
+}
+
+template unsigned long computeScore<DenseWeightStore>(const unsigned int*, const unsigned int*, const DenseWeightStore&, unsigned int, const BloomConfig&);
+template unsigned long computeScore<HashWeightStore>(const unsigned int*, const unsigned int*, const HashWeightStore&, unsigned int, const BloomConfig&);
+template unsigned long computeScore<SortedWeightStore>(const unsigned int*, const unsigned int*, const SortedWeightStore&, unsigned int, const BloomConfig&);
@@ -5,21 +5,31 @@
 #include<utility>
 #include<cstdio>
 #include<cstdlib>
+#include<cstring>
 
 #include"sizes.h"
 #include "common.h"
+#include "parallel_score.h"
+#include "weight_store.h"
+#include "packed_flags.h"
+#include "top_k.h"
+#include "posting_index.h"
 
 using namespace std;
 using namespace std::chrono;
 
-void runOnCPU (
+// Hash/flag pass and score pass timed separately, as the original code.
+// Only used for the instrumented mode, as it writes and re-reads a flag
+// per word.
+static void runOnCPUSplit (
     unsigned int*  doc_sizes,
     unsigned int*  input_doc_words,
     unsigned int*  bloom_filter,
     unsigned long* profile_weights,
     unsigned long* profile_score,
     unsigned int   total_num_docs,
-    unsigned int   total_size) 
+    unsigned int   total_size,
+    const BloomConfig& bloom) 
 {
 
     unsigned int size_offset=0;
@@ -31,32 +41,11 @@ void runOnCPU (
 
     for(unsigned int doc=0;doc<total_num_docs;doc++) 
     {
-        profile_score[doc] = 0.0;
-        unsigned int size = doc_sizes[doc];
-
-        for (unsigned i = 0; i < size ; i++)
-        { 
-            unsigned curr_entry = input_doc_words[size_offset+i];
-            unsigned word_id = curr_entry >> 8;
-            unsigned hash_pu =  MurmurHash2( &word_id , 3,1);
-            unsigned hash_lu =  MurmurHash2( &word_id , 3,5);
-            bool doc_end = (word_id==docTag);
-            unsigned hash1 = hash_pu&hash_bloom;
-            bool inh1 = (!doc_end) && (bloom_filter[ hash1 >> 5 ] & ( 1 << (hash1 & 0x1f)));
-            unsigned hash2 = (hash_pu+hash_lu)&hash_bloom;
-            bool inh2 = (!doc_end) && (bloom_filter[ hash2 >> 5 ] & ( 1 << (hash2 & 0x1f)));
-            
-           
-            if (inh1 && inh2) {
-                inh_flags[size_offset+i]=1;
-            }else {
-                inh_flags[size_offset+i]=0;
-            }
-        }
-      
-        size_offset+=size;
+        size_offset+=doc_sizes[doc];
     }
 
+    computeHashFlags(input_doc_words, bloom_filter, inh_flags, size_offset, bloom);
+
    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
 
      for(unsigned int doc=0, n=0; doc<total_num_docs;doc++) 
@@ -81,7 +70,511 @@ void runOnCPU (
     chrono::duration<double> hash_processing   = (t2-t1);
     chrono::duration<double> cpu_post_processing   = (t3-t2);
 
+    free(inh_flags);
+
     printf(" Total execution time of CPU          | %10.4f ms\n", 1000*time_span_cpu.count());
-    printf(" Compute Hash processing time         | %10.4f ms\n", 1000*hash_processing.count());
+    printf(" Compute Hash processing (%-6s)     | %10.4f ms\n", computeHashFlagsIsa(bloom), 1000*hash_processing.count());
     printf(" Compute Score processing time        | %10.4f ms\n", 1000*cpu_post_processing.count());
 }
+
+void runOnCPU (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    unsigned int   total_size,
+    const BloomConfig& bloom,
+    bool           split_timing) 
+{
+    if (split_timing) {
+        runOnCPUSplit(doc_sizes, input_doc_words, bloom_filter, profile_weights,
+                      profile_score, total_num_docs, total_size, bloom);
+        return;
+    }
+
+    // Hash and score every document in a single pass over its words
+    DenseWeightStore weights(profile_weights);
+    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+
+    for(unsigned int doc=0, size_offset=0; doc<total_num_docs; doc++) 
+    {
+        unsigned int size = doc_sizes[doc];
+        profile_score[doc] = computeScore(&input_doc_words[size_offset], bloom_filter,
+                                          weights, size, bloom);
+        size_offset+=size;
+    }
+
+    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+    chrono::duration<double> time_span_cpu   = (t2-t1);
+
+    printf(" Total execution time of CPU          | %10.4f ms\n", 1000*time_span_cpu.count());
+    printf(" Fused Hash & Score (%-6s)          | %10.4f ms\n", computeHashFlagsIsa(bloom), 1000*time_span_cpu.count());
+}
+
+// Scores the documents with 1 .. max_threads threads and reports the
+// speedup over one thread. Every run is checked against profile_score as
+// computed by runOnCPU.
+void runOnCPUScaling (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    unsigned int   max_threads,
+    const BloomConfig& bloom) 
+{
+    vector<unsigned long> score(total_num_docs);
+    DenseWeightStore weights(profile_weights);
+    double single_ms = 0;
+
+    printf("--------------------------------------------------------------------\n");
+    printf(" Threads |  Time (ms) | Speedup | Chunks | Steals\n");
+
+    for (unsigned int num_threads = 1; num_threads <= max_threads; num_threads++)
+    {
+        WorkStealingPool pool(num_threads);
+        vector<DocChunk> chunks = partitionDocs(doc_sizes, total_num_docs, 16*num_threads);
+
+        chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+        pool.run(chunks, [&](const DocChunk& chunk) {
+            for (unsigned int doc = chunk.doc_begin, n = chunk.word_offset; doc < chunk.doc_end; doc++)
+            {
+                score[doc] = computeScore(&input_doc_words[n], bloom_filter, weights, doc_sizes[doc], bloom);
+                n += doc_sizes[doc];
+            }
+        });
+        chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+        double ms = 1000*chrono::duration<double>(t2-t1).count();
+        if (num_threads == 1) single_ms = ms;
+
+        for (unsigned int doc = 0; doc < total_num_docs; doc++) {
+            if (score[doc] != profile_score[doc]) {
+                printf(" Verification: FAILED with %u threads, doc[%u]\n", num_threads, doc);
+                exit(-1);
+            }
+        }
+        printf(" %7u | %10.4f | %7.2f | %6u | %6lu\n", num_threads, ms, single_ms/ms,
+               (unsigned int)chunks.size(), pool.numSteals());
+    }
+}
+
+// Times one weight store: raw lookups of every word id of the corpus
+// (mostly misses, as for a plain per-word lookup) and the fused hash &
+// score pass, which only looks up the bloom filter hits.
+template <class Store>
+static void benchWeightStore (
+    const Store&   weights,
+    double         build_ms,
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    const BloomConfig& bloom,
+    unsigned long& lookup_sum) 
+{
+    unsigned int num_words = 0;
+    for (unsigned int doc = 0; doc < total_num_docs; doc++) {
+        num_words += doc_sizes[doc];
+    }
+
+    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+    unsigned long sum = 0;
+    for (unsigned int i = 0; i < num_words; i++) {
+        sum += weights.weight(input_doc_words[i] >> 8);
+    }
+    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+
+    for (unsigned int doc = 0, size_offset = 0; doc < total_num_docs; doc++)
+    {
+        unsigned long score = computeScore(&input_doc_words[size_offset], bloom_filter, weights, doc_sizes[doc], bloom);
+        if (score != profile_score[doc]) {
+            printf(" Verification: FAILED with %s weight store, doc[%u]\n", weights.name(), doc);
+            exit(-1);
+        }
+        size_offset += doc_sizes[doc];
+    }
+    chrono::high_resolution_clock::time_point t3 = chrono::high_resolution_clock::now();
+
+    if (lookup_sum != (unsigned long)-1 && sum != lookup_sum) {
+        printf(" Verification: FAILED with %s weight store, lookups\n", weights.name());
+        exit(-1);
+    }
+    lookup_sum = sum;
+
+    double lookup_ms = 1000*chrono::duration<double>(t2-t1).count();
+    double score_ms  = 1000*chrono::duration<double>(t3-t2).count();
+    printf(" %-6s | %12.1f | %10.4f | %12.1f | %10.4f\n", weights.name(),
+           weights.bytes()/1024.0, build_ms, num_words/lookup_ms/1000.0, score_ms);
+}
+
+// Compares the profile weight stores on footprint, lookup throughput and
+// fused scoring time. Every store is checked against profile_score as
+// computed by runOnCPU.
+void runOnCPUWeightStores (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    const BloomConfig& bloom) 
+{
+    unsigned long lookup_sum = (unsigned long)-1;
+
+    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+    WeightList list = nonZeroWeights(profile_weights, 1 << 24);
+    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+    HashWeightStore hash(list);
+    chrono::high_resolution_clock::time_point t3 = chrono::high_resolution_clock::now();
+    SortedWeightStore sorted(list);
+    chrono::high_resolution_clock::time_point t4 = chrono::high_resolution_clock::now();
+
+    printf("--------------------------------------------------------------------\n");
+    printf(" %u profile entries, %s scoring; build time excludes the %.1f ms scan\n",
+           (unsigned int)list.size(), computeHashFlagsIsa(bloom), 1000*chrono::duration<double>(t2-t1).count());
+    printf(" Store  |    Size (KB) | Build (ms) | Lookup (M/s) | Score (ms)\n");
+
+    benchWeightStore(DenseWeightStore(profile_weights), 0.0, doc_sizes, input_doc_words,
+                     bloom_filter, profile_score, total_num_docs, bloom, lookup_sum);
+    benchWeightStore(hash, 1000*chrono::duration<double>(t3-t2).count(), doc_sizes, input_doc_words,
+                     bloom_filter, profile_score, total_num_docs, bloom, lookup_sum);
+    benchWeightStore(sorted, 1000*chrono::duration<double>(t4-t3).count(), doc_sizes, input_doc_words,
+                     bloom_filter, profile_score, total_num_docs, bloom, lookup_sum);
+}
+
+// Scores from the in-hash flags as the FPGA returns them, one byte per
+// word and packed one bit per word (runOnfpga built with -DFLAGS_PACKED),
+// and compares the readback size and the scoring time. The packed flags
+// are scored by walking the set bits. Both are checked against
+// profile_score as computed by runOnCPU.
+void runOnCPUPackedFlags (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    unsigned int   total_size,
+    const BloomConfig& bloom) 
+{
+    unsigned int   packed_size  = (total_size + packed_flags_block - 1) / packed_flags_block * packed_flags_block;
+    unsigned char* inh_flags    = (unsigned char*)aligned_alloc(4096, packed_size*sizeof(char));
+    unsigned long* packed_flags = (unsigned long*)aligned_alloc(4096, packed_size/8);
+
+    memset(inh_flags, 0, packed_size*sizeof(char));
+    computeHashFlags(input_doc_words, bloom_filter, inh_flags, total_size, bloom);
+    packFlags(inh_flags, packed_flags, packed_size);
+
+    unsigned long mismatches = 0;
+
+    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+    for(unsigned int doc=0, n=0; doc<total_num_docs; doc++) 
+    {
+        unsigned long ans = 0;
+        for (unsigned i = 0; i < doc_sizes[doc]; i++, n++)
+        {
+            if (inh_flags[n])
+            {
+                unsigned curr_entry = input_doc_words[n];
+                ans += profile_weights[curr_entry >> 8] * (unsigned long)(curr_entry & 0x00ff);
+            }
+        }
+        if (ans != profile_score[doc]) mismatches++;
+    }
+    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+    for(unsigned int doc=0, n=0; doc<total_num_docs; doc++) 
+    {
+        unsigned long ans = scorePackedFlags(packed_flags, input_doc_words, profile_weights, n, n + doc_sizes[doc]);
+        if (ans != profile_score[doc]) mismatches++;
+        n += doc_sizes[doc];
+    }
+    chrono::high_resolution_clock::time_point t3 = chrono::high_resolution_clock::now();
+
+    unsigned long flagged = countPackedFlags(packed_flags, packed_size);
+    free(inh_flags);
+    free(packed_flags);
+
+    printf("--------------------------------------------------------------------\n");
+    printf(" %lu of %u words flagged (%.2f%%)\n", flagged, total_size, 100.0*flagged/total_size);
+    printf(" Flags  | Readback (MB) | Score (ms)\n");
+    printf(" byte   | %13.3f | %10.4f\n", packed_size/1000000.0,   1000*chrono::duration<double>(t2-t1).count());
+    printf(" packed | %13.3f | %10.4f\n", packed_size/8/1000000.0, 1000*chrono::duration<double>(t3-t2).count());
+    if (mismatches) {
+        printf(" Verification: FAILED (%lu documents differ)\n", mismatches);
+        exit(-1);
+    }
+}
+
+// Selects the top_k best documents as they are scored: every thread keeps
+// its own bounded heap and the heaps are merged at the end, so no score
+// vector is stored. Compared, selection and time, with storing every
+// score and sorting them, from profile_score as computed by runOnCPU.
+vector<DocScore> topKOnCPU (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned int   total_num_docs,
+    unsigned int   top_k,
+    unsigned int   num_threads,
+    const BloomConfig& bloom)
+{
+    DenseWeightStore weights(profile_weights);
+    WorkStealingPool pool(num_threads);
+    vector<DocChunk> chunks = partitionDocs(doc_sizes, total_num_docs, 16*pool.numThreads());
+    vector<TopK>     heaps(pool.numThreads(), TopK(top_k));
+
+    pool.run(chunks, [&](unsigned int thread, const DocChunk& chunk) {
+        for (unsigned int doc = chunk.doc_begin, n = chunk.word_offset; doc < chunk.doc_end; doc++)
+        {
+            heaps[thread].push(doc, computeScore(&input_doc_words[n], bloom_filter, weights, doc_sizes[doc], bloom));
+            n += doc_sizes[doc];
+        }
+    });
+
+    for (unsigned int t = 1; t < heaps.size(); t++) {
+        heaps[0].merge(heaps[t]);
+    }
+    return heaps[0].sorted();
+}
+
+void runOnCPUTopK (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    unsigned int   top_k,
+    unsigned int   num_threads,
+    const BloomConfig& bloom) 
+{
+    DenseWeightStore weights(profile_weights);
+
+    // Reference: every score stored, then sorted
+    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+    vector<DocScore> all(total_num_docs);
+    for (unsigned int doc = 0, n = 0; doc < total_num_docs; doc++)
+    {
+        all[doc].doc   = doc;
+        all[doc].score = computeScore(&input_doc_words[n], bloom_filter, weights, doc_sizes[doc], bloom);
+        n += doc_sizes[doc];
+    }
+    sort(all.begin(), all.end(), [](const DocScore& a, const DocScore& b) {
+        return a.score > b.score || (a.score == b.score && a.doc < b.doc);
+    });
+    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+
+    vector<DocScore> top = topKOnCPU(doc_sizes, input_doc_words, bloom_filter, profile_weights,
+                                     total_num_docs, top_k, 1, bloom);
+    chrono::high_resolution_clock::time_point t3 = chrono::high_resolution_clock::now();
+
+    vector<DocScore> top_mt = topKOnCPU(doc_sizes, input_doc_words, bloom_filter, profile_weights,
+                                        total_num_docs, top_k, num_threads, bloom);
+    chrono::high_resolution_clock::time_point t4 = chrono::high_resolution_clock::now();
+
+    unsigned int expected = (top_k < total_num_docs) ? top_k : total_num_docs;
+    bool match = (top.size() == expected) && (top_mt.size() == expected);
+    for (unsigned int i = 0; match && i < expected; i++) {
+        match = top[i].doc == all[i].doc && top_mt[i].doc == all[i].doc &&
+                top[i].score == profile_score[top[i].doc];
+    }
+
+    printf("--------------------------------------------------------------------\n");
+    printf(" Top %u documents:", expected);
+    for (unsigned int i = 0; i < expected && i < 5; i++) {
+        printf(" %u (%lu)", top[i].doc, top[i].score);
+    }
+    printf("%s\n", (expected > 5) ? " ..." : "");
+    printf(" Selection                      |  Time (ms)\n");
+    printf(" Score all, then sort           | %10.4f\n", 1000*chrono::duration<double>(t2-t1).count());
+    printf(" Streaming heap, 1 thread       | %10.4f\n", 1000*chrono::duration<double>(t3-t2).count());
+    printf(" Streaming heaps, %2u threads    | %10.4f\n", num_threads, 1000*chrono::duration<double>(t4-t3).count());
+    if (!match) {
+        printf(" Verification: FAILED (top %u differs from the sorted scores)\n", top_k);
+        exit(-1);
+    }
+}
+
+// Scores the profiles of the batch one pass each, as separate runs would,
+// then all of them in one batched pass over the corpus: the vectorized
+// probe of the combined filter, then the bit-sliced filter for the words
+// that pass. Profile 0 is the profile of runOnCPU and is checked against
+// profile_score.
+void runOnCPUMultiProfile (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    const ProfileBatch& batch)
+{
+    unsigned int num_profiles = batch.numProfiles();
+    const BloomConfig& bloom = batch.config();
+    vector<unsigned long> separate((unsigned long)total_num_docs*num_profiles);
+    vector<unsigned long> batched((unsigned long)total_num_docs*num_profiles);
+
+    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+    for (unsigned int p = 0; p < num_profiles; p++)
+    {
+        for (unsigned int doc = 0, n = 0; doc < total_num_docs; doc++)
+        {
+            separate[(unsigned long)doc*num_profiles + p] =
+                computeScore(&input_doc_words[n], batch.filter(p), batch.store(p), doc_sizes[doc], bloom);
+            n += doc_sizes[doc];
+        }
+    }
+    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+    vector<unsigned char> flags;
+    unsigned long passed = 0;
+    for (unsigned int doc = 0, n = 0; doc < total_num_docs; doc++)
+    {
+        unsigned int size = doc_sizes[doc];
+        unsigned long* doc_score = &batched[(unsigned long)doc*num_profiles];
+        flags.resize(size + 8);
+        computeHashFlags(&input_doc_words[n], batch.combinedFilter(), flags.data(), size, bloom);
+        memset(&flags[size], 0, 8);
+        // Eight flags at a time: few words pass for a handful of profiles
+        for (unsigned int i = 0; i < size; i += 8)
+        {
+            unsigned long group;
+            memcpy(&group, &flags[i], 8);
+            while (group) {
+                unsigned int w = n + i + __builtin_ctzl(group) / 8;
+                group &= ~(0xfful << (__builtin_ctzl(group) & ~7));
+                passed++;
+                unsigned int mask = batch.match(input_doc_words[w] >> 8);
+                if (mask) batch.addMatches(input_doc_words[w], mask, doc_score);
+            }
+        }
+        n += size;
+    }
+    chrono::high_resolution_clock::time_point t3 = chrono::high_resolution_clock::now();
+
+    double separate_ms = 1000*chrono::duration<double>(t2-t1).count();
+    double batched_ms  = 1000*chrono::duration<double>(t3-t2).count();
+
+    printf("--------------------------------------------------------------------\n");
+    unsigned long total_size = 0;
+    for (unsigned int doc = 0; doc < total_num_docs; doc++) total_size += doc_sizes[doc];
+    printf(" %u profiles, bit-sliced filter of %.1f KB, %.2f%% of the words pass the combined filter\n",
+           num_profiles, batch.slicedBytes() / 1024.0, 100.0 * passed / total_size);
+    printf(" Scoring                        |  Time (ms) | Per profile (ms)\n");
+    printf(" One pass per profile (%-6s)  | %10.4f | %10.4f\n", computeHashFlagsIsa(bloom), separate_ms, separate_ms/num_profiles);
+    printf(" One batched pass (%-6s)      | %10.4f | %10.4f\n", computeHashFlagsIsa(bloom), batched_ms, batched_ms/num_profiles);
+
+    for (unsigned int doc = 0; doc < total_num_docs; doc++)
+    {
+        for (unsigned int p = 0; p < num_profiles; p++)
+        {
+            unsigned long i = (unsigned long)doc*num_profiles + p;
+            if (batched[i] != separate[i] || (p == 0 && batched[i] != profile_score[doc])) {
+                printf(" Verification: FAILED, doc[%u] profile %u: batched %lu, separate %lu\n",
+                       doc, p, batched[i], separate[i]);
+                exit(-1);
+            }
+        }
+    }
+}
+
+// Applies a batch of weight changes to the scores with the posting index
+// built during an indexed first pass, and compares with rescoring the
+// whole corpus with the new weights. The first pass is checked against
+// profile_score as computed by runOnCPU, the updated scores against the
+// rescoring. The new weights, filter and scores are local copies, the
+// profile of the run is left as it is.
+void runOnCPURescore (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    const std::vector<WeightChange>& changes,
+    const BloomConfig& bloom)
+{
+    DenseWeightStore weights(profile_weights);
+    PostingIndex index(doc_sizes, input_doc_words, total_num_docs);
+    vector<unsigned long> scores(total_num_docs);
+    vector<unsigned char> flags;
+
+    // First pass, without and with the index
+    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+    for (unsigned int doc = 0, n = 0; doc < total_num_docs; doc++)
+    {
+        scores[doc] = computeScore(&input_doc_words[n], bloom_filter, weights, doc_sizes[doc], bloom);
+        n += doc_sizes[doc];
+    }
+    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+    for (unsigned int doc = 0, n = 0; doc < total_num_docs; doc++)
+    {
+        flags.resize(doc_sizes[doc]);
+        computeHashFlags(&input_doc_words[n], bloom_filter, flags.data(), doc_sizes[doc], bloom);
+        scores[doc] = index.addDoc(doc, &input_doc_words[n], flags.data(), doc_sizes[doc], weights);
+        n += doc_sizes[doc];
+    }
+    chrono::high_resolution_clock::time_point t3 = chrono::high_resolution_clock::now();
+    for (unsigned int doc = 0; doc < total_num_docs; doc++) {
+        if (scores[doc] != profile_score[doc]) {
+            printf(" Verification: FAILED, doc[%u]: indexed pass %lu, CPU %lu\n", doc, scores[doc], profile_score[doc]);
+            exit(-1);
+        }
+    }
+    unsigned int  indexed_words    = index.numWords();
+    unsigned long indexed_postings = index.numPostings();
+    size_t        indexed_bytes    = index.bytes();
+
+    // Copies of the profile for the rescoring, made before any timing
+    vector<unsigned long> new_weights(profile_weights, profile_weights + (1 << 24));
+    vector<unsigned int>  new_filter(bloom_filter, bloom_filter + bloom.numWords());
+    vector<unsigned long> rescored(total_num_docs);
+    DenseWeightStore      new_store(new_weights.data());
+
+    // Incremental update. The words the batch adds to the profile are
+    // indexed first, on their own, to time the corpus scan they need.
+    chrono::high_resolution_clock::time_point t4 = chrono::high_resolution_clock::now();
+    vector<unsigned int> added = index.addedWords(changes);
+    index.indexWords(added);
+    chrono::high_resolution_clock::time_point t5 = chrono::high_resolution_clock::now();
+    vector<DocScore> updated = index.update(changes, scores.data());
+    chrono::high_resolution_clock::time_point t6 = chrono::high_resolution_clock::now();
+
+    // Full rescoring: the new weights, the added words in the filter
+    for (unsigned int c = 0; c < changes.size(); c++) {
+        new_weights[changes[c].word_id] = changes[c].weight;
+        if (changes[c].weight != 0) bloom.insert(new_filter.data(), changes[c].word_id);
+    }
+    for (unsigned int doc = 0, n = 0; doc < total_num_docs; doc++)
+    {
+        rescored[doc] = computeScore(&input_doc_words[n], new_filter.data(), new_store, doc_sizes[doc], bloom);
+        n += doc_sizes[doc];
+    }
+    chrono::high_resolution_clock::time_point t7 = chrono::high_resolution_clock::now();
+
+    printf("--------------------------------------------------------------------\n");
+    printf(" Posting index: %u words, %lu postings, %.1f KB; %u weight changes, %u documents updated\n",
+           indexed_words, indexed_postings, indexed_bytes / 1024.0, (unsigned int)changes.size(), (unsigned int)updated.size());
+    printf(" Scoring                        |  Time (ms)\n");
+    printf(" First pass                     | %10.4f\n", 1000*chrono::duration<double>(t2-t1).count());
+    printf(" First pass, building the index | %10.4f\n", 1000*chrono::duration<double>(t3-t2).count());
+    printf(" Indexing %4u added words      | %10.4f   ( %lu postings, one corpus scan )\n", (unsigned int)added.size(),
+           1000*chrono::duration<double>(t5-t4).count(), index.numPostings() - indexed_postings);
+    printf(" Incremental update             | %10.4f\n", 1000*chrono::duration<double>(t6-t5).count());
+    printf(" Full rescoring                 | %10.4f\n", 1000*chrono::duration<double>(t7-t6).count());
+
+    for (unsigned int i = 0; i < updated.size(); i++) {
+        if (updated[i].score != scores[updated[i].doc]) {
+            printf(" Verification: FAILED, doc[%u] returned %lu, updated %lu\n", updated[i].doc, updated[i].score, scores[updated[i].doc]);
+            exit(-1);
+        }
+    }
+    for (unsigned int doc = 0; doc < total_num_docs; doc++) {
+        if (scores[doc] != rescored[doc]) {
+            printf(" Verification: FAILED, doc[%u]: incremental %lu, rescored %lu\n", doc, scores[doc], rescored[doc]);
+            exit(-1);
+        }
+    }
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<vector>
+#include<thread>
+#include<algorithm>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+
+#include"sizes.h"
+#include"bloom_config.h"
+
+// Deterministic corpus and profile generator, and the binary cache of
+// its output.
+//
+// Every document is a block with its own SplitMix64 stream, seeded from
+// (seed, document), so the corpus is the same whatever the number of
+// threads and whatever the libc. Document lengths follow the original
+// normal distribution (mean 3500, deviation 500, at least 100 words),
+// drawn as the sum of 12 uniforms in integer arithmetic; words are a
+// term below (1<<24)-1 and a frequency from 1 to 254, as before.
+
+const unsigned long corpus_seed_default = 1;
+
+inline unsigned long splitmix64(unsigned long x)
+{
+    x += 0x9e3779b97f4a7c15ul;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ul;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebul;
+    return x ^ (x >> 31);
+}
+
+class SplitMix64
+{
+    unsigned long m_state;
+
+public:
+    // Stream of a block: stream tells what is generated, block which one
+    SplitMix64(unsigned long seed, unsigned long stream, unsigned long block) :
+        m_state(splitmix64(seed ^ splitmix64((stream << 40) ^ block))) {}
+
+    unsigned long next()
+    {
+        m_state += 0x9e3779b97f4a7c15ul;
+        unsigned long x = m_state;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ul;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebul;
+        return x ^ (x >> 31);
+    }
+
+    // Uniform in [0, n)
+    unsigned int below(unsigned int n) { return (unsigned int)(((next() >> 32) * n) >> 32); }
+};
+
+enum GenStream { GenDocLen = 1, GenDocWords = 2, GenProfile = 3, GenWeightChanges = 4 };
+
+inline unsigned int genDocLen(unsigned long seed, unsigned int doc)
+{
+    SplitMix64 rng(seed, GenDocLen, doc);
+    long sum = 0;
+    for (int i = 0; i < 12; i++) {
+        sum += (long)(rng.next() >> 32);
+    }
+    long len = 3500 + ((sum - (6l << 32)) * 500) / (1l << 32);
+    return (len < 100) ? 100 : (unsigned int)len;
+}
+
+inline void genDocWords(unsigned long seed, unsigned int doc, unsigned int* words, unsigned int size)
+{
+    SplitMix64 rng(seed, GenDocWords, doc);
+    for (unsigned int i = 0; i < size; i++) {
+        unsigned int term = rng.below((1u << 24) - 1);
+        unsigned int freq = rng.below(254) + 1;
+        words[i] = (term << 8) | freq;
+    }
+}
+
+// Runs fn(begin, end) on num_threads ranges of [0, count)
+template <class Fn>
+inline void parallelRanges(unsigned int count, unsigned int num_threads, Fn fn)
+{
+    if (num_threads < 1) num_threads = 1;
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < num_threads; t++) {
+        threads.push_back(std::thread(fn, (unsigned int)((unsigned long)count*t/num_threads),
+                                          (unsigned int)((unsigned long)count*(t+1)/num_threads)));
+    }
+    fn(0u, (unsigned int)((unsigned long)count/num_threads));
+    for (unsigned int t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+}
+
+// Document sizes and offsets; returns the number of words
+inline unsigned long genDocSizes(unsigned long seed, unsigned int num_docs, unsigned int* doc_sizes,
+                                 unsigned int* doc_offsets, unsigned int num_threads)
+{
+    parallelRanges(num_docs, num_threads, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int doc = begin; doc < end; doc++) doc_sizes[doc] = genDocLen(seed, doc);
+    });
+    unsigned long total = 0;
+    for (unsigned int doc = 0; doc < num_docs; doc++) {
+        doc_offsets[doc] = total;
+        total += doc_sizes[doc];
+    }
+    return total;
+}
+
+// Words of every document. The threads take ranges of about the same
+// number of words, and first touch the pages they write.
+inline void genCorpus(unsigned long seed, unsigned int num_docs, const unsigned int* doc_sizes,
+                      const unsigned int* doc_offsets, unsigned int* words, unsigned int num_threads)
+{
+    unsigned long total = num_docs ? (unsigned long)doc_offsets[num_docs-1] + doc_sizes[num_docs-1] : 0;
+    if (num_threads < 1) num_threads = 1;
+    std::vector<unsigned int> first(num_threads + 1, num_docs);
+    for (unsigned int t = 0; t < num_threads; t++) {
+        first[t] = std::lower_bound(doc_offsets, doc_offsets + num_docs, total*t/num_threads) - doc_offsets;
+    }
+    parallelRanges(num_threads, num_threads, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int t = begin; t < end; t++) {
+            for (unsigned int doc = first[t]; doc < first[t+1]; doc++) {
+                genDocWords(seed, doc, &words[doc_offsets[doc]], doc_sizes[doc]);
+            }
+        }
+    });
+}
+
+// Profile entries: word ids with a weight of 10, as before. Profiles
+// other than 0 are the extra profiles of a batch (see multi_profile.h).
+inline std::vector<unsigned int> genProfile(unsigned long seed, unsigned int num_entries, unsigned int profile = 0)
+{
+    SplitMix64 rng(seed, GenProfile, profile);
+    std::vector<unsigned int> entries(num_entries);
+    for (unsigned int i = 0; i < num_entries; i++) {
+        entries[i] = rng.below(1u << 24);
+    }
+    return entries;
+}
+
+// Binary cache of a generated data set, mapped read-only on later runs:
+//
+//   CorpusCacheHeader
+//   doc_sizes       num_docs x 32 bits
+//   profile entries num_entries x 32 bits
+//   bloom filter    at filter_offset, 4 KB aligned
+//   words           at words_offset, 4 KB aligned, so they can be handed
+//                   to the FPGA buffers as they are
+//
+// The version changes with the layout or the generator; a file of
+// another version, seed, size or profile is generated again.
+
+const unsigned int corpus_cache_version = 2;
+static const char corpus_cache_magic[8] = "M2CACHE";
+
+struct CorpusCacheHeader {
+    char          magic[8];
+    unsigned int  version;
+    unsigned int  num_docs;
+    unsigned long num_words;
+    unsigned long seed;
+    unsigned int  num_entries;
+    unsigned int  bloom_size_log2;
+    unsigned int  bloom_num_hashes;
+    unsigned int  bloom_seed_pu;
+    unsigned int  bloom_seed_lu;
+    unsigned int  bloom_layout;
+    unsigned int  bloom_hash;
+    unsigned long filter_offset;
+    unsigned long words_offset;
+};
+
+inline unsigned long cacheAlign(unsigned long offset) { return (offset + 4095) & ~4095ul; }
+
+inline void writeCorpusCache(const char* path, unsigned long seed, unsigned int num_docs, const unsigned int* doc_sizes,
+                             unsigned long num_words, const unsigned int* words,
+                             const std::vector<unsigned int>& entries, const unsigned int* bloom_filter, const BloomConfig& bloom)
+{
+    CorpusCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, corpus_cache_magic, sizeof(corpus_cache_magic));
+    header.version          = corpus_cache_version;
+    header.num_docs         = num_docs;
+    header.num_words        = num_words;
+    header.seed             = seed;
+    header.num_entries      = entries.size();
+    header.bloom_size_log2  = bloom.size_log2;
+    header.bloom_num_hashes = bloom.num_hashes;
+    header.bloom_seed_pu    = bloom.seed_pu;
+    header.bloom_seed_lu    = bloom.seed_lu;
+    header.bloom_layout     = bloom.layout;
+    header.bloom_hash       = bloom.hash;
+    header.filter_offset    = cacheAlign(sizeof(header) + (num_docs + entries.size())*sizeof(unsigned int));
+    header.words_offset     = cacheAlign(header.filter_offset + bloom.numWords()*sizeof(unsigned int));
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        printf("ERROR: Could not create corpus cache %s\n", path);
+        exit(-1);
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(doc_sizes, sizeof(unsigned int), num_docs, file);
+    fwrite(entries.data(), sizeof(unsigned int), entries.size(), file);
+    fseek(file, header.filter_offset, SEEK_SET);
+    fwrite(bloom_filter, sizeof(unsigned int), bloom.numWords(), file);
+    fseek(file, header.words_offset, SEEK_SET);
+    if (fwrite(words, sizeof(unsigned int), num_words, file) != num_words) {
+        printf("ERROR: Could not write corpus cache %s\n", path);
+        exit(-1);
+    }
+    fclose(file);
+}
+
+// Read-only mapping of a cache file, valid until it is destroyed
+class CorpusCache
+{
+    unsigned char*    m_data;
+    size_t            m_size;
+    CorpusCacheHeader m_header;
+
+public:
+    CorpusCache() : m_data(NULL), m_size(0) {}
+    ~CorpusCache() { if (m_data) munmap(m_data, m_size); }
+
+    // False if the file is missing or was made for other parameters
+    bool open(const char* path, unsigned long seed, unsigned int num_docs, unsigned int num_entries)
+    {
+        int fd = ::open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0) return false;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CorpusCacheHeader)) {
+            close(fd);
+            return false;
+        }
+        m_size = st.st_size;
+        m_data = (unsigned char*)mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (m_data == MAP_FAILED) {
+            m_data = NULL;
+            return false;
+        }
+        memcpy(&m_header, m_data, sizeof(m_header));
+
+        bool valid = memcmp(m_header.magic, corpus_cache_magic, sizeof(corpus_cache_magic)) == 0 &&
+                     m_header.version == corpus_cache_version &&
+                     m_header.seed == seed && m_header.num_docs == num_docs && m_header.num_entries == num_entries &&
+                     m_header.words_offset + m_header.num_words*sizeof(unsigned int) <= m_size;
+        if (!valid) {
+            munmap(m_data, m_size);
+            m_data = NULL;
+        }
+        return valid;
+    }
+
+    unsigned long       numWords()   const { return m_header.num_words; }
+    const unsigned int* docSizes()   const { return (const unsigned int*)(m_data + sizeof(CorpusCacheHeader)); }
+    const unsigned int* entries()    const { return docSizes() + m_header.num_docs; }
+    const unsigned int* words()      const { return (const unsigned int*)(m_data + m_header.words_offset); }
+
+    // The cached filter, if it was built with the same configuration
+    const unsigned int* bloomFilter(const BloomConfig& bloom) const
+    {
+        bool same = m_header.bloom_size_log2 == bloom.size_log2 && m_header.bloom_num_hashes == bloom.num_hashes &&
+                    m_header.bloom_seed_pu == bloom.seed_pu && m_header.bloom_seed_lu == bloom.seed_lu &&
+                    m_header.bloom_layout == (unsigned int)bloom.layout && m_header.bloom_hash == (unsigned int)bloom.hash;
+        return same ? (const unsigned int*)(m_data + m_header.filter_offset) : NULL;
+    }
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+// Hash families of the bloom filter, as policies for the host code and
+// the kernel (no library calls, so HLS takes them as they are).
+//
+// A policy hashes a 24-bit word id with a 32-bit seed:
+//
+//   static unsigned int hash(unsigned int word_id, unsigned int seed)
+//   static HashPair     dual(unsigned int word_id, unsigned int seed_pu, unsigned int seed_lu)
+//
+// dual returns hash_pu and hash_lu of the double hashing (see
+// bloom_config.h) in one go, and shares what does not depend on the seed:
+// the key, and for xxHash32 its product. The functions are C++11
+// constexpr, so they are also checked at compile time below.
+//
+// Murmur2Hash is the original MurmurHash2(&word_id, 3, seed) and the
+// default. The hash is picked at run time on the CPU (BloomConfig::hash)
+// and at build time in the kernel, with -DBLOOM_HASH_XXH32 or
+// -DBLOOM_HASH_MULTIPLY_SHIFT for both host and kernel.
+
+struct HashPair {
+    unsigned int pu;
+    unsigned int lu;
+};
+
+// MurmurHash2 with len=3: the three key bytes are the whole word id. The
+// constants are shared with the SIMD hashing of the CPU scorer.
+struct Murmur2Hash {
+    static constexpr unsigned int m   = 0x5bd1e995;
+    static constexpr unsigned int len = 3;
+    static constexpr int          r1  = 13;
+    static constexpr int          r2  = 15;
+
+    static constexpr unsigned int init(unsigned int seed)    { return seed ^ len; }
+    static constexpr unsigned int finalMix(unsigned int h)   { return finalShift((h ^ (h >> r1)) * m); }
+    static constexpr unsigned int finalShift(unsigned int h) { return h ^ (h >> r2); }
+    static constexpr unsigned int keyed(unsigned int key, unsigned int seed) { return finalMix((init(seed) ^ key) * m); }
+
+    static constexpr unsigned int hash(unsigned int word_id, unsigned int seed)
+    {
+        return keyed(word_id & 0xffffff, seed);
+    }
+
+    static constexpr HashPair dualKey(unsigned int key, unsigned int seed_pu, unsigned int seed_lu)
+    {
+        return HashPair{ keyed(key, seed_pu), keyed(key, seed_lu) };
+    }
+
+    static constexpr HashPair dual(unsigned int word_id, unsigned int seed_pu, unsigned int seed_lu)
+    {
+        return dualKey(word_id & 0xffffff, seed_pu, seed_lu);
+    }
+};
+
+// xxHash32 of the 4-byte word id: one lane round and the avalanche. The
+// key product is the same for both seeds.
+struct XXHash32 {
+    static constexpr unsigned int p2 = 2246822519u;
+    static constexpr unsigned int p3 = 3266489917u;
+    static constexpr unsigned int p4 = 668265263u;
+    static constexpr unsigned int p5 = 374761393u;
+
+    static constexpr unsigned int rotl17(unsigned int x) { return (x << 17) | (x >> 15); }
+    static constexpr unsigned int shift16(unsigned int h) { return h ^ (h >> 16); }
+    static constexpr unsigned int shift13(unsigned int h) { return shift16((h ^ (h >> 13)) * p3); }
+    static constexpr unsigned int avalanche(unsigned int h) { return shift13((h ^ (h >> 15)) * p2); }
+    static constexpr unsigned int round(unsigned int product, unsigned int seed)
+    {
+        return avalanche(rotl17(seed + p5 + 4 + product) * p4);
+    }
+
+    static constexpr unsigned int hash(unsigned int word_id, unsigned int seed)
+    {
+        return round((word_id & 0xffffff) * p3, seed);
+    }
+
+    static constexpr HashPair dualProduct(unsigned int product, unsigned int seed_pu, unsigned int seed_lu)
+    {
+        return HashPair{ round(product, seed_pu), round(product, seed_lu) };
+    }
+
+    static constexpr HashPair dual(unsigned int word_id, unsigned int seed_pu, unsigned int seed_lu)
+    {
+        return dualProduct((word_id & 0xffffff) * p3, seed_pu, seed_lu);
+    }
+};
+
+// Multiply-shift (Dietzfelbinger): the high half of a*key + b, with an
+// odd 64-bit a and a b derived from the seed. One multiply per hash, of
+// a 24-bit key, and no mixing rounds.
+struct MultiplyShiftHash {
+    static constexpr unsigned long multiplier(unsigned int seed) { return ((seed * 0x9e3779b97f4a7c15ul) ^ 0xd6e8feb86659fd93ul) | 1; }
+    static constexpr unsigned long increment(unsigned int seed)  { return seed * 0xbf58476d1ce4e5b9ul + 0x94d049bb133111ebul; }
+    static constexpr unsigned int  keyed(unsigned long key, unsigned int seed)
+    {
+        return (unsigned int)((multiplier(seed) * key + increment(seed)) >> 32);
+    }
+
+    static constexpr unsigned int hash(unsigned int word_id, unsigned int seed)
+    {
+        return keyed(word_id & 0xffffff, seed);
+    }
+
+    static constexpr HashPair dualKey(unsigned long key, unsigned int seed_pu, unsigned int seed_lu)
+    {
+        return HashPair{ keyed(key, seed_pu), keyed(key, seed_lu) };
+    }
+
+    static constexpr HashPair dual(unsigned int word_id, unsigned int seed_pu, unsigned int seed_lu)
+    {
+        return dualKey(word_id & 0xffffff, seed_pu, seed_lu);
+    }
+};
+
+// Values of MurmurHash2(&word_id, 3, seed) in MurmurHash2.c and of the
+// xxHash32 specification
+static_assert(Murmur2Hash::hash(0x123456, 1) == 0x2b19db0cu && Murmur2Hash::hash(0xabcdef, 5) == 0xc7dbd016u,
+              "Murmur2Hash differs from MurmurHash2.c");
+static_assert(XXHash32::hash(0x123456, 1) == 0xa049361du, "XXHash32 differs from xxHash32");
+static_assert(XXHash32::dual(0x123456, 1, 5).pu == XXHash32::hash(0x123456, 1) &&
+              XXHash32::dual(0x123456, 1, 5).lu == XXHash32::hash(0x123456, 5), "XXHash32::dual");
+static_assert(MultiplyShiftHash::dual(0x123456, 1, 5).lu == MultiplyShiftHash::hash(0x123456, 5), "MultiplyShiftHash::dual");
+
+enum BloomHash { HashMurmur2, HashXXH32, HashMultiplyShift };
+
+#if defined(BLOOM_HASH_XXH32)
+typedef XXHash32 bloom_hash_policy;
+#define bloom_default_hash HashXXH32
+#elif defined(BLOOM_HASH_MULTIPLY_SHIFT)
+typedef MultiplyShiftHash bloom_hash_policy;
+#define bloom_default_hash HashMultiplyShift
+#else
+typedef Murmur2Hash bloom_hash_policy;
+#define bloom_default_hash HashMurmur2
+#endif
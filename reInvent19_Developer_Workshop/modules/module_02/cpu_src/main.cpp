@@ -3,14 +3,16 @@
 #include<ctime>
 #include<cstdio>
 #include<cstdlib>
+#include<cstring>
 #include<cmath>
 #include<iostream>
 #include<vector>
 #include<utility>
-#include<random>
+#include<thread>
 #include"xcl2.hpp"
 #include"sizes.h"
 #include"common.h"
+#include"corpus_gen.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -24,126 +26,242 @@ vector<unsigned long,aligned_allocator<unsigned long>> fpga_profileScore;
 vector<unsigned int,aligned_allocator<unsigned int>> doc_sizes;
 vector<unsigned long,aligned_allocator<unsigned long>> cpu_profileScore;
 
-default_random_engine generator;
-normal_distribution<double> distribution(3500,500);
+// The words, in input_doc_words or mapped from the corpus cache
+unsigned int* corpus_words;
+CorpusCache   corpus_cache;
 
 unsigned int total_num_docs;
 unsigned size=0;
-unsigned block_size;
-
-unsigned doc_len()
-{
-    unsigned int len = distribution(generator);
-    if (len < 100) { len = 100; }
-//    if(len > 4000) { len = 3500;}
-    return len;
-}
+unsigned int profile_entries = 16384;
+unsigned long corpus_seed = corpus_seed_default;
+unsigned int gen_threads = thread::hardware_concurrency();
 
 
-void setupData()
+// Documents, profile weights and bloom filter. With a cache path, a cache
+// made for the same seed, documents and profile is mapped instead of
+// generating the data; otherwise the data is generated and saved there.
+void setupData(const BloomConfig& bloom, const char* cache_path)
 {
-    starting_doc_id.reserve( total_num_docs );
     fpga_profileScore.reserve( total_num_docs );
     cpu_profileScore.reserve(total_num_docs);
-
-    //  h_docInfo.reserve( total_num_docs );
-
     doc_sizes.reserve( total_num_docs );
-    unsigned unpadded_size=0;
-
-    for (unsigned i=0; i<total_num_docs; i++) {
-        unsigned len_doc = doc_len();
-        starting_doc_id[i] = unpadded_size;
-        unpadded_size+=len_doc;
-        doc_sizes[i] = len_doc;
-    }
-    
-    size = unpadded_size&(~(block_size-1));
-    if(unpadded_size & (block_size-1)) size+=block_size;
-    bloom_filter.reserve( (1L << bloom_size) );
-    input_doc_words.reserve( size );
+    starting_doc_id.reserve( total_num_docs );
 
-    // double mbytes = size*sizeof(int)/(1000000.0);
+    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+    vector<unsigned int> entries;
+    const unsigned int* cached_filter = NULL;
 
-    printf("Creating documents - total size : %.3f MBytes (%d words)\n", size*sizeof(int)/1000000.0, size);
-    // std::cout << "Creating documents of total size = "<< size  << " words" << endl;
+    if (cache_path && corpus_cache.open(cache_path, corpus_seed, total_num_docs, profile_entries)) {
+        memcpy(doc_sizes.data(), corpus_cache.docSizes(), total_num_docs*sizeof(unsigned int));
+        entries.assign(corpus_cache.entries(), corpus_cache.entries() + profile_entries);
+        cached_filter = corpus_cache.bloomFilter(bloom);
+        corpus_words  = (unsigned int*)corpus_cache.words();
+        size = corpus_cache.numWords();
+        printf("Mapping documents from %s - total size : %.3f MBytes (%d words)\n", cache_path, size*sizeof(int)/1000000.0, size);
+    } else {
+        // Documents are not padded; the words after the last one are
+        // handled by the callers
+        size = genDocSizes(corpus_seed, total_num_docs, doc_sizes.data(), starting_doc_id.data(), gen_threads);
+        input_doc_words.reserve( size );
+        corpus_words = input_doc_words.data();
 
-    for (unsigned i=0; i<size; i++) {
-        input_doc_words[i] = docTag;
-    }
-    for (unsigned doci=0; doci < total_num_docs; doci++)
-    {
-        unsigned start_dimm1 = starting_doc_id[doci];
-        unsigned size_1 = doc_sizes[doci];
-        unsigned term;
-        unsigned freq;
-
-        for (unsigned i = 0; i < size_1; i++)
-        {
-            term = (rand()%((1L << 24)-1));
-            freq = (rand()%254)+1;
-            input_doc_words[start_dimm1 + i] = (term << 8) | freq;
-        }
+        printf("Creating documents - total size : %.3f MBytes (%d words)\n", size*sizeof(int)/1000000.0, size);
+        genCorpus(corpus_seed, total_num_docs, doc_sizes.data(), starting_doc_id.data(), corpus_words, gen_threads);
+        entries = genProfile(corpus_seed, profile_entries);
     }
 
+    bloom_filter.reserve( bloom.numWords() );
     profile_weights.reserve( (1L << 24) );
-    for (unsigned i=0; i<(1L << bloom_size); i++) {
+    for (unsigned i=0; i<bloom.numWords(); i++) {
         bloom_filter[i] = 0x0;
     }
     std::cout << "Creating profile weights" << endl;
-    std::cout << endl;
  
     for (unsigned i=0; i<(1L << 24); i++) {
         profile_weights[i] = 0;
     }
 
-    for (unsigned i=0; i<16384; i++) {
-        unsigned entry = (rand()%(1<<24));	
+    for (unsigned i=0; i<profile_entries; i++) {
+        unsigned entry = entries[i];
 
         profile_weights[entry] = 10;
-        unsigned hash_pu = MurmurHash2(&entry,3,1);
-        unsigned hash_lu = MurmurHash2(&entry,3,5);
+        if (!cached_filter) bloom.insert(bloom_filter.data(), entry);
+    }
+    if (cached_filter) {
+        memcpy(bloom_filter.data(), cached_filter, bloom.numWords()*sizeof(unsigned int));
+    }
 
-        unsigned hash1 = hash_pu&hash_bloom; 
-        unsigned hash2 = (hash_pu+hash_lu)&hash_bloom;
+    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+    printf("Data set up in %.1f ms (%u threads)\n", 1000*chrono::duration<double>(t2-t1).count(), gen_threads);
 
-        bloom_filter[ hash1 >> 5 ] |= 1 << (hash1 & 0x1f);
-        bloom_filter[ hash2 >> 5 ] |= 1 << (hash2 & 0x1f);
+    if (cache_path && corpus_words == input_doc_words.data()) {
+        writeCorpusCache(cache_path, corpus_seed, total_num_docs, doc_sizes.data(), size, corpus_words,
+                         entries, bloom_filter.data(), bloom);
+        printf("Saved documents, profile and bloom filter to %s\n", cache_path);
     }
-
+    std::cout << endl;
 }
 
 int main(int argc, char** argv)
 {
-    int num_iter;
+    bool split_timing = false;
+    unsigned int max_threads = 0;
+    bool weight_stores = false;
+    bool packed_flags = false;
+    unsigned int top_k = 0;
+    unsigned int num_profiles = 0;
+    unsigned int num_changes = 0;
+    BloomLayout bloom_layout = BloomStandard;
+    BloomHash bloom_hash = HashMurmur2;
+    double target_fpr = 0;
+    const char* cache_path = NULL;
+
+    // Options start with "--", the remaining arguments are positional
+    int num_args = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--split")) {
+            split_timing = true;
+        } else if (!strcmp(argv[i], "--threads") && i+1 < argc) {
+            max_threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--stores")) {
+            weight_stores = true;
+        } else if (!strcmp(argv[i], "--packed")) {
+            packed_flags = true;
+        } else if (!strcmp(argv[i], "--topk") && i+1 < argc) {
+            top_k = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--profiles") && i+1 < argc) {
+            num_profiles = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--rescore") && i+1 < argc) {
+            num_changes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--blocked")) {
+            bloom_layout = BloomBlocked;
+        } else if (!strcmp(argv[i], "--fpr") && i+1 < argc) {
+            target_fpr = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--hash") && i+1 < argc) {
+            if (!BloomConfig::hashFromName(argv[++i], bloom_hash)) {
+                printf("ERROR: Unknown hash %s (murmur2, xxh32 or mulshift)\n", argv[i]);
+                exit(-1);
+            }
+        } else if (!strcmp(argv[i], "--seed") && i+1 < argc) {
+            corpus_seed = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--gen-threads") && i+1 < argc) {
+            gen_threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--cache") && i+1 < argc) {
+            cache_path = argv[++i];
+        } else {
+            argv[num_args++] = argv[i];
+        }
+    }
+    argc = num_args;
 
     switch(argc) {
       case 2: 
-         total_num_docs=atoi(argv[1]);
-         num_iter = 2;
-         break;
       case 3:
+         // The number of iterations only matters on the FPGA
          total_num_docs=atoi(argv[1]);
-         num_iter = atoi(argv[2]);
          break;      
       default:
          cout << "Incorrect number of arguments"<<endl;
          return 0;
     } 
 
+    // Without a target false-positive rate the original filter is used
+    BloomConfig bloom_config = (target_fpr > 0)
+        ? BloomConfig::fromTarget(target_fpr, profile_entries, bloom_layout, bloom_hash)
+        : BloomConfig(bloom_layout, bloom_hash);
+    bloom_config.print(profile_entries);
+
     std::cout << "Initializing data"<< endl;
-    block_size = num_iter*64;
-    setupData();
+    setupData(bloom_config, cache_path);
 
     runOnCPU(
         doc_sizes.data(),
-        input_doc_words.data(),
+        corpus_words,
         bloom_filter.data(),
         profile_weights.data(),
         cpu_profileScore.data(),
         total_num_docs,
-        size) ;
+        size,
+        bloom_config,
+        split_timing) ;
+
+    if (max_threads > 0) {
+        runOnCPUScaling(
+            doc_sizes.data(),
+            corpus_words,
+            bloom_filter.data(),
+            profile_weights.data(),
+            cpu_profileScore.data(),
+            total_num_docs,
+            max_threads,
+            bloom_config) ;
+    }
+
+    if (weight_stores) {
+        runOnCPUWeightStores(
+            doc_sizes.data(),
+            corpus_words,
+            bloom_filter.data(),
+            profile_weights.data(),
+            cpu_profileScore.data(),
+            total_num_docs,
+            bloom_config) ;
+    }
+
+    if (packed_flags) {
+        runOnCPUPackedFlags(
+            doc_sizes.data(),
+            corpus_words,
+            bloom_filter.data(),
+            profile_weights.data(),
+            cpu_profileScore.data(),
+            total_num_docs,
+            size,
+            bloom_config) ;
+    }
+
+    if (top_k > 0) {
+        runOnCPUTopK(
+            doc_sizes.data(),
+            corpus_words,
+            bloom_filter.data(),
+            profile_weights.data(),
+            cpu_profileScore.data(),
+            total_num_docs,
+            top_k,
+            (max_threads > 0) ? max_threads : thread::hardware_concurrency(),
+            bloom_config) ;
+    }
     
+    // Profile 0 is the profile above, the others are generated
+    if (num_profiles > 0) {
+        vector<WeightList> profiles(1, nonZeroWeights(profile_weights.data(), 1 << 24));
+        for (unsigned int p = 1; p < num_profiles && p < max_batch_profiles; p++) {
+            profiles.push_back(entryWeights(genProfile(corpus_seed, profile_entries, p)));
+        }
+        ProfileBatch batch(bloom_config, profiles);
+
+        runOnCPUMultiProfile(
+            doc_sizes.data(),
+            corpus_words,
+            cpu_profileScore.data(),
+            total_num_docs,
+            batch) ;
+    }
+
+    // Rescores a changed copy of the profile
+    if (num_changes > 0) {
+        runOnCPURescore(
+            doc_sizes.data(),
+            corpus_words,
+            bloom_filter.data(),
+            profile_weights.data(),
+            cpu_profileScore.data(),
+            total_num_docs,
+            genWeightChanges(corpus_seed, nonZeroWeights(profile_weights.data(), 1 << 24), num_changes),
+            bloom_config) ;
+    }
+
     printf("--------------------------------------------------------------------\n");
     
     cout << " Execution COMPLETE" << endl;
@@ -0,0 +1,189 @@
+#pragma once
+
+#include<vector>
+#include<deque>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<atomic>
+#include<functional>
+#include<algorithm>
+
+// Document-parallel scoring helpers.
+//
+// partitionDocs cuts the corpus into chunks of whole documents holding
+// about the same number of words, using the prefix sums of doc_sizes.
+// Chunk boundaries are multiples of 8 documents, so two chunks never
+// write profile_score entries in the same 64-byte cache line.
+//
+// WorkStealingPool runs a function on every chunk. Chunks are dealt
+// round-robin to per-thread queues, so all threads move through the
+// corpus front to back; a thread that runs dry steals from the back of
+// another thread's queue. The calling thread works as thread 0. The
+// function can also take the index of the thread that runs it, for
+// per-thread state such as partial results.
+
+struct DocChunk {
+    unsigned int doc_begin;
+    unsigned int doc_end;
+    unsigned int word_offset;
+    unsigned int num_words;
+};
+
+inline std::vector<DocChunk> partitionDocs(
+    const unsigned int* doc_sizes,
+    unsigned int        total_num_docs,
+    unsigned int        num_chunks)
+{
+    const unsigned int docs_per_line = 64 / sizeof(unsigned long);
+
+    std::vector<unsigned long> prefix(total_num_docs + 1, 0);
+    for (unsigned int doc = 0; doc < total_num_docs; doc++) {
+        prefix[doc + 1] = prefix[doc] + doc_sizes[doc];
+    }
+
+    std::vector<DocChunk> chunks;
+    unsigned int doc_begin = 0;
+    for (unsigned int c = 1; c <= num_chunks && doc_begin < total_num_docs; c++) {
+        unsigned long target = prefix[total_num_docs] * c / num_chunks;
+        unsigned int doc_end = std::lower_bound(prefix.begin(), prefix.end(), target) - prefix.begin();
+        doc_end = (doc_end + docs_per_line - 1) / docs_per_line * docs_per_line;
+        if (c == num_chunks || doc_end > total_num_docs) doc_end = total_num_docs;
+        if (doc_end <= doc_begin) continue;
+
+        DocChunk chunk = { doc_begin, doc_end, (unsigned int)prefix[doc_begin],
+                           (unsigned int)(prefix[doc_end] - prefix[doc_begin]) };
+        chunks.push_back(chunk);
+        doc_begin = doc_end;
+    }
+    return chunks;
+}
+
+class WorkStealingPool
+{
+    struct alignas(64) Queue {
+        std::mutex               mutex;
+        std::deque<unsigned int> chunks;
+    };
+
+    unsigned int                                m_num_threads;
+    std::vector<Queue>                          m_queues;
+    std::vector<std::thread>                    m_threads;
+    std::function<void(unsigned int, const DocChunk&)> m_fn;
+    const std::vector<DocChunk>*                m_chunks;
+
+    std::mutex                                  m_mutex;
+    std::condition_variable                     m_start_cv;
+    std::condition_variable                     m_done_cv;
+    unsigned long                               m_generation;
+    unsigned int                                m_busy;
+    bool                                        m_stop;
+    std::atomic<unsigned long>                  m_steals;
+
+    bool nextChunk(unsigned int self, unsigned int& chunk)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_queues[self].mutex);
+            if (!m_queues[self].chunks.empty()) {
+                chunk = m_queues[self].chunks.front();
+                m_queues[self].chunks.pop_front();
+                return true;
+            }
+        }
+        for (unsigned int i = 1; i < m_num_threads; i++) {
+            Queue& victim = m_queues[(self + i) % m_num_threads];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.chunks.empty()) {
+                chunk = victim.chunks.back();
+                victim.chunks.pop_back();
+                m_steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(unsigned int self)
+    {
+        unsigned int chunk;
+        while (nextChunk(self, chunk)) {
+            m_fn(self, (*m_chunks)[chunk]);
+        }
+    }
+
+    void worker(unsigned int self)
+    {
+        unsigned long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_start_cv.wait(lock, [&]{ return m_stop || m_generation != seen; });
+                if (m_stop) return;
+                seen = m_generation;
+            }
+            work(self);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_busy--;
+            }
+            m_done_cv.notify_all();
+        }
+    }
+
+public:
+    WorkStealingPool(unsigned int num_threads) :
+        m_num_threads(num_threads < 1 ? 1 : num_threads),
+        m_queues(m_num_threads),
+        m_chunks(nullptr),
+        m_generation(0),
+        m_busy(0),
+        m_stop(false),
+        m_steals(0)
+    {
+        for (unsigned int t = 1; t < m_num_threads; t++) {
+            m_threads.push_back(std::thread(&WorkStealingPool::worker, this, t));
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_start_cv.notify_all();
+        for (unsigned int t = 0; t < m_threads.size(); t++) {
+            m_threads[t].join();
+        }
+    }
+
+    unsigned int  numThreads() { return m_num_threads; }
+    unsigned long numSteals()  { return m_steals; }
+
+    // Calls fn once for every chunk and returns when all calls are done
+    void run(const std::vector<DocChunk>& chunks, std::function<void(const DocChunk&)> fn)
+    {
+        run(chunks, [&](unsigned int, const DocChunk& chunk) { fn(chunk); });
+    }
+
+    // Same, fn(thread, chunk) with thread in [0, numThreads())
+    void run(const std::vector<DocChunk>& chunks, std::function<void(unsigned int, const DocChunk&)> fn)
+    {
+        for (unsigned int c = 0; c < chunks.size(); c++) {
+            m_queues[c % m_num_threads].chunks.push_back(c);
+        }
+        m_chunks = &chunks;
+        m_fn     = fn;
+        m_steals = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy = m_num_threads - 1;
+            m_generation++;
+        }
+        m_start_cv.notify_all();
+        work(0);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cv.wait(lock, [&]{ return m_busy == 0; });
+    }
+};
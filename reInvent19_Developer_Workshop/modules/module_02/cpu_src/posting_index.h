@@ -0,0 +1,186 @@
+#pragma once
+
+#include<vector>
+#include<cstring>
+#include<algorithm>
+#include<unordered_map>
+
+#include"sizes.h"
+#include"top_k.h"
+#include"weight_store.h"
+#include"corpus_gen.h"
+
+// Incremental rescoring when a few profile weights change.
+//
+// The index is filled during a first scoring pass (addDoc) with a posting
+// (doc, frequency) for every word that passes the bloom filter, the only
+// words a score depends on, and the weight each word was scored with.
+// update then applies a batch of (word_id, new weight) changes to the
+// scores of the documents of their postings only, in time proportional to
+// the postings of the changed words.
+//
+// A word that did not pass the filter has no postings. When it gets a
+// weight (a word added to the profile) the corpus is scanned once for all
+// such words of the batch and their postings are added, so later changes
+// to them are incremental as well. The caller adds them to its bloom
+// filter as usual; the index does not need it.
+//
+// The index refers to the corpus words and sizes, which must stay valid.
+
+struct WeightChange {
+    unsigned int  word_id;
+    unsigned long weight;
+};
+
+// A batch of changes to the profile: half of them give a profile word a
+// new weight from 1 to 100, a quarter remove one and a quarter give a
+// weight to a random word, most likely not in the profile
+inline std::vector<WeightChange> genWeightChanges(unsigned long seed, const WeightList& profile, unsigned int num_changes)
+{
+    SplitMix64 rng(seed, GenWeightChanges, 0);
+    std::vector<WeightChange> changes(num_changes);
+    for (unsigned int c = 0; c < num_changes; c++) {
+        unsigned int kind = rng.below(4);
+        if (kind == 3 || profile.empty()) {
+            changes[c].word_id = rng.below((1u << 24) - 1);
+            changes[c].weight  = 1 + rng.below(100);
+        } else {
+            changes[c].word_id = profile[rng.below(profile.size())].first;
+            changes[c].weight  = (kind == 0) ? 0 : 1 + rng.below(100);
+        }
+    }
+    return changes;
+}
+
+class PostingIndex
+{
+    struct Posting {
+        unsigned int doc;
+        unsigned int frequency;
+    };
+
+    struct WordPostings {
+        unsigned long        weight;
+        std::vector<Posting> postings;
+    };
+
+    const unsigned int*                            m_doc_sizes;
+    const unsigned int*                            m_words;
+    unsigned int                                   m_num_docs;
+    std::unordered_map<unsigned int, WordPostings> m_index;
+    unsigned long                                  m_num_postings;
+
+public:
+    PostingIndex(const unsigned int* doc_sizes, const unsigned int* input_doc_words, unsigned int total_num_docs) :
+        m_doc_sizes(doc_sizes), m_words(input_doc_words), m_num_docs(total_num_docs), m_num_postings(0) {}
+
+    // Indexes words that did not pass the filter, with a weight of 0: one
+    // scan of the corpus for all of them. update does it for the words a
+    // batch adds to the profile.
+    void indexWords(const std::vector<unsigned int>& new_words)
+    {
+        // The low 19 bits of the words first, 64 KB that stay in cache, then
+        // the exact bitmap of the few words that pass
+        std::vector<unsigned long> low((1 << 19) / 64, 0);
+        std::vector<unsigned long> wanted((1 << 24) / 64, 0);
+        bool any = false;
+        for (unsigned int i = 0; i < new_words.size(); i++) {
+            if (m_index.find(new_words[i]) != m_index.end()) continue;
+            low[(new_words[i] >> 6) & 0x1fff] |= 1ul << (new_words[i] & 63);
+            wanted[new_words[i] >> 6] |= 1ul << (new_words[i] & 63);
+            m_index[new_words[i]].weight = 0;
+            any = true;
+        }
+        if (!any) return;
+        for (unsigned int doc = 0, n = 0; doc < m_num_docs; doc++) {
+            for (unsigned int i = 0; i < m_doc_sizes[doc]; i++, n++) {
+                unsigned int word_id = m_words[n] >> 8;
+                if (!((low[(word_id >> 6) & 0x1fff] >> (word_id & 63)) & 1)) continue;
+                if (word_id != docTag && ((wanted[word_id >> 6] >> (word_id & 63)) & 1)) {
+                    Posting posting = { doc, m_words[n] & 0x00ff };
+                    m_index[word_id].postings.push_back(posting);
+                    m_num_postings++;
+                }
+            }
+        }
+    }
+
+    // Words of changes that would need indexWords
+    std::vector<unsigned int> addedWords(const std::vector<WeightChange>& changes) const
+    {
+        std::vector<unsigned int> added;
+        for (unsigned int c = 0; c < changes.size(); c++) {
+            if (changes[c].weight != 0 && m_index.find(changes[c].word_id) == m_index.end()) {
+                added.push_back(changes[c].word_id);
+            }
+        }
+        return added;
+    }
+
+    unsigned int  numWords()    const { return m_index.size(); }
+    unsigned long numPostings() const { return m_num_postings; }
+    size_t        bytes()       const { return m_num_postings * sizeof(Posting) + m_index.size() * sizeof(WordPostings); }
+
+    // Scores a document and indexes its flagged words. flags are the
+    // in-hash flags of its words, as computeHashFlags writes them.
+    template <class Store>
+    unsigned long addDoc(unsigned int doc, const unsigned int* words, const unsigned char* flags,
+                         unsigned int size, const Store& weights)
+    {
+        unsigned long score = 0;
+        for (unsigned int i = 0; i < size; i++) {
+            // Few words pass the filter: eight clear flags at a time
+            unsigned long group;
+            if (i + 8 <= size && (memcpy(&group, &flags[i], 8), group == 0)) {
+                i += 7;
+                continue;
+            }
+            if (!flags[i]) continue;
+            unsigned int word_id = words[i] >> 8;
+            unsigned int frequency = words[i] & 0x00ff;
+            WordPostings& entry = m_index[word_id];
+            entry.weight = weights.weight(word_id);
+            Posting posting = { doc, frequency };
+            entry.postings.push_back(posting);
+            m_num_postings++;
+            score += entry.weight * (unsigned long)frequency;
+        }
+        return score;
+    }
+
+    // Applies the changes, in order, to profile_score and returns the
+    // documents whose score changed with their new score, by doc id
+    std::vector<DocScore> update(const std::vector<WeightChange>& changes, unsigned long* profile_score)
+    {
+        indexWords(addedWords(changes));
+
+        std::vector<unsigned int> touched;
+        std::vector<unsigned long> before;
+        std::unordered_map<unsigned int, unsigned int> seen;
+        for (unsigned int c = 0; c < changes.size(); c++) {
+            std::unordered_map<unsigned int, WordPostings>::iterator it = m_index.find(changes[c].word_id);
+            if (it == m_index.end()) continue;
+            WordPostings& entry = it->second;
+            for (unsigned int i = 0; i < entry.postings.size(); i++) {
+                const Posting& posting = entry.postings[i];
+                if (seen.insert(std::make_pair(posting.doc, (unsigned int)touched.size())).second) {
+                    touched.push_back(posting.doc);
+                    before.push_back(profile_score[posting.doc]);
+                }
+                // Unsigned arithmetic: the difference wraps and comes back
+                profile_score[posting.doc] += (changes[c].weight - entry.weight) * (unsigned long)posting.frequency;
+            }
+            entry.weight = changes[c].weight;
+        }
+
+        std::vector<DocScore> updated;
+        for (unsigned int t = 0; t < touched.size(); t++) {
+            if (profile_score[touched[t]] != before[t]) {
+                DocScore entry = { touched[t], profile_score[touched[t]] };
+                updated.push_back(entry);
+            }
+        }
+        std::sort(updated.begin(), updated.end(), [](const DocScore& a, const DocScore& b) { return a.doc < b.doc; });
+        return updated;
+    }
+};
@@ -1,6 +1,16 @@
 #pragma once
 
-#define hash_bloom 0x7ffff 
+// Default bloom filter size and kernel capacity, log2 of the number of
+// 32-bit words; the filter actually used is described by a BloomConfig
 #define bloom_size 14
 #define docTag 0xffffffff
 
+
+// Blocked layout: hash_pu selects one 512-bit (64-byte) block of the
+// filter, all bits of a word are taken from hash_lu inside that block
+#define bloom_block_bits 9
+#define bloom_block_mask 0x1ff
+
+// Most probes per word the runOnfpga kernel unrolls, see BloomConfig
+#define bloom_max_hashes 4
+#define bloom_max_hashes_blocked 3
@@ -0,0 +1,68 @@
+#pragma once
+
+#include<vector>
+#include<algorithm>
+
+// Best-matching documents, selected as the scores are produced.
+//
+// TopK keeps the k best (doc, score) pairs seen so far in a bounded heap
+// with the worst of them on top, so a score that does not make it costs
+// one compare and the full score vector is never stored or sorted. Each
+// thread fills its own TopK; merge folds them together at the end.
+// Higher scores come first, equal scores by increasing doc id, so the
+// result does not depend on the order the documents were scored in.
+
+struct DocScore {
+    unsigned int  doc;
+    unsigned long score;
+};
+
+class TopK
+{
+    unsigned int          m_k;
+    std::vector<DocScore> m_heap;
+
+    static bool better(const DocScore& a, const DocScore& b)
+    {
+        return a.score > b.score || (a.score == b.score && a.doc < b.doc);
+    }
+
+public:
+    TopK(unsigned int k = 0) : m_k(k) { m_heap.reserve(k); }
+
+    unsigned int size() const { return m_heap.size(); }
+
+    // Lowest score that can still make it into a full selection
+    unsigned long threshold() const
+    {
+        return (m_k > 0 && m_heap.size() == m_k) ? m_heap.front().score : 0;
+    }
+
+    void push(unsigned int doc, unsigned long score)
+    {
+        DocScore entry = { doc, score };
+        if (m_heap.size() < m_k) {
+            m_heap.push_back(entry);
+            std::push_heap(m_heap.begin(), m_heap.end(), better);
+        } else if (m_k > 0 && better(entry, m_heap.front())) {
+            std::pop_heap(m_heap.begin(), m_heap.end(), better);
+            m_heap.back() = entry;
+            std::push_heap(m_heap.begin(), m_heap.end(), better);
+        }
+    }
+
+    void merge(const TopK& other)
+    {
+        for (unsigned int i = 0; i < other.m_heap.size(); i++) {
+            push(other.m_heap[i].doc, other.m_heap[i].score);
+        }
+    }
+
+    // The selection, best first
+    std::vector<DocScore> sorted() const
+    {
+        std::vector<DocScore> result(m_heap);
+        std::sort(result.begin(), result.end(), better);
+        return result;
+    }
+};
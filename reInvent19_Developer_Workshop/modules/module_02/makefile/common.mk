@@ -1,7 +1,7 @@
 SHELL := /bin/sh
 host: $(SRCDIR)/*.cpp $(SRCDIR)/*.c $(SRCDIR)/*.h
 	mkdir -p $(BUILDDIR)
-	g++ -D__USE_XOPEN2K8 -D__USE_XOPEN2K8 -I$(XILINX_XRT)/include -I$(SRCDIR) -O3 -Wall -fmessage-length=0 -std=c++11 \
+	g++ -D__USE_XOPEN2K8 -D__USE_XOPEN2K8 -I$(XILINX_XRT)/include -I$(SRCDIR) -O3 -Wall -fmessage-length=0 -std=c++11 $(HOST_FLAGS) \
 	$(HOST_SRC_CPP) \
 	-L$(XILINX_XRT)/lib/ \
 	-lxilinxopencl -lpthread -lrt \
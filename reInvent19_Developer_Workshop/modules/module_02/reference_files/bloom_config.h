@@ -0,0 +1,153 @@
+#pragma once
+
+#include<cstdio>
+#include<cmath>
+#include<cstring>
+
+#include"sizes.h"
+#include"hash_policy.h"
+
+// Standard: the bits of a word are anywhere in the filter.
+// Blocked:  all bits of a word are in the same 64-byte block, one cache line.
+enum BloomLayout { BloomStandard, BloomBlocked };
+
+#ifdef BLOOM_BLOCKED
+#define bloom_default_layout BloomBlocked
+#else
+#define bloom_default_layout BloomStandard
+#endif
+
+// Bloom filter parameters, used by setupData to build the filter, by the
+// CPU scoring and as runOnfpga kernel arguments.
+//
+// The filter has 1<<size_log2 bits. A word is probed at num_hashes bits
+// derived (double hashing) from
+//
+//   hash_pu = Hash::hash(word_id, seed_pu)
+//   hash_lu = Hash::hash(word_id, seed_lu)
+//
+// with the Hash policy of hash (see hash_policy.h), by default
+// MurmurHash2(&word_id, 3, seed). The default configuration is the
+// original filter: 1<<bloom_size words, two hashes, seeds 1 and 5.
+// Sizes are limited to the kernel capacity of 1<<bloom_size words and
+// the hash count to what the kernel unrolls.
+struct BloomConfig {
+    unsigned int size_log2;
+    unsigned int num_hashes;
+    unsigned int seed_pu;
+    unsigned int seed_lu;
+    BloomLayout  layout;
+    BloomHash    hash;
+
+    static const unsigned int min_size_log2 = bloom_block_bits;
+    static const unsigned int max_size_log2 = bloom_size + 5;
+
+    BloomConfig(BloomLayout layout = bloom_default_layout, BloomHash hash = bloom_default_hash) :
+        size_log2(bloom_size + 5), num_hashes(2), seed_pu(1), seed_lu(5), layout(layout), hash(hash) {}
+
+    unsigned int numWords()  const { return 1u << (size_log2 - 5); }
+    unsigned int mask()      const { return (1u << size_log2) - 1; }
+    unsigned int maxHashes() const { return layout == BloomBlocked ? bloom_max_hashes_blocked : bloom_max_hashes; }
+
+    bool valid() const {
+        return size_log2 >= min_size_log2 && size_log2 <= max_size_log2 &&
+               num_hashes >= 1 && num_hashes <= maxHashes();
+    }
+
+    // Bit index of probe i. The blocked layout takes the block from
+    // hash_pu and 9 bits of hash_lu per probe inside the block.
+    unsigned int index(unsigned int hash_pu, unsigned int hash_lu, unsigned int i) const {
+        if (layout == BloomBlocked) {
+            return (hash_pu & mask() & ~bloom_block_mask) | ((hash_lu >> (i*bloom_block_bits)) & bloom_block_mask);
+        }
+        return (hash_pu + i*hash_lu) & mask();
+    }
+
+    // With the Hash policy given at compile time, for the loops that
+    // dispatch on hash once rather than per word
+    template <class Hash>
+    void insertWith(unsigned int* bloom_filter, unsigned int word_id) const {
+        HashPair h = Hash::dual(word_id, seed_pu, seed_lu);
+        for (unsigned int i = 0; i < num_hashes; i++) {
+            unsigned hash = index(h.pu, h.lu, i);
+            bloom_filter[ hash >> 5 ] |= 1 << (hash & 0x1f);
+        }
+    }
+
+    template <class Hash>
+    bool containsWith(const unsigned int* bloom_filter, unsigned int word_id) const {
+        HashPair h = Hash::dual(word_id, seed_pu, seed_lu);
+        for (unsigned int i = 0; i < num_hashes; i++) {
+            unsigned hash = index(h.pu, h.lu, i);
+            if (!(bloom_filter[ hash >> 5 ] & ( 1 << (hash & 0x1f)))) return false;
+        }
+        return true;
+    }
+
+    void insert(unsigned int* bloom_filter, unsigned int word_id) const {
+        switch (hash) {
+          case HashXXH32:         insertWith<XXHash32>(bloom_filter, word_id); break;
+          case HashMultiplyShift: insertWith<MultiplyShiftHash>(bloom_filter, word_id); break;
+          default:                insertWith<Murmur2Hash>(bloom_filter, word_id); break;
+        }
+    }
+
+    bool contains(const unsigned int* bloom_filter, unsigned int word_id) const {
+        switch (hash) {
+          case HashXXH32:         return containsWith<XXHash32>(bloom_filter, word_id);
+          case HashMultiplyShift: return containsWith<MultiplyShiftHash>(bloom_filter, word_id);
+          default:                return containsWith<Murmur2Hash>(bloom_filter, word_id);
+        }
+    }
+
+    static const char* hashName(BloomHash hash) {
+        switch (hash) {
+          case HashXXH32:         return "xxh32";
+          case HashMultiplyShift: return "mulshift";
+          default:                return "murmur2";
+        }
+    }
+
+    // False if name is none of the hashName names
+    static bool hashFromName(const char* name, BloomHash& hash) {
+        for (int h = HashMurmur2; h <= HashMultiplyShift; h++) {
+            if (!strcmp(name, hashName((BloomHash)h))) {
+                hash = (BloomHash)h;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // (1 - e^(-kn/m))^k; the blocked layout does slightly worse
+    double expectedFpr(unsigned int num_entries) const {
+        double m = (double)(1ul << size_log2);
+        return pow(1.0 - exp(-(double)num_hashes * num_entries / m), num_hashes);
+    }
+
+    // Smallest filter, with the best hash count for its size, whose
+    // expected false-positive rate for num_entries words meets target_fpr.
+    // Falls back to the largest filter the kernel holds.
+    static BloomConfig fromTarget(double target_fpr, unsigned int num_entries,
+                                  BloomLayout layout = bloom_default_layout,
+                                  BloomHash hash = bloom_default_hash) {
+        BloomConfig config(layout, hash);
+        for (config.size_log2 = min_size_log2; ; config.size_log2++) {
+            double m = (double)(1ul << config.size_log2);
+            double k = round(m / (num_entries ? num_entries : 1) * log(2.0));
+            config.num_hashes = (k < 1) ? 1 : (k > config.maxHashes()) ? config.maxHashes() : (unsigned int)k;
+            if (config.size_log2 == max_size_log2 || config.expectedFpr(num_entries) <= target_fpr) break;
+        }
+        if (config.expectedFpr(num_entries) > target_fpr) {
+            printf("WARNING: target false-positive rate %g needs more than the %lu KB bloom filter capacity\n",
+                   target_fpr, (1ul << max_size_log2) / 8 / 1024);
+        }
+        return config;
+    }
+
+    void print(unsigned int num_entries) const {
+        printf("Bloom filter: %s, %s, %.1f KB, %u hashes, seeds %u/%u, expected FPR %.4f%%\n",
+               layout == BloomBlocked ? "blocked" : "standard", hashName(hash), (1ul << size_log2) / 8 / 1024.0,
+               num_hashes, seed_pu, seed_lu, 100.0 * expectedFpr(num_entries));
+    }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include<vector>
+
+#include"sizes.h"
+#include"bloom_config.h"
+
+// Splits a corpus of any size into FPGA transfers.
+//
+// runOnfpga processes a multiple of 64 words per invocation (the flags of
+// 64 words fill one 512-bit output word; 512 words with packed flags).
+// The transfers cover the corpus rounded down to that granule, all of the
+// same size except a shorter last one. The tail, fewer than granule words,
+// is flagged on the CPU while the FPGA works, so the corpus never has to
+// be padded.
+
+// Transfer size used when the number of transfers is not given
+const unsigned long default_transfer_bytes = 32ul*1024*1024;
+
+struct TransferPlan {
+    std::vector<unsigned int> offset;
+    std::vector<unsigned int> size;
+    unsigned int              fpga_words;
+    unsigned int              tail_words;
+
+    unsigned int count() const { return offset.size(); }
+};
+
+// Number of transfers of about transfer_bytes for total_size words
+inline unsigned int numTransfers(unsigned int total_size, unsigned long transfer_bytes)
+{
+    unsigned long total_bytes = (unsigned long)total_size * sizeof(unsigned int);
+    unsigned long count = (total_bytes + transfer_bytes - 1) / transfer_bytes;
+    return count > 0 ? count : 1;
+}
+
+inline TransferPlan planTransfers(unsigned int total_size, unsigned int num_transfers, unsigned int granule = 64)
+{
+    TransferPlan plan;
+    plan.fpga_words = total_size / granule * granule;
+    plan.tail_words = total_size - plan.fpga_words;
+
+    if (num_transfers == 0) num_transfers = 1;
+    unsigned int granules = plan.fpga_words / granule;
+    unsigned int chunk = (granules + num_transfers - 1) / num_transfers * granule;
+
+    for (unsigned int offset = 0; offset < plan.fpga_words; offset += chunk) {
+        plan.offset.push_back(offset);
+        plan.size.push_back((plan.fpga_words - offset < chunk) ? plan.fpga_words - offset : chunk);
+    }
+    return plan;
+}
+
+// In-hash flags of the words in [begin, end), computed on the CPU
+inline void computeTailFlags(
+    const unsigned int* input_doc_words,
+    const unsigned int* bloom_filter,
+    unsigned char*      inh_flags,
+    unsigned int        begin,
+    unsigned int        end,
+    const BloomConfig&  bloom)
+{
+    for (unsigned int n = begin; n < end; n++) {
+        unsigned int word_id = input_doc_words[n] >> 8;
+        inh_flags[n] = (word_id != docTag) && bloom.contains(bloom_filter, word_id);
+    }
+}
+
+// Same, one bit per word as with -DFLAGS_PACKED (see packed_flags.h).
+// begin is a multiple of 64; the bits past end in the last 64-bit word
+// are cleared.
+inline void computeTailPackedFlags(
+    const unsigned int* input_doc_words,
+    const unsigned int* bloom_filter,
+    unsigned long*      packed_flags,
+    unsigned int        begin,
+    unsigned int        end,
+    const BloomConfig&  bloom)
+{
+    for (unsigned int w = begin / 64; w < (end + 63) / 64; w++) {
+        packed_flags[w] = 0;
+    }
+    for (unsigned int n = begin; n < end; n++) {
+        unsigned int word_id = input_doc_words[n] >> 8;
+        if ((word_id != docTag) && bloom.contains(bloom_filter, word_id)) {
+            packed_flags[n / 64] |= 1ul << (n % 64);
+        }
+    }
+}
@@ -1,5 +1,16 @@
 #pragma once
 
+#include "bloom_config.h"
+
+// Top-K query (main.cpp --topk, --min-score), used by the doc_scores step
+extern unsigned int  top_k;
+extern unsigned long min_score;
+
+// Data set of the run (main.cpp), used by the multi_profile step to
+// generate the other profiles of its batch
+extern unsigned long corpus_seed;
+extern unsigned int  profile_entries;
+
 unsigned int MurmurHash2(const void* key ,int len,unsigned int seed);
 
 void runOnCPU (
@@ -9,7 +20,8 @@ void runOnCPU (
     unsigned long* profile_weights,
     unsigned long* profile_score,
     unsigned int   total_num_docs,
-    unsigned int   total_size);
+    unsigned int   total_size,
+    const BloomConfig& bloom);
 
 void runOnFPGA(	
 	unsigned int*  doc_sizes,
@@ -19,4 +31,14 @@ void runOnFPGA(
 	unsigned long* profile_score,
 	unsigned int   total_num_docs, 
 	unsigned int   total_doc_size,
-	int            num_iter);
+	int            num_iter,
+	const BloomConfig& bloom);
+
+void runOnFPGAStream(
+	const char*        corpus_path,
+	unsigned int*      bloom_filter,
+	unsigned long*     profile_weights,
+	const BloomConfig& bloom,
+	unsigned int       chunk_words,
+	unsigned int       num_slots,
+	const char*        scores_path);
@@ -7,38 +7,131 @@
 
 #include "hls_stream_utils.h"
 #include "sizes.h"
+#include "hash_policy.h"
 
 #ifndef PARALLELISATION
 #define PARALLELISATION 8
 #endif
 
 typedef ap_uint<sizeof(int )*8*PARALLELISATION> parallel_words_t; 
-typedef ap_uint<sizeof(char)*8*PARALLELISATION> parallel_flags_t; 
 
+// In-hash flags, a byte per word or, built with -DFLAGS_PACKED, a bit per
+// word (see packed_flags.h for the layout the host reads)
+#ifdef FLAGS_PACKED
+const unsigned int flag_bits = 1;
+#else
+const unsigned int flag_bits = 8;
+#endif
+typedef ap_uint<flag_bits*PARALLELISATION> parallel_flags_t; 
+
+// Capacity of the kernel: the filter the host sets up (1<<bloom_size_log2
+// bits) can be any size up to this many 32-bit words
 const unsigned int bloom_filter_size = 1<<bloom_size;
 
-unsigned int MurmurHash2(unsigned int key, int len, unsigned int seed)
+// Local copies of the bloom filter. In the standard layout every probe
+// is a 32-bit read of its own; a dual-port copy serves two probes, so
+// each lane has (bloom_max_hashes+1)/2 copies. In the blocked layout all
+// probes of a word are in one 512-bit block, so a lane makes a single
+// wide read and the two ports of a copy serve two lanes.
+#ifdef BLOOM_BLOCKED
+typedef ap_uint<512> bloom_word_t;
+const unsigned int bloom_copies     = PARALLELISATION/2;
+const unsigned int bloom_local_size = bloom_filter_size/16;
+#else
+typedef unsigned int bloom_word_t;
+const unsigned int bloom_copies_per_lane = (bloom_max_hashes+1)/2;
+const unsigned int bloom_copies     = PARALLELISATION*bloom_copies_per_lane;
+const unsigned int bloom_local_size = bloom_filter_size;
+#endif
+
+// A bank of local copies holds one filter. A copy is 64 KB, 16 BRAM36,
+// so at PARALLELISATION 8 a bank takes 256 BRAM36 in the standard layout
+// (16 copies) and 64 in the blocked layout (4 copies).
+//
+// Built with -DFILTER_BANKS=2 (make run STEP=hot_swap), there are two
+// banks: the words are tested against the bank given by filter_bank, and
+// load_filter loads that bank only, so the host can load a new filter in
+// the other bank while chunks are in flight (see run_hot_swap.cpp). The
+// second bank doubles the BRAM of a CU, 512 BRAM36 in the standard
+// layout, so it is only built for that step; otherwise filter_bank is
+// ignored.
+//
+// Built with -DBLOOM_PROFILES=P (2 or 4), there is a bank per profile,
+// loaded with filter_bank=p, and every word is tested against all of them
+// at once: bit p of its flag byte is set when it is in the filter of
+// profile p, so the corpus is read once for P profiles (see
+// run_multi_profile.cpp). filter_bank then only selects the bank to load.
+// Every profile takes the BRAM of a bank, so P=4 takes 1024 BRAM36 in the
+// standard layout, about half of the device for one CU; 8 profiles would
+// not place.
+#ifdef BLOOM_PROFILES
+const unsigned int bloom_banks = BLOOM_PROFILES;
+const unsigned int flag_banks  = BLOOM_PROFILES;
+static_assert(BLOOM_PROFILES == 2 || BLOOM_PROFILES == 4, "BLOOM_PROFILES is 2 or 4");
+static_assert(flag_bits == 8, "BLOOM_PROFILES needs a flag byte per word");
+#ifdef DOC_SCORES
+#error "BLOOM_PROFILES applies to the flag kernel, not to DOC_SCORES"
+#endif
+#ifdef FILTER_BANKS
+#error "BLOOM_PROFILES has a bank per profile, FILTER_BANKS does not apply"
+#endif
+#else
+#ifdef FILTER_BANKS
+const unsigned int bloom_banks = FILTER_BANKS;
+static_assert(FILTER_BANKS == 1 || FILTER_BANKS == 2, "FILTER_BANKS is 1 or 2");
+#else
+const unsigned int bloom_banks = 1;
+#endif
+const unsigned int flag_banks  = 1;
+#endif
+
+// Bloom filter test of one word, made by lane j on its local copies. The
+// hash policy is the one the kernel is built with (bloom_hash_policy, see
+// hash_policy.h); both hashes of a word come from one fused dual hash.
+template <class Hash>
+bool in_hash (
+        unsigned int   word_id,
+        unsigned int   j,
+        bloom_word_t   bloom_filter_local[bloom_copies][bloom_local_size],
+        unsigned int   bloom_mask,
+        unsigned int   num_hashes,
+        unsigned int   seed_pu,
+        unsigned int   seed_lu)
 {
-  const unsigned char* data = (const unsigned char *)&key;
-  const unsigned int m = 0x5bd1e995;
-  unsigned int h = seed ^ len;
-  switch(len) {
-    case 3: h ^= data[2] << 16;
-    case 2: h ^= data[1] << 8;
-    case 1: h ^= data[0];
-            h *= m;
-  };
-  h ^= h >> 13;
-  h *= m;
-  h ^= h >> 15;
-  return h;
-} 
+#pragma HLS INLINE
+  HashPair hashes = Hash::dual(word_id, seed_pu, seed_lu);
+  unsigned hash_pu = hashes.pu;
+  unsigned hash_lu = hashes.lu;
+  bool doc_end= (word_id==docTag); 
+  bool inh = !doc_end;
+#ifdef BLOOM_BLOCKED
+  bloom_word_t block = bloom_filter_local[j/2][ (hash_pu&bloom_mask) >> bloom_block_bits ];
+  for (unsigned int k=0; k<bloom_max_hashes_blocked; k++)
+  {
+#pragma HLS UNROLL
+    unsigned bit = (hash_lu >> (k*bloom_block_bits)) & bloom_block_mask;
+    if (k < num_hashes) inh = inh && block[ bit ];
+  }
+#else
+  for (unsigned int k=0; k<bloom_max_hashes; k++)
+  {
+#pragma HLS UNROLL
+    unsigned hash = (hash_pu + k*hash_lu)&bloom_mask;
+    if (k < num_hashes) inh = inh && (bloom_filter_local[j*bloom_copies_per_lane + k/2][ hash >> 5 ] & ( 1 << (hash & 0x1f)));
+  }
+#endif
+  return inh;
+}
 
 void compute_hash_flags (
         hls::stream<parallel_flags_t>& flag_stream,
         hls::stream<parallel_words_t>& word_stream,
-        unsigned int                   bloom_filter_local[PARALLELISATION][bloom_filter_size],
-        unsigned int                   total_size) 
+        bloom_word_t                   bloom_filter_local[flag_banks][bloom_copies][bloom_local_size],
+        unsigned int                   total_size,
+        unsigned int                   bloom_mask,
+        unsigned int                   num_hashes,
+        unsigned int                   seed_pu,
+        unsigned int                   seed_lu) 
 {
   compute_flags: for(int i=0; i<total_size/PARALLELISATION; i++)
   {
@@ -50,17 +143,15 @@ void compute_hash_flags (
 #pragma HLS UNROLL
 
       unsigned int curr_entry = parallel_entries(31+j*32, j*32);
-      unsigned int frequency = curr_entry & 0x00ff;
       unsigned int word_id = curr_entry >> 8;
-      unsigned hash_pu = MurmurHash2(word_id, 3, 1);
-      unsigned hash_lu = MurmurHash2(word_id, 3, 5);
-      bool doc_end= (word_id==docTag); 
-      unsigned hash1 = hash_pu&hash_bloom; 
-      bool inh1 = (!doc_end) && (bloom_filter_local[j][ hash1 >> 5 ] & ( 1 << (hash1 & 0x1f)));
-      unsigned hash2=(hash_pu+hash_lu)&hash_bloom;
-      bool inh2 = (!doc_end) && (bloom_filter_local[j][ hash2 >> 5 ] & ( 1 << (hash2 & 0x1f)));
-
-      inh_flags(7+j*8, j*8) = (inh1 && inh2) ? 1 : 0;
+      unsigned int inh = 0;
+      for (unsigned int p=0; p<flag_banks; p++)
+      {
+#pragma HLS UNROLL
+        if (in_hash<bloom_hash_policy>(word_id, j, bloom_filter_local[p], bloom_mask, num_hashes, seed_pu, seed_lu)) inh |= 1u << p;
+      }
+
+      inh_flags(flag_bits-1+j*flag_bits, j*flag_bits) = inh;
     }
 
     flag_stream.write(inh_flags); 
@@ -70,8 +161,12 @@ void compute_hash_flags (
 void compute_hash_flags_dataflow(
         ap_uint<512>*   output_flags,
         ap_uint<512>*   input_words,
-        unsigned int    bloom_filter[PARALLELISATION][bloom_filter_size],
-        unsigned int    total_size)
+        bloom_word_t    bloom_filter[flag_banks][bloom_copies][bloom_local_size],
+        unsigned int    total_size,
+        unsigned int    bloom_mask,
+        unsigned int    num_hashes,
+        unsigned int    seed_pu,
+        unsigned int    seed_lu)
 {
     hls::stream<ap_uint<512> >    data_from_gmem;
     hls::stream<parallel_words_t> word_stream;
@@ -87,24 +182,269 @@ void compute_hash_flags_dataflow(
   hls_stream::resize(word_stream, data_from_gmem, total_size/(512/32));
 
   // Process stream of parallel word 
-  compute_hash_flags(flag_stream, word_stream, bloom_filter, total_size);
+  compute_hash_flags(flag_stream, word_stream, bloom_filter, total_size,
+                     bloom_mask, num_hashes, seed_pu, seed_lu);
  
   // Form a stream of 512-bit values from stream of parallel flags
-  hls_stream::resize(data_to_gmem, flag_stream, total_size/(512/8));
+  hls_stream::resize(data_to_gmem, flag_stream, total_size/(512/flag_bits));
 
   // Burst write 512-bit values to global memory over AXI interface
-  hls_stream::buffer(output_flags, data_to_gmem, total_size/(512/8));
+  hls_stream::buffer(output_flags, data_to_gmem, total_size/(512/flag_bits));
+}
+
+#ifdef DOC_SCORES
+// Score of every segment of the words. The host cuts the words of an
+// invocation into segments (its documents, or the parts of the documents
+// that straddle the invocation boundaries) and sends their sizes; their
+// scores go back instead of a flag per word.
+// The weight of a flagged word is read from the profile table in global
+// memory. Groups of words with no flagged word and no segment end, most
+// of them, go through in one step.
+// With min_score 0 every score goes back, in segment order. Otherwise the
+// segments scored below it are dropped, except the first and the last
+// one, which may be part of a document that straddles the boundary, and
+// the kept ones go back as (segment, score) pairs.
+void compute_doc_scores (
+        hls::stream<ap_uint<64> >&     score_stream,
+        hls::stream<bool>&             kept_stream,
+        hls::stream<parallel_words_t>& word_stream,
+        hls::stream<unsigned int>&     segment_stream,
+        ap_uint<64>*                   profile_weights,
+        bloom_word_t                   bloom_filter_local[bloom_copies][bloom_local_size],
+        unsigned int                   total_size,
+        unsigned int                   num_segments,
+        unsigned long                  min_score,
+        unsigned int                   bloom_mask,
+        unsigned int                   num_hashes,
+        unsigned int                   seed_pu,
+        unsigned int                   seed_lu) 
+{
+  unsigned int  seg_left = 0;
+  unsigned int  seg = 0;
+  unsigned long ans = 0;
+
+  compute_scores: for(int i=0; i<total_size/PARALLELISATION; i++)
+  {
+    parallel_words_t parallel_entries = word_stream.read();
+    bool inh[PARALLELISATION];
+#pragma HLS ARRAY_PARTITION variable=inh complete
+    bool any = false;
+
+    for (unsigned int j=0; j<PARALLELISATION; j++)
+    {
+#pragma HLS UNROLL
+      unsigned int curr_entry = parallel_entries(31+j*32, j*32);
+      unsigned int word_id = curr_entry >> 8;
+      inh[j] = in_hash<bloom_hash_policy>(word_id, j, bloom_filter_local, bloom_mask, num_hashes, seed_pu, seed_lu);
+      any = any || inh[j];
+    }
+
+    if (!any && seg_left > PARALLELISATION) {
+      seg_left -= PARALLELISATION;
+      continue;
+    }
+
+    accumulate: for (unsigned int j=0; j<PARALLELISATION; j++)
+    {
+      if (seg_left == 0) seg_left = segment_stream.read();
+
+      unsigned int curr_entry = parallel_entries(31+j*32, j*32);
+      if (inh[j]) {
+        unsigned long weight = profile_weights[curr_entry >> 8];
+        ans += weight * (curr_entry & 0x00ff);
+      }
+
+      seg_left--;
+      if (seg_left == 0) {
+        if (seg == 0 || seg == num_segments-1 || ans >= min_score) {
+          if (min_score) score_stream.write(seg);
+          score_stream.write(ans);
+          kept_stream.write(true);
+        }
+        seg++;
+        ans = 0;
+      }
+    }
+  }
+  kept_stream.write(false);
+}
+
+// Number of segments kept, then their scores, or their pairs when
+// min_score drops some
+void write_kept_scores(
+        ap_uint<64>*                output_scores,
+        hls::stream<ap_uint<64> >&  score_stream,
+        hls::stream<bool>&          kept_stream,
+        unsigned long               min_score)
+{
+  unsigned int kept = 0;
+  unsigned int n = 1;
+  write_scores: while (kept_stream.read()) {
+#pragma HLS PIPELINE II=2
+    if (min_score) output_scores[n++] = score_stream.read();
+    output_scores[n++] = score_stream.read();
+    kept++;
+  }
+  output_scores[0] = kept;
+}
+
+void compute_doc_scores_dataflow(
+        ap_uint<64>*    output_scores,
+        ap_uint<512>*   input_words,
+        unsigned int*   segment_sizes,
+        ap_uint<64>*    profile_weights,
+        bloom_word_t    bloom_filter[bloom_copies][bloom_local_size],
+        unsigned int    total_size,
+        unsigned int    num_segments,
+        unsigned long   min_score,
+        unsigned int    bloom_mask,
+        unsigned int    num_hashes,
+        unsigned int    seed_pu,
+        unsigned int    seed_lu)
+{
+    hls::stream<ap_uint<512> >    data_from_gmem;
+    hls::stream<parallel_words_t> word_stream;
+    hls::stream<unsigned int>     segment_stream;
+    hls::stream<ap_uint<64> >     score_stream;
+    hls::stream<bool>             kept_stream;
+
+#pragma HLS DATAFLOW
+
+  // Burst read 512-bit values from global memory over AXI interface
+  hls_stream::buffer(data_from_gmem, input_words, total_size/(512/32));
+
+  // Form a stream of parallel words from stream of 512-bit values
+  hls_stream::resize(word_stream, data_from_gmem, total_size/(512/32));
+
+  // Segment sizes, in order
+  hls_stream::buffer(segment_stream, segment_sizes, num_segments);
+
+  // Score every segment
+  compute_doc_scores(score_stream, kept_stream, word_stream, segment_stream, profile_weights, bloom_filter,
+                     total_size, num_segments, min_score, bloom_mask, num_hashes, seed_pu, seed_lu);
+
+  // Write the kept scores to global memory over AXI interface
+  write_kept_scores(output_scores, score_stream, kept_stream, min_score);
+}
+#endif
+
+// Copies the bloom filter to every local copy
+void load_bloom_filter(
+        bloom_word_t    bloom_filter_local[bloom_copies][bloom_local_size],
+        unsigned int*   bloom_filter,
+        unsigned int    bloom_words)
+{
+#ifdef BLOOM_BLOCKED
+  bloom_word_t block = 0;
+  read_bloom_filter: for(int index=0; index<bloom_words; index++) {
+#pragma HLS LOOP_TRIPCOUNT max=bloom_filter_size
+#pragma HLS PIPELINE II=1
+    block(31+(index%16)*32, (index%16)*32) = bloom_filter[index];
+    if (index%16 == 15) {
+      for (int j=0; j<bloom_copies; j++) {
+        bloom_filter_local[j][index/16] = block;
+      }
+    }
+  }
+#else
+  read_bloom_filter: for(int index=0; index<bloom_words; index++) {
+#pragma HLS LOOP_TRIPCOUNT max=bloom_filter_size
+#pragma HLS PIPELINE II=1
+    unsigned int tmp = bloom_filter[index];
+    for (int j=0; j<bloom_copies; j++) {
+      bloom_filter_local[j][index] = tmp;
+    }
+  }
+#endif
 }
 
 extern "C" 
 {
 
+#ifdef DOC_SCORES
+  // Built with -DDOC_SCORES: 64-bit segment scores instead of the flags,
+  // after their number. Arguments 0 to 8 are as in the flag kernel, with
+  // the scores in place of the flags. With min_score 0 every segment is
+  // kept and there is a score per segment, 8 bytes; otherwise only the
+  // kept segments come back, as (segment, score) pairs of 16 bytes.
+  void runOnfpga (
+          ap_uint<64>*   output_scores,
+          ap_uint<512>*  input_words,
+          unsigned int*  bloom_filter,
+          unsigned int   total_size,
+          bool           load_filter,
+          unsigned int   bloom_size_log2,
+          unsigned int   num_hashes,
+          unsigned int   seed_pu,
+          unsigned int   seed_lu,
+          unsigned int*  segment_sizes,
+          unsigned int   num_segments,
+          ap_uint<64>*   profile_weights,
+          unsigned long  min_score,
+          unsigned int   filter_bank)
+  {
+  #pragma HLS INTERFACE ap_ctrl_chain port=return            bundle=control
+  #pragma HLS INTERFACE s_axilite     port=return            bundle=control
+  #pragma HLS INTERFACE s_axilite     port=output_scores     bundle=control
+  #pragma HLS INTERFACE s_axilite     port=input_words       bundle=control
+  #pragma HLS INTERFACE s_axilite     port=bloom_filter      bundle=control
+  #pragma HLS INTERFACE s_axilite     port=total_size        bundle=control
+  #pragma HLS INTERFACE s_axilite     port=load_filter       bundle=control
+  #pragma HLS INTERFACE s_axilite     port=bloom_size_log2   bundle=control
+  #pragma HLS INTERFACE s_axilite     port=num_hashes        bundle=control
+  #pragma HLS INTERFACE s_axilite     port=seed_pu           bundle=control
+  #pragma HLS INTERFACE s_axilite     port=seed_lu           bundle=control
+  #pragma HLS INTERFACE s_axilite     port=segment_sizes     bundle=control
+  #pragma HLS INTERFACE s_axilite     port=num_segments      bundle=control
+  #pragma HLS INTERFACE s_axilite     port=profile_weights   bundle=control
+  #pragma HLS INTERFACE s_axilite     port=min_score         bundle=control
+  #pragma HLS INTERFACE s_axilite     port=filter_bank       bundle=control
+
+  #pragma HLS INTERFACE m_axi         port=output_scores     bundle=maxiport0   offset=slave 
+  #pragma HLS INTERFACE m_axi         port=input_words       bundle=maxiport0   offset=slave 
+  #pragma HLS INTERFACE m_axi         port=bloom_filter      bundle=maxiport1   offset=slave 
+  #pragma HLS INTERFACE m_axi         port=segment_sizes     bundle=maxiport1   offset=slave 
+  #pragma HLS INTERFACE m_axi         port=profile_weights   bundle=maxiport2   offset=slave 
+
+    static bloom_word_t bloom_filter_local[bloom_banks][bloom_copies][bloom_local_size];
+  #pragma HLS ARRAY_PARTITION variable=bloom_filter_local complete dim=2
+
+    // The host keeps the size within bloom_filter_size words
+    unsigned int bloom_mask  = (1u << bloom_size_log2) - 1;
+    unsigned int bloom_words = 1u << (bloom_size_log2 - 5);
+    filter_bank &= bloom_banks - 1;
+
+    if(load_filter==true) 
+    {
+      load_bloom_filter(bloom_filter_local[filter_bank], bloom_filter, bloom_words);
+    }
+
+    compute_doc_scores_dataflow(
+      output_scores,
+      input_words,
+      segment_sizes,
+      profile_weights,
+      bloom_filter_local[filter_bank],
+      total_size,
+      num_segments,
+      min_score,
+      bloom_mask,
+      num_hashes,
+      seed_pu,
+      seed_lu);
+  }
+#else
   void runOnfpga (
           ap_uint<512>*  output_flags,
           ap_uint<512>*  input_words,
           unsigned int*  bloom_filter,
           unsigned int   total_size,
-          bool           load_filter)
+          bool           load_filter,
+          unsigned int   bloom_size_log2,
+          unsigned int   num_hashes,
+          unsigned int   seed_pu,
+          unsigned int   seed_lu,
+          unsigned int   filter_bank)
   {
   #pragma HLS INTERFACE ap_ctrl_chain port=return            bundle=control
   #pragma HLS INTERFACE s_axilite     port=return            bundle=control
@@ -113,29 +453,46 @@ extern "C"
   #pragma HLS INTERFACE s_axilite     port=bloom_filter      bundle=control
   #pragma HLS INTERFACE s_axilite     port=total_size        bundle=control
   #pragma HLS INTERFACE s_axilite     port=load_filter       bundle=control
+  #pragma HLS INTERFACE s_axilite     port=bloom_size_log2   bundle=control
+  #pragma HLS INTERFACE s_axilite     port=num_hashes        bundle=control
+  #pragma HLS INTERFACE s_axilite     port=seed_pu           bundle=control
+  #pragma HLS INTERFACE s_axilite     port=seed_lu           bundle=control
+  #pragma HLS INTERFACE s_axilite     port=filter_bank       bundle=control
 
   #pragma HLS INTERFACE m_axi         port=output_flags      bundle=maxiport0   offset=slave 
   #pragma HLS INTERFACE m_axi         port=input_words       bundle=maxiport0   offset=slave 
   #pragma HLS INTERFACE m_axi         port=bloom_filter      bundle=maxiport1   offset=slave 
 
-    static unsigned int bloom_filter_local[PARALLELISATION][bloom_filter_size];
+    static bloom_word_t bloom_filter_local[bloom_banks][bloom_copies][bloom_local_size];
+  #pragma HLS ARRAY_PARTITION variable=bloom_filter_local complete dim=2
+#ifdef BLOOM_PROFILES
   #pragma HLS ARRAY_PARTITION variable=bloom_filter_local complete dim=1
+#endif
+
+    // The host keeps the size within bloom_filter_size words
+    unsigned int bloom_mask  = (1u << bloom_size_log2) - 1;
+    unsigned int bloom_words = 1u << (bloom_size_log2 - 5);
+    filter_bank &= bloom_banks - 1;
 
     if(load_filter==true) 
     {
-      read_bloom_filter: for(int index=0; index<bloom_filter_size; index++) {
-  #pragma HLS PIPELINE II=1
-        unsigned int tmp = bloom_filter[index];
-        for (int j=0; j<PARALLELISATION; j++) {
-          bloom_filter_local[j][index] = tmp;
-        }
-      }
+      load_bloom_filter(bloom_filter_local[filter_bank], bloom_filter, bloom_words);
     }
 
+    // Every bank with BLOOM_PROFILES, otherwise the bank of filter_bank
     compute_hash_flags_dataflow(
       output_flags,
       input_words,
+#ifdef BLOOM_PROFILES
       bloom_filter_local,
-      total_size);
+#else
+      &bloom_filter_local[filter_bank],
+#endif
+      total_size,
+      bloom_mask,
+      num_hashes,
+      seed_pu,
+      seed_lu);
   }
+#endif
 }
@@ -0,0 +1,169 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <ap_int.h>
+
+#include "sizes.h"
+#include "common.h"
+#include "doc_segments.h"
+#include "chunk_plan.h"
+#include "top_k.h"
+
+// C simulation testbench of runOnfpga built with -DDOC_SCORES. A small
+// random corpus, not padded, is scored in a few invocations, with
+// documents that straddle them and a tail scored on the CPU, and the
+// per-document scores are checked against runOnCPU. With a min_score,
+// the documents scored below it may be dropped by the kernel, and the
+// top documents are checked instead.
+//
+// Vitis HLS: compute_score_fpga.cpp is the design, this file,
+// compute_score_host.cpp and MurmurHash2.c are the testbench, all with
+// -DDOC_SCORES in their cflags; then run csim_design. Or directly:
+//
+//   g++ -std=c++11 -DDOC_SCORES -I$XILINX_HLS/include -I. -o csim compute_score_fpga_tb.cpp compute_score_fpga.cpp compute_score_host.cpp MurmurHash2.c
+//   ./csim [num_docs] [num_chunks] [min_score]
+
+using namespace std;
+
+extern "C" void runOnfpga (
+        ap_uint<64>*   output_scores,
+        ap_uint<512>*  input_words,
+        unsigned int*  bloom_filter,
+        unsigned int   total_size,
+        bool           load_filter,
+        unsigned int   bloom_size_log2,
+        unsigned int   num_hashes,
+        unsigned int   seed_pu,
+        unsigned int   seed_lu,
+        unsigned int*  segment_sizes,
+        unsigned int   num_segments,
+        ap_uint<64>*   profile_weights,
+        unsigned long  min_score,
+        unsigned int   filter_bank);
+
+int main(int argc, char** argv)
+{
+    unsigned int total_num_docs = (argc > 1) ? atoi(argv[1]) : 200;
+    unsigned int num_chunks     = (argc > 2) ? atoi(argv[2]) : 4;
+    unsigned long min_score     = (argc > 3) ? atol(argv[3]) : 0;
+    BloomConfig  bloom;
+
+    // Documents as in setupData, shorter to keep the simulation quick
+    vector<unsigned int> doc_sizes(total_num_docs);
+    unsigned int unpadded_size = 0;
+    for (unsigned int doc = 0; doc < total_num_docs; doc++) {
+        doc_sizes[doc] = 50 + rand()%400;
+        unpadded_size += doc_sizes[doc];
+    }
+    unsigned int total_size = unpadded_size;
+
+    vector<unsigned int> input_doc_words(total_size);
+    for (unsigned int n = 0; n < total_size; n++) {
+        unsigned term = (rand()%((1L << 24)-1));
+        unsigned freq = (rand()%254)+1;
+        input_doc_words[n] = (term << 8) | freq;
+    }
+
+    // Profile with random entries plus one word in 20 of the corpus, so
+    // that plenty of words are flagged, with varied weights
+    vector<unsigned long> profile_weights(1 << 24, 0);
+    vector<unsigned int>  bloom_filter(bloom.numWords(), 0);
+    for (unsigned int i = 0; i < 16384 + total_size/20; i++) {
+        unsigned entry = (i < 16384) ? rand()%(1<<24) : input_doc_words[rand()%total_size] >> 8;
+        profile_weights[entry] = 1 + rand()%100;
+        bloom.insert(bloom_filter.data(), entry);
+    }
+
+    // Kernel view of the data
+    vector<ap_uint<512> > kernel_words((total_size+15)/16);
+    for (unsigned int n = 0; n < total_size; n++) {
+        kernel_words[n/16]((n%16)*32+31, (n%16)*32) = input_doc_words[n];
+    }
+    vector<ap_uint<64> > kernel_weights(1 << 24);
+    for (unsigned int i = 0; i < (1 << 24); i++) {
+        kernel_weights[i] = profile_weights[i];
+    }
+
+    // Load the bloom filter, then score chunk by chunk
+    ap_uint<64> no_scores[1];
+    runOnfpga(no_scores, NULL, bloom_filter.data(), 0, true, bloom.size_log2, bloom.num_hashes,
+              bloom.seed_pu, bloom.seed_lu, NULL, 0, kernel_weights.data(), 0, 0);
+
+    TransferPlan plan = planTransfers(total_size, num_chunks);
+    vector<unsigned int> chunk_sizes = plan.size;
+    if (plan.tail_words) chunk_sizes.push_back(plan.tail_words);
+
+    vector<ChunkSegments> segments = segmentDocs(doc_sizes.data(), total_num_docs, chunk_sizes);
+    vector<unsigned long> fpga_score(total_num_docs, 0);
+    unsigned int num_scores = 0;
+
+    for (unsigned int c = 0; c < plan.count(); c++)
+    {
+        // A score per segment, or (segment, score) pairs with a min_score
+        unsigned int num_segments = segments[c].sizes.size();
+        vector<ap_uint<64> > scores(1 + (min_score ? 2 : 1)*num_segments);
+        runOnfpga(scores.data(), &kernel_words[plan.offset[c]/16], bloom_filter.data(), plan.size[c], false,
+                  bloom.size_log2, bloom.num_hashes, bloom.seed_pu, bloom.seed_lu,
+                  segments[c].sizes.data(), num_segments, kernel_weights.data(), min_score, 0);
+
+        unsigned int kept = scores[0];
+        if (!min_score && kept != num_segments) {
+            printf(" Invocation %u: %u scores for %u segments\n", c, kept, num_segments);
+            return 1;
+        }
+        for (unsigned int k = 0; k < kept; k++) {
+            unsigned int  seg   = min_score ? (unsigned int)scores[1 + 2*k] : k;
+            unsigned long score = min_score ? (unsigned long)scores[2 + 2*k] : (unsigned long)scores[1 + k];
+            unsigned int doc = segments[c].docs[seg];
+            if (doc < total_num_docs) fpga_score[doc] += score;
+        }
+        num_scores += kept;
+    }
+
+    // The tail, fewer than 64 words, is scored on the CPU
+    for (unsigned int c = plan.count(), n = plan.fpga_words; c < segments.size(); c++) {
+        for (unsigned int k = 0; k < segments[c].sizes.size(); k++) {
+            unsigned int doc = segments[c].docs[k];
+            if (doc < total_num_docs) {
+                fpga_score[doc] += scoreSegment(input_doc_words.data(), bloom_filter.data(), profile_weights.data(),
+                                                n, segments[c].sizes[k], bloom);
+            }
+            n += segments[c].sizes[k];
+        }
+    }
+
+    vector<unsigned long> cpu_score(total_num_docs);
+    runOnCPU(doc_sizes.data(), input_doc_words.data(), bloom_filter.data(), profile_weights.data(),
+             cpu_score.data(), total_num_docs, total_size, bloom);
+
+    printf(" %u documents, %u words in %u invocations (%u words on the CPU), %u scores read back\n",
+           total_num_docs, total_size, plan.count(), plan.tail_words, num_scores);
+
+    // A document is dropped only if it is scored below min_score
+    unsigned int mismatches = 0;
+    TopK cpu_top(10), fpga_top(10);
+    for (unsigned int doc = 0; doc < total_num_docs; doc++) {
+        if (cpu_score[doc] >= min_score) cpu_top.push(doc, cpu_score[doc]);
+        if (fpga_score[doc] >= min_score) fpga_top.push(doc, fpga_score[doc]);
+        bool dropped = (fpga_score[doc] == 0 && cpu_score[doc] < min_score);
+        if (cpu_score[doc] != fpga_score[doc] && !dropped) {
+            if (mismatches++ < 10) {
+                printf(" doc[%u] score: CPU = %lu, FPGA = %lu\n", doc, cpu_score[doc], fpga_score[doc]);
+            }
+        }
+    }
+    vector<DocScore> cpu_best = cpu_top.sorted(), fpga_best = fpga_top.sorted();
+    for (unsigned int i = 0; i < cpu_best.size(); i++) {
+        if (fpga_best.size() != cpu_best.size() || fpga_best[i].doc != cpu_best[i].doc) {
+            printf(" Top documents differ at rank %u\n", i);
+            mismatches++;
+            break;
+        }
+    }
+    if (mismatches) {
+        printf(" Verification: FAILED (%u documents)\n", mismatches);
+        return 1;
+    }
+    printf(" Verification: PASS\n");
+    return 0;
+}
@@ -12,42 +12,31 @@
 using namespace std;
 using namespace std::chrono;
 
-void runOnCPU (
+// In-hash flag of every word, with the Hash policy of the bloom filter
+template <class Hash>
+static void computeFlags (
     unsigned int*  doc_sizes,
     unsigned int*  input_doc_words,
     unsigned int*  bloom_filter,
-    unsigned long* profile_weights,
-    unsigned long* profile_score,
+    unsigned char* inh_flags,
     unsigned int   total_num_docs,
-    unsigned int   total_size) 
+    const BloomConfig& bloom)
 {
-
     unsigned int size_offset=0;
 
-    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
-
-    unsigned char* inh_flags = (unsigned char*)aligned_alloc(4096, total_size*sizeof(char));
-
-
     for(unsigned int doc=0;doc<total_num_docs;doc++) 
     {
-        profile_score[doc] = 0.0;
         unsigned int size = doc_sizes[doc];
 
         for (unsigned i = 0; i < size ; i++)
         { 
             unsigned curr_entry = input_doc_words[size_offset+i];
             unsigned word_id = curr_entry >> 8;
-            unsigned hash_pu =  MurmurHash2( &word_id , 3,1);
-            unsigned hash_lu =  MurmurHash2( &word_id , 3,5);
             bool doc_end = (word_id==docTag);
-            unsigned hash1 = hash_pu&hash_bloom;
-            bool inh1 = (!doc_end) && (bloom_filter[ hash1 >> 5 ] & ( 1 << (hash1 & 0x1f)));
-            unsigned hash2 = (hash_pu+hash_lu)&hash_bloom;
-            bool inh2 = (!doc_end) && (bloom_filter[ hash2 >> 5 ] & ( 1 << (hash2 & 0x1f)));
+            bool inh = (!doc_end) && bloom.containsWith<Hash>(bloom_filter, word_id);
             
            
-            if (inh1 && inh2) {
+            if (inh) {
                 inh_flags[size_offset+i]=1;
             } else {
                 inh_flags[size_offset+i]=0;
@@ -56,7 +45,28 @@ void runOnCPU (
       
         size_offset+=size;
     }
+}
 
+void runOnCPU (
+    unsigned int*  doc_sizes,
+    unsigned int*  input_doc_words,
+    unsigned int*  bloom_filter,
+    unsigned long* profile_weights,
+    unsigned long* profile_score,
+    unsigned int   total_num_docs,
+    unsigned int   total_size,
+    const BloomConfig& bloom) 
+{
+
+    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+
+    unsigned char* inh_flags = (unsigned char*)aligned_alloc(4096, total_size*sizeof(char));
+
+    switch (bloom.hash) {
+      case HashXXH32:         computeFlags<XXHash32>(doc_sizes, input_doc_words, bloom_filter, inh_flags, total_num_docs, bloom); break;
+      case HashMultiplyShift: computeFlags<MultiplyShiftHash>(doc_sizes, input_doc_words, bloom_filter, inh_flags, total_num_docs, bloom); break;
+      default:                computeFlags<Murmur2Hash>(doc_sizes, input_doc_words, bloom_filter, inh_flags, total_num_docs, bloom); break;
+    }
 
      for(unsigned int doc=0, n=0; doc<total_num_docs;doc++) 
     {
@@ -0,0 +1,161 @@
+#pragma once
+
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<vector>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+
+#include"sizes.h"
+
+// Binary corpus file used by the streaming mode:
+//
+//   CorpusHeader
+//   for every document: doc_size (32 bits), then doc_size words (32 bits)
+//
+// CorpusWriter appends one document at a time and CorpusReader hands out
+// chunks of whole documents, so neither holds more than a chunk in memory.
+
+struct CorpusHeader {
+    char          magic[8];
+    unsigned int  num_docs;
+    unsigned int  reserved;
+    unsigned long num_words;
+};
+
+static const char corpus_magic[8] = "M2CORPS";
+
+class CorpusWriter
+{
+    FILE*        m_file;
+    CorpusHeader m_header;
+
+public:
+    CorpusWriter(const char* path)
+    {
+        m_file = fopen(path, "wb");
+        if (!m_file) {
+            printf("ERROR: Could not create corpus file %s\n", path);
+            exit(-1);
+        }
+        memset(&m_header, 0, sizeof(m_header));
+        memcpy(m_header.magic, corpus_magic, sizeof(corpus_magic));
+        fwrite(&m_header, sizeof(m_header), 1, m_file);
+    }
+
+    void addDoc(const unsigned int* words, unsigned int size)
+    {
+        fwrite(&size, sizeof(size), 1, m_file);
+        fwrite(words, sizeof(unsigned int), size, m_file);
+        m_header.num_docs++;
+        m_header.num_words += size;
+    }
+
+    // The header is written last, once the counts are known
+    ~CorpusWriter()
+    {
+        fseek(m_file, 0, SEEK_SET);
+        fwrite(&m_header, sizeof(m_header), 1, m_file);
+        fclose(m_file);
+    }
+};
+
+// Whole documents copied into a caller provided word buffer and padded
+// with docTag to a multiple of 64 words, as the kernel expects
+struct CorpusChunk {
+    unsigned int*             words;
+    unsigned int              num_words;
+    unsigned long             first_doc;
+    std::vector<unsigned int> doc_sizes;
+};
+
+// Reads the corpus through a read-only mapping. The pages of consumed
+// documents are dropped as the reader moves on, so the resident part of
+// the file stays around one chunk whatever the corpus size.
+class CorpusReader
+{
+    unsigned char* m_data;
+    size_t         m_size;
+    size_t         m_offset;
+    size_t         m_released;
+    unsigned long  m_docs_read;
+    CorpusHeader   m_header;
+
+public:
+    CorpusReader(const char* path) : m_offset(sizeof(CorpusHeader)), m_released(0), m_docs_read(0)
+    {
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CorpusHeader)) {
+            printf("ERROR: Could not read corpus file %s\n", path);
+            exit(-1);
+        }
+        m_size = st.st_size;
+        m_data = (unsigned char*)mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (m_data == MAP_FAILED) {
+            printf("ERROR: Could not map corpus file %s\n", path);
+            exit(-1);
+        }
+        madvise(m_data, m_size, MADV_SEQUENTIAL);
+
+        memcpy(&m_header, m_data, sizeof(m_header));
+        if (memcmp(m_header.magic, corpus_magic, sizeof(corpus_magic)) != 0) {
+            printf("ERROR: %s is not a corpus file\n", path);
+            exit(-1);
+        }
+    }
+
+    ~CorpusReader()
+    {
+        munmap(m_data, m_size);
+    }
+
+    unsigned int  numDocs()  { return m_header.num_docs; }
+    unsigned long numWords() { return m_header.num_words; }
+
+    // Fills chunk with the next documents that fit in capacity words
+    // (a multiple of 64). Returns false once the corpus is exhausted.
+    bool next(CorpusChunk& chunk, unsigned int capacity)
+    {
+        chunk.num_words = 0;
+        chunk.first_doc = m_docs_read;
+        chunk.doc_sizes.clear();
+
+        while (m_docs_read < m_header.num_docs)
+        {
+            unsigned int size;
+            memcpy(&size, m_data + m_offset, sizeof(size));
+            if (m_offset + sizeof(size) + (size_t)size*sizeof(unsigned int) > m_size) {
+                printf("ERROR: Corpus file truncated at document %lu\n", m_docs_read);
+                exit(-1);
+            }
+            if (chunk.num_words + size > capacity) {
+                if (chunk.num_words == 0) {
+                    printf("ERROR: Document %lu (%u words) is larger than a chunk\n", m_docs_read, size);
+                    exit(-1);
+                }
+                break;
+            }
+            memcpy(&chunk.words[chunk.num_words], m_data + m_offset + sizeof(size), size*sizeof(unsigned int));
+            chunk.num_words += size;
+            chunk.doc_sizes.push_back(size);
+            m_offset += sizeof(size) + size*sizeof(unsigned int);
+            m_docs_read++;
+        }
+        while (chunk.num_words % 64) {
+            chunk.words[chunk.num_words++] = docTag;
+        }
+
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t done = m_offset & ~(page - 1);
+        if (done > m_released) {
+            madvise(m_data + m_released, done - m_released, MADV_DONTNEED);
+            m_released = done;
+        }
+        return !chunk.doc_sizes.empty();
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include<vector>
+
+#include"sizes.h"
+#include"bloom_config.h"
+
+// Segments of the words handed to the scoring kernel (runOnfpga built
+// with -DDOC_SCORES). The words are cut into consecutive chunks of the
+// given sizes, one per invocation (see chunk_plan.h). A segment is the
+// part of a document that is in a chunk: a document that straddles a
+// chunk boundary has a segment in each chunk and its score is the sum of
+// their scores. Words after the last document, if any, are one more
+// segment, with doc == total_num_docs. Empty documents have no segment;
+// their score is 0.
+
+struct ChunkSegments {
+    std::vector<unsigned int> sizes;
+    std::vector<unsigned int> docs;
+};
+
+inline std::vector<ChunkSegments> segmentDocs(
+    const unsigned int* doc_sizes,
+    unsigned int        total_num_docs,
+    const std::vector<unsigned int>& chunk_sizes)
+{
+    std::vector<ChunkSegments> chunks(chunk_sizes.size());
+    unsigned int doc  = 0;
+    unsigned int left = 0;
+
+    for (unsigned int c = 0; c < chunk_sizes.size(); c++)
+    {
+        unsigned int room = chunk_sizes[c];
+        while (room > 0)
+        {
+            while (left == 0 && doc < total_num_docs) {
+                left = doc_sizes[doc++];
+            }
+
+            // Past the last document, the rest of the chunk is padding
+            unsigned int owner = (left > 0) ? doc - 1 : total_num_docs;
+            unsigned int size  = (left > 0 && left < room) ? left : room;
+
+            chunks[c].sizes.push_back(size);
+            chunks[c].docs.push_back(owner);
+            if (left > 0) left -= size;
+            room -= size;
+        }
+    }
+    return chunks;
+}
+
+// Score of the segment of size words at begin, computed on the CPU. Used
+// for the words after the last full chunk, which the kernel does not take.
+inline unsigned long scoreSegment(
+    const unsigned int*  input_doc_words,
+    const unsigned int*  bloom_filter,
+    const unsigned long* profile_weights,
+    unsigned int         begin,
+    unsigned int         size,
+    const BloomConfig&   bloom)
+{
+    unsigned long score = 0;
+    for (unsigned int n = begin; n < begin + size; n++) {
+        unsigned int curr_entry = input_doc_words[n];
+        unsigned int word_id    = curr_entry >> 8;
+        unsigned int frequency  = curr_entry & 0x00ff;
+        if (word_id != docTag && bloom.contains(bloom_filter, word_id)) {
+            score += profile_weights[word_id] * (unsigned long)frequency;
+        }
+    }
+    return score;
+}
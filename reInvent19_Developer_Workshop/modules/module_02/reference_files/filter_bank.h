@@ -0,0 +1,52 @@
+#pragma once
+
+#include"bloom_config.h"
+
+// Versions of the bloom filter held in the two banks of runOnfpga (see
+// filter_bank in compute_score_fpga.cpp).
+//
+// stage() gives a new filter a version and the idle bank; the host loads
+// it there (load_filter with that filter_bank) while the chunks already
+// enqueued keep being scored against the active bank. activate() makes
+// it the bank of the next chunks. The load must only wait for the chunks
+// scored against the previous filter of the idle bank, two versions ago.
+//
+// Every chunk records the version it was scored with (active() when it
+// is enqueued), so its results are matched with the right profile.
+
+struct FilterVersion {
+    unsigned int version;
+    unsigned int bank;
+    BloomConfig  config;
+};
+
+class FilterBanks
+{
+    FilterVersion m_banks[2];
+    unsigned int  m_active;
+    unsigned int  m_num_versions;
+
+public:
+    // No filter yet: the first one is staged in bank 0
+    FilterBanks() : m_active(1), m_num_versions(0)
+    {
+        for (unsigned int b = 0; b < 2; b++) {
+            m_banks[b].version = 0;
+            m_banks[b].bank    = b;
+        }
+    }
+
+    const FilterVersion& stage(const BloomConfig& config)
+    {
+        FilterVersion& idle = m_banks[m_active ^ 1];
+        idle.version = m_num_versions++;
+        idle.config  = config;
+        return idle;
+    }
+
+    void activate() { m_active ^= 1; }
+
+    const FilterVersion& active() const { return m_banks[m_active]; }
+
+    unsigned int numVersions() const { return m_num_versions; }
+};
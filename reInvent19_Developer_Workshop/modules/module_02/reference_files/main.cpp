@@ -3,14 +3,18 @@
 #include<ctime>
 #include<cstdio>
 #include<cstdlib>
+#include<cstring>
 #include<cmath>
 #include<iostream>
 #include<vector>
 #include<utility>
-#include<random>
+#include<thread>
 #include"xcl2.hpp"
 #include"sizes.h"
 #include"common.h"
+#include"corpus_file.h"
+#include"chunk_plan.h"
+#include"corpus_gen.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -24,103 +28,176 @@ vector<unsigned long,aligned_allocator<unsigned long>> fpga_profileScore;
 vector<unsigned int,aligned_allocator<unsigned int>> doc_sizes;
 vector<unsigned long,aligned_allocator<unsigned long>> cpu_profileScore;
 
-default_random_engine generator;
-normal_distribution<double> distribution(3500,500);
+// The words, in input_doc_words or mapped from the corpus cache
+unsigned int* corpus_words;
+CorpusCache   corpus_cache;
 
 unsigned int total_num_docs;
 unsigned size=0;
-unsigned block_size;
+unsigned int profile_entries = 16384;
+unsigned int top_k = 0;
+unsigned long min_score = 0;
+unsigned long corpus_seed = corpus_seed_default;
+unsigned int gen_threads = thread::hardware_concurrency();
 
-unsigned doc_len()
-{
-    unsigned int len = distribution(generator);
-    if (len < 100) { len = 100; }
-//    if(len > 4000) { len = 3500;}
-    return len;
-}
 
+void setupProfile(const BloomConfig& bloom, const vector<unsigned int>& entries, const unsigned int* cached_filter);
 
-void setupData()
+// Documents, profile weights and bloom filter. With a cache path, a cache
+// made for the same seed, documents and profile is mapped instead of
+// generating the data; otherwise the data is generated and saved there.
+void setupData(const BloomConfig& bloom, const char* cache_path)
 {
-    starting_doc_id.reserve( total_num_docs );
     fpga_profileScore.reserve( total_num_docs );
     cpu_profileScore.reserve(total_num_docs);
+    doc_sizes.reserve( total_num_docs );
+    starting_doc_id.reserve( total_num_docs );
 
-    //  h_docInfo.reserve( total_num_docs );
+    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+    vector<unsigned int> entries;
+    const unsigned int* cached_filter = NULL;
 
-    doc_sizes.reserve( total_num_docs );
-    unsigned unpadded_size=0;
+    if (cache_path && corpus_cache.open(cache_path, corpus_seed, total_num_docs, profile_entries)) {
+        memcpy(doc_sizes.data(), corpus_cache.docSizes(), total_num_docs*sizeof(unsigned int));
+        entries.assign(corpus_cache.entries(), corpus_cache.entries() + profile_entries);
+        cached_filter = corpus_cache.bloomFilter(bloom);
+        corpus_words  = (unsigned int*)corpus_cache.words();
+        size = corpus_cache.numWords();
+        printf("Mapping documents from %s - total size : %.3f MBytes (%d words)\n", cache_path, size*sizeof(int)/1000000.0, size);
+    } else {
+        // No padding: the runners flag the words past the last full transfer
+        // on the CPU (see chunk_plan.h)
+        size = genDocSizes(corpus_seed, total_num_docs, doc_sizes.data(), starting_doc_id.data(), gen_threads);
+        input_doc_words.reserve( size );
+        corpus_words = input_doc_words.data();
 
-    for (unsigned i=0; i<total_num_docs; i++) {
-        unsigned len_doc = doc_len();
-        starting_doc_id[i] = unpadded_size;
-        unpadded_size+=len_doc;
-        doc_sizes[i] = len_doc;
+        printf("Creating documents - total size : %.3f MBytes (%d words)\n", size*sizeof(int)/1000000.0, size);
+        genCorpus(corpus_seed, total_num_docs, doc_sizes.data(), starting_doc_id.data(), corpus_words, gen_threads);
+        entries = genProfile(corpus_seed, profile_entries);
     }
-    
-    size = unpadded_size&(~(block_size-1));
-    if(unpadded_size & (block_size-1)) size+=block_size;
-    bloom_filter.reserve( (1L << bloom_size) );
-    input_doc_words.reserve( size );
 
-    // double mbytes = size*sizeof(int)/(1000000.0);
+    setupProfile(bloom, entries, cached_filter);
 
-    printf("Creating documents - total size : %.3f MBytes (%d words)\n", size*sizeof(int)/1000000.0, size);
-    // std::cout << "Creating documents of total size = "<< size  << " words" << endl;
+    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+    printf("Data set up in %.1f ms (%u threads)\n", 1000*chrono::duration<double>(t2-t1).count(), gen_threads);
 
-    for (unsigned i=0; i<size; i++) {
-        input_doc_words[i] = docTag;
-    }
-    for (unsigned doci=0; doci < total_num_docs; doci++)
-    {
-        unsigned start_dimm1 = starting_doc_id[doci];
-        unsigned size_1 = doc_sizes[doci];
-        unsigned term;
-        unsigned freq;
-
-        for (unsigned i = 0; i < size_1; i++)
-        {
-            term = (rand()%((1L << 24)-1));
-            freq = (rand()%254)+1;
-            input_doc_words[start_dimm1 + i] = (term << 8) | freq;
-        }
+    if (cache_path && corpus_words == input_doc_words.data()) {
+        writeCorpusCache(cache_path, corpus_seed, total_num_docs, doc_sizes.data(), size, corpus_words,
+                         entries, bloom_filter.data(), bloom);
+        printf("Saved documents, profile and bloom filter to %s\n", cache_path);
     }
+    std::cout << endl;
+}
 
+// Profile weights and the bloom filter built from them, or copied from
+// the cache when it was built with the same configuration
+void setupProfile(const BloomConfig& bloom, const vector<unsigned int>& entries, const unsigned int* cached_filter)
+{
+    bloom_filter.reserve( bloom.numWords() );
     profile_weights.reserve( (1L << 24) );
-    for (unsigned i=0; i<(1L << bloom_size); i++) {
+    for (unsigned i=0; i<bloom.numWords(); i++) {
         bloom_filter[i] = 0x0;
     }
     std::cout << "Creating profile weights" << endl;
-    std::cout << endl;
  
     for (unsigned i=0; i<(1L << 24); i++) {
         profile_weights[i] = 0;
     }
 
-    for (unsigned i=0; i<16384; i++) {
-        unsigned entry = (rand()%(1<<24));	
+    for (unsigned i=0; i<profile_entries; i++) {
+        unsigned entry = entries[i];
 
         profile_weights[entry] = 10;
-        unsigned hash_pu = MurmurHash2(&entry,3,1);
-        unsigned hash_lu = MurmurHash2(&entry,3,5);
+        if (!cached_filter) bloom.insert(bloom_filter.data(), entry);
+    }
+    if (cached_filter) {
+        memcpy(bloom_filter.data(), cached_filter, bloom.numWords()*sizeof(unsigned int));
+    }
+}
 
-        unsigned hash1 = hash_pu&hash_bloom; 
-        unsigned hash2 = (hash_pu+hash_lu)&hash_bloom;
+// Generates documents as setupData does, one at a time, into a corpus
+// file for the streaming mode
+void writeCorpus(const char* path)
+{
+    CorpusWriter writer(path);
+    vector<unsigned int> words;
+    unsigned long total_words = 0;
 
-        bloom_filter[ hash1 >> 5 ] |= 1 << (hash1 & 0x1f);
-        bloom_filter[ hash2 >> 5 ] |= 1 << (hash2 & 0x1f);
+    for (unsigned doci=0; doci < total_num_docs; doci++)
+    {
+        unsigned size_1 = genDocLen(corpus_seed, doci);
+        words.resize(size_1);
+        genDocWords(corpus_seed, doci, words.data(), size_1);
+        writer.addDoc(words.data(), size_1);
+        total_words += size_1;
     }
-
+    printf("Wrote %u documents - total size : %.3f MBytes (%lu words) to %s\n",
+           total_num_docs, total_words*sizeof(int)/1000000.0, total_words, path);
 }
 
 int main(int argc, char** argv)
 {
-    int num_iter;
+    int num_iter = 0;
+    unsigned long transfer_bytes = default_transfer_bytes;
+    double target_fpr = 0;
+    const char* write_corpus = NULL;
+    const char* corpus = NULL;
+    const char* scores = NULL;
+    unsigned int chunk_words = 1024*1024;
+    unsigned int num_slots = 4;
+    const char* cache_path = NULL;
+
+    // Options start with "--", the remaining arguments are positional
+    int num_args = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--fpr") && i+1 < argc) {
+            target_fpr = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--write-corpus") && i+1 < argc) {
+            write_corpus = argv[++i];
+        } else if (!strcmp(argv[i], "--corpus") && i+1 < argc) {
+            corpus = argv[++i];
+        } else if (!strcmp(argv[i], "--chunk") && i+1 < argc) {
+            chunk_words = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--slots") && i+1 < argc) {
+            num_slots = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--transfer") && i+1 < argc) {
+            transfer_bytes = atof(argv[++i])*1024*1024;
+        } else if (!strcmp(argv[i], "--topk") && i+1 < argc) {
+            top_k = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--min-score") && i+1 < argc) {
+            min_score = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--scores") && i+1 < argc) {
+            scores = argv[++i];
+        } else if (!strcmp(argv[i], "--seed") && i+1 < argc) {
+            corpus_seed = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--gen-threads") && i+1 < argc) {
+            gen_threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--cache") && i+1 < argc) {
+            cache_path = argv[++i];
+        } else {
+            argv[num_args++] = argv[i];
+        }
+    }
+    argc = num_args;
+
+    // Streaming mode: only the profile is held in memory, the corpus is
+    // read from the file chunk by chunk
+    if (corpus) {
+        BloomConfig bloom_config = (target_fpr > 0)
+            ? BloomConfig::fromTarget(target_fpr, profile_entries)
+            : BloomConfig();
+        bloom_config.print(profile_entries);
+        setupProfile(bloom_config, genProfile(corpus_seed, profile_entries), NULL);
+        cout << endl;
+        runOnFPGAStream(corpus, bloom_filter.data(), profile_weights.data(), bloom_config,
+                        chunk_words, num_slots, scores);
+        cout << endl;
+        return 0;
+    }
 
     switch(argc) {
       case 2: 
          total_num_docs=atoi(argv[1]);
-         num_iter = 2;
          break;
       case 3:
          total_num_docs=atoi(argv[1]);
@@ -131,34 +208,55 @@ int main(int argc, char** argv)
          return 0;
     } 
 
+    if (write_corpus) {
+        writeCorpus(write_corpus);
+        return 0;
+    }
+
+    // Without a target false-positive rate the original filter is used.
+    // The layout and the hash are the ones the kernel was built for
+    // (BLOOM_BLOCKED, BLOOM_HASH_XXH32 or BLOOM_HASH_MULTIPLY_SHIFT).
+    BloomConfig bloom_config = (target_fpr > 0)
+        ? BloomConfig::fromTarget(target_fpr, profile_entries)
+        : BloomConfig();
+    bloom_config.print(profile_entries);
+
     std::cout << "Initializing data"<< endl;
-    block_size = num_iter*64;
-    setupData();
+    setupData(bloom_config, cache_path);
+
+    // Without a number of iterations, transfers of about transfer_bytes
+    if (num_iter <= 0) {
+        num_iter = numTransfers(size, transfer_bytes);
+    }
 
     runOnFPGA(
         doc_sizes.data(),
-        input_doc_words.data(),
+        corpus_words,
         bloom_filter.data(),
         profile_weights.data(),
         fpga_profileScore.data(),
         total_num_docs,
         size,
-        num_iter) ;
+        num_iter,
+        bloom_config) ;
   
      runOnCPU(
         doc_sizes.data(),
-        input_doc_words.data(),
+        corpus_words,
         bloom_filter.data(),
         profile_weights.data(),
         cpu_profileScore.data(),
         total_num_docs,
-        size) ;
+        size,
+        bloom_config) ;
   
     printf("--------------------------------------------------------------------\n");
     
+    // Documents scored below min_score may have been dropped on the FPGA
     for (unsigned doci = 0; doci < total_num_docs; doci++)
     {
-        if (cpu_profileScore[doci] != fpga_profileScore[doci]) {
+        bool dropped = (fpga_profileScore[doci] == 0 && cpu_profileScore[doci] < min_score);
+        if (cpu_profileScore[doci] != fpga_profileScore[doci] && !dropped) {
             std::cout << " Verification: FAILED "<< endl  << " : doc[" << doci << "]" << " score: CPU = " << cpu_profileScore[doci]<< ", FPGA = "<< fpga_profileScore[doci] <<  endl;
             return 0;
         }
@@ -0,0 +1,149 @@
+#pragma once
+
+#include<vector>
+
+#include"sizes.h"
+#include"bloom_config.h"
+#include"weight_store.h"
+
+// Several profiles scored in one pass over the corpus.
+//
+// All profiles of a batch share one BloomConfig, so the probes of a word
+// are at the same bits for every profile and are hashed once. A word is
+// first tested against the combined filter, the OR of the filters of the
+// profiles, which is as small as one filter and stays in cache. The words
+// that pass are looked up in the bit-sliced filter: entry i holds bit i
+// of the filter of every profile, bit p for profile p, and the entries of
+// the probes ANDed together are the mask of the profiles that may contain
+// the word. Only the words with a non-empty mask are looked up in the
+// weight stores of those profiles. Scores are kept num_profiles per
+// document, score[doc*num_profiles + p].
+//
+// The combined filter fills up with the number of profiles: with the
+// default filter it passes about 15% of the words for 8 profiles and most
+// of them for 32.
+//
+// The filter of every profile, in the usual layout, is kept as well for
+// the FPGA banks (see BLOOM_PROFILES in compute_score_fpga.cpp) and for
+// scoring the profiles one at a time.
+
+const unsigned int max_batch_profiles = 32;
+
+// Generated profile entries with the weight setupData gives them
+inline WeightList entryWeights(const std::vector<unsigned int>& entries)
+{
+    WeightList list;
+    for (unsigned int i = 0; i < entries.size(); i++) {
+        list.push_back(std::make_pair(entries[i], 10ul));
+    }
+    return list;
+}
+
+class ProfileBatch
+{
+    BloomConfig                            m_bloom;
+    std::vector<std::vector<unsigned int>> m_filters;
+    std::vector<unsigned int>              m_combined;
+    std::vector<unsigned int>              m_slices;
+    std::vector<HashWeightStore>           m_stores;
+
+    template <class Hash>
+    unsigned int matchWith(unsigned int word_id) const
+    {
+        HashPair h = Hash::dual(word_id, m_bloom.seed_pu, m_bloom.seed_lu);
+        unsigned int mask = ~0u;
+        for (unsigned int i = 0; i < m_bloom.num_hashes; i++) {
+            mask &= m_slices[m_bloom.index(h.pu, h.lu, i)];
+        }
+        return mask;
+    }
+
+    template <class Hash>
+    void scoreDocsWith(const unsigned int* doc_sizes, const unsigned int* input_doc_words,
+                       unsigned int total_num_docs, unsigned long* score) const
+    {
+        unsigned int num_profiles = numProfiles();
+        for (unsigned int doc = 0, n = 0; doc < total_num_docs; doc++) {
+            unsigned long* doc_score = &score[(unsigned long)doc*num_profiles];
+            for (unsigned int p = 0; p < num_profiles; p++) doc_score[p] = 0;
+            for (unsigned int i = 0; i < doc_sizes[doc]; i++, n++) {
+                unsigned int word_id = input_doc_words[n] >> 8;
+                if (word_id == docTag || !m_bloom.containsWith<Hash>(m_combined.data(), word_id)) continue;
+                unsigned int mask = matchWith<Hash>(word_id);
+                if (mask) addMatches(input_doc_words[n], mask, doc_score);
+            }
+        }
+    }
+
+public:
+    // One profile per weight list; at most max_batch_profiles
+    ProfileBatch(const BloomConfig& bloom, const std::vector<WeightList>& profiles) :
+        m_bloom(bloom), m_filters(profiles.size()), m_combined(bloom.numWords(), 0), m_slices(1ul << bloom.size_log2, 0)
+    {
+        for (unsigned int p = 0; p < profiles.size() && p < max_batch_profiles; p++) {
+            m_filters[p].assign(bloom.numWords(), 0);
+            for (unsigned int i = 0; i < profiles[p].size(); i++) {
+                bloom.insert(m_filters[p].data(), profiles[p][i].first);
+            }
+            for (unsigned int i = 0; i < m_combined.size(); i++) {
+                m_combined[i] |= m_filters[p][i];
+            }
+            for (unsigned int bit = 0; bit < m_slices.size(); bit++) {
+                if (m_filters[p][bit >> 5] & (1u << (bit & 0x1f))) m_slices[bit] |= 1u << p;
+            }
+            m_stores.push_back(HashWeightStore(profiles[p]));
+        }
+        m_filters.resize(m_stores.size());
+    }
+
+    unsigned int           numProfiles()            const { return m_stores.size(); }
+    const BloomConfig&     config()                 const { return m_bloom; }
+    const unsigned int*    filter(unsigned int p)   const { return m_filters[p].data(); }
+    const unsigned int*    combinedFilter()         const { return m_combined.data(); }
+    const HashWeightStore& store(unsigned int p)    const { return m_stores[p]; }
+    size_t                 slicedBytes()            const { return m_slices.size() * sizeof(unsigned int); }
+
+    // Adds the weighted frequency of curr_entry to the profiles of mask
+    void addMatches(unsigned int curr_entry, unsigned int mask, unsigned long* score) const
+    {
+        unsigned int word_id = curr_entry >> 8;
+        unsigned long frequency = curr_entry & 0x00ff;
+        while (mask) {
+            unsigned int p = __builtin_ctz(mask);
+            score[p] += m_stores[p].weight(word_id) * frequency;
+            mask &= mask - 1;
+        }
+    }
+
+    // Mask of the profiles whose filter contains word_id
+    unsigned int match(unsigned int word_id) const
+    {
+        switch (m_bloom.hash) {
+          case HashXXH32:         return matchWith<XXHash32>(word_id);
+          case HashMultiplyShift: return matchWith<MultiplyShiftHash>(word_id);
+          default:                return matchWith<Murmur2Hash>(word_id);
+        }
+    }
+
+    // Scores of every document for every profile, in one pass
+    void scoreDocs(const unsigned int* doc_sizes, const unsigned int* input_doc_words,
+                   unsigned int total_num_docs, unsigned long* score) const
+    {
+        switch (m_bloom.hash) {
+          case HashXXH32:         scoreDocsWith<XXHash32>(doc_sizes, input_doc_words, total_num_docs, score); break;
+          case HashMultiplyShift: scoreDocsWith<MultiplyShiftHash>(doc_sizes, input_doc_words, total_num_docs, score); break;
+          default:                scoreDocsWith<Murmur2Hash>(doc_sizes, input_doc_words, total_num_docs, score); break;
+        }
+    }
+
+    // Adds the words [begin, end) to score, num_profiles values, with their
+    // masks already computed (by match or by the FPGA, a flag byte per
+    // word, so at most 8 profiles)
+    void scoreMasks(const unsigned int* input_doc_words, const unsigned char* masks,
+                    unsigned int begin, unsigned int end, unsigned long* score) const
+    {
+        for (unsigned int n = begin; n < end; n++) {
+            if (masks[n]) addMatches(input_doc_words[n], masks[n], score);
+        }
+    }
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+// In-hash flags packed one bit per word, as written by runOnfpga when it
+// is built with -DFLAGS_PACKED: word n of the input has its flag in bit
+// n%64 of 64-bit word n/64 (each 512-bit output word holds the flags of
+// 512 consecutive input words, lowest bit first). The readback is 1/32
+// of the input instead of 1/4 with a byte per word.
+//
+// The host scores a range of words by walking the set bits only, so the
+// words that are not in the profile are never loaded.
+
+const unsigned int packed_flags_block = 512;
+
+// Packs a byte-per-word flag array (num_words a multiple of 64)
+inline void packFlags(const unsigned char* inh_flags, unsigned long* packed_flags, unsigned int num_words)
+{
+    for (unsigned int w = 0; w < num_words/64; w++) {
+        unsigned long bits = 0;
+        for (unsigned int b = 0; b < 64; b++) {
+            bits |= (unsigned long)(inh_flags[w*64 + b] != 0) << b;
+        }
+        packed_flags[w] = bits;
+    }
+}
+
+// Number of words flagged in [0, num_words)
+inline unsigned long countPackedFlags(const unsigned long* packed_flags, unsigned int num_words)
+{
+    unsigned long count = 0;
+    for (unsigned int w = 0; w < num_words/64; w++) {
+        count += __builtin_popcountl(packed_flags[w]);
+    }
+    return count;
+}
+
+// Score of the words in [begin, end) whose flag is set
+inline unsigned long scorePackedFlags(
+    const unsigned long* packed_flags,
+    const unsigned int*  input_doc_words,
+    const unsigned long* profile_weights,
+    unsigned int         begin,
+    unsigned int         end)
+{
+    unsigned long ans = 0;
+    while (begin < end)
+    {
+        unsigned int  offset = begin % 64;
+        unsigned int  span   = (end - begin < 64 - offset) ? end - begin : 64 - offset;
+        unsigned long bits   = packed_flags[begin / 64] >> offset;
+        if (span < 64) bits &= (1ul << span) - 1;
+
+        while (bits)
+        {
+            unsigned curr_entry = input_doc_words[begin + __builtin_ctzl(bits)];
+            unsigned frequency = curr_entry & 0x00ff;
+            unsigned word_id = curr_entry >> 8;
+            ans += profile_weights[word_id] * (unsigned long)frequency;
+            bits &= bits - 1;
+        }
+        begin += span;
+    }
+    return ans;
+}
@@ -0,0 +1,287 @@
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+#include "xcl2.hpp"
+#include "sizes.h"
+#include "common.h"
+#include "doc_segments.h"
+#include "chunk_plan.h"
+#include "top_k.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// The documents are scored on the FPGA: the xclbin must be built from
+// compute_score_fpga.cpp with -DDOC_SCORES. Every sub-buffer goes with the
+// sizes of its segments (see doc_segments.h) and a score per segment
+// comes back, instead of a flag per word. The profile weights are copied
+// to the device once.
+//
+// With --min-score the kernel drops the documents scored below it, they
+// keep a score of 0, and the kept ones come back as (segment, score)
+// pairs: their number is read first, then only the pairs kept. With
+// --topk the best documents are selected as the chunks come back.
+
+string kernel_name = "runOnfpga";
+const char* kernel_name_charptr = kernel_name.c_str();
+unsigned int profile_size = 1L<<24;
+
+
+void runOnFPGA(
+	unsigned int*  doc_sizes,
+	unsigned int*  input_doc_words,
+	unsigned int*  bloom_filter,
+	unsigned long* profile_weights,
+	unsigned long* profile_score,
+	unsigned int   total_num_docs,
+	unsigned int   total_doc_size,
+	int            num_iter,
+	const BloomConfig& bloom)
+{
+	// Sub-buffers of a multiple of 64 words, the tail is scored on the CPU
+	TransferPlan plan = planTransfers(total_doc_size, num_iter);
+	if (plan.count() == 0) {
+		printf("--------------------------------------------------------------------\n");
+		printf("ERROR: At least 64 words are needed for FPGA processing\n");
+		printf("       Skipping FPGA kernel execution\n");
+		exit(-1);
+	}
+	num_iter = plan.count();
+
+	// Boilerplate code to load the FPGA binary, create the kernel and command queue
+	vector<cl::Device> devices = xcl::get_xil_devices();
+	cl::Device device = devices[0];
+	cl::Context context(device);
+	cl::CommandQueue q(context,device, CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE );
+
+	string run_type = xcl::is_emulation()?(xcl::is_hw_emulation()?"hw_emu":"sw_emu"):"hw";
+	string binary_file = kernel_name + "_" + run_type + ".awsxclbin";
+	cl::Program::Binaries bins = xcl::import_binary_file(binary_file);
+	cl::Program program(context, devices, bins);
+	cl::Kernel kernel(program,kernel_name_charptr,NULL);
+
+	unsigned int total_size = total_doc_size;
+	bool load_filter = true;
+
+	// Segments of every sub-buffer and of the tail, and room for their
+	// scores: a word per segment, two with a min_score
+	unsigned int score_words = min_score ? 2 : 1;
+	vector<unsigned int> chunk_sizes = plan.size;
+	if (plan.tail_words) chunk_sizes.push_back(plan.tail_words);
+	vector<ChunkSegments> segments = segmentDocs(doc_sizes, total_num_docs, chunk_sizes);
+	unsigned int*  segment_sizes[num_iter];
+	unsigned long* segment_scores[num_iter];
+	unsigned long  num_scores = 0;
+	for (int i=0; i<num_iter; i++) {
+		unsigned int num_segments = segments[i].sizes.size();
+		segment_sizes[i]  = (unsigned int*) aligned_alloc(4096, num_segments*sizeof(uint));
+		segment_scores[i] = (unsigned long*)aligned_alloc(4096, (1 + score_words*num_segments)*sizeof(unsigned long));
+		copy(segments[i].sizes.begin(), segments[i].sizes.end(), segment_sizes[i]);
+		num_scores += num_segments;
+	}
+
+	// Create buffers
+	cl::Buffer buffer_bloom_filter(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom.numWords()*sizeof(uint),bloom_filter);
+	cl::Buffer buffer_input_doc_words(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, total_size*sizeof(uint),input_doc_words);
+	cl::Buffer buffer_profile_weights(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, profile_size*sizeof(unsigned long),profile_weights);
+
+	cl::Buffer buffer_segment_sizes[num_iter];
+	cl::Buffer buffer_segment_scores[num_iter];
+	for (int i=0; i<num_iter; i++) {
+		unsigned int num_segments = segments[i].sizes.size();
+		buffer_segment_sizes[i]  = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,  num_segments*sizeof(uint), segment_sizes[i]);
+		buffer_segment_scores[i] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, (1 + score_words*num_segments)*sizeof(unsigned long), segment_scores[i]);
+	}
+
+	// With a min_score, the number of pairs kept is read back first
+	cl_buffer_region subbuf_kept_info = {0, sizeof(unsigned long)};
+	cl::Buffer subbuf_kept[num_iter];
+	if (min_score) {
+		for (int i=0; i<num_iter; i++) {
+			subbuf_kept[i] = buffer_segment_scores[i].createSubBuffer (CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &subbuf_kept_info);
+		}
+	}
+
+	// Set buffer kernel arguments (needed to migrate the buffers in the correct memory)
+	kernel.setArg(0, buffer_segment_scores[0]);
+	kernel.setArg(1, buffer_input_doc_words);
+	kernel.setArg(2, buffer_bloom_filter);
+	kernel.setArg(9, buffer_segment_sizes[0]);
+	kernel.setArg(11, buffer_profile_weights);
+
+	// Bloom filter configuration and bank, the same for every invocation
+	if (!bloom.valid() || bloom.layout != bloom_default_layout || bloom.hash != bloom_default_hash) {
+		printf("ERROR: Bloom filter configuration not supported by the kernel\n");
+		exit(-1);
+	}
+	kernel.setArg(5, bloom.size_log2);
+	kernel.setArg(6, bloom.num_hashes);
+	kernel.setArg(7, bloom.seed_pu);
+	kernel.setArg(8, bloom.seed_lu);
+	kernel.setArg(12, min_score);
+	kernel.setArg(13, 0u);
+
+	// Make buffers resident in the device
+	q.enqueueMigrateMemObjects({buffer_bloom_filter, buffer_input_doc_words, buffer_profile_weights}, CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED);
+
+	// Specify size of sub-buffers for each iteration
+	cl_buffer_region subbuf_doc_info[num_iter];
+	cl::Buffer subbuf_doc_words[num_iter];
+	for (int i=0; i<num_iter; i++) {
+		subbuf_doc_info[i]={plan.offset[i]*sizeof(uint), plan.size[i]*sizeof(uint)};
+		subbuf_doc_words[i] = buffer_input_doc_words.createSubBuffer (CL_MEM_READ_ONLY,  CL_BUFFER_CREATE_TYPE_REGION, &subbuf_doc_info[i]);
+	}
+
+	printf("\n");
+    double mbytes_total  = (double)(total_doc_size * sizeof(int)) / (double)(1000*1000);
+    double mbytes_block  = (double)(plan.size[0] * sizeof(int)) / (double)(1000*1000);
+    printf(" Processing %.3f MBytes of data\n", mbytes_total);
+    if (num_iter>1) {
+    printf(" Splitting data in %d sub-buffers of %.3f MBytes for FPGA processing\n", num_iter, mbytes_block);
+    }
+    if (plan.tail_words) {
+    printf(" Scoring the last %u words on the CPU\n", plan.tail_words);
+    }
+    printf(" Reading back up to %lu scores (%.3f MBytes) instead of %.3f MBytes of flags\n",
+           num_scores, num_scores*score_words*sizeof(unsigned long)/1000000.0, total_doc_size/1000000.0);
+    if (min_score) {
+    printf(" Dropping the documents scored below %lu on the FPGA\n", min_score);
+    }
+
+    // Create Events to co-ordinate read,compute and write for each iteration
+	vector<cl::Event> wordWait;
+	vector<cl::Event> krnlWait;
+	vector<cl::Event> scoreWait;
+
+    printf("--------------------------------------------------------------------\n");
+
+	chrono::high_resolution_clock::time_point t1, t2;
+	t1 = chrono::high_resolution_clock::now();
+
+	// Set Kernel arguments and load bloom filter coefficients; the profile
+	// weights go to the device at the same time
+	cl::Event buffDone, krnlDone;
+	total_size = 0;
+	load_filter = true;
+	kernel.setArg(3, total_size);
+	kernel.setArg(4, load_filter);
+	kernel.setArg(10, 0u);
+	q.enqueueMigrateMemObjects({buffer_bloom_filter, buffer_profile_weights}, 0, NULL, &buffDone);
+	wordWait.push_back(buffDone);
+	q.enqueueTask(kernel, &wordWait, &krnlDone);
+	krnlWait.push_back(krnlDone);
+
+        // Set Kernel arguments. Read,enqueue the kernel and write for each iteration
+	for (int i=0; i<num_iter; i++)
+	{
+		cl::Event buffDone, krnlDone, scoreDone;
+		total_size = subbuf_doc_info[i].size / sizeof(uint);
+		load_filter = false;
+		kernel.setArg(0, buffer_segment_scores[i]);
+		kernel.setArg(1, subbuf_doc_words[i]);
+		kernel.setArg(3, total_size);
+		kernel.setArg(4, load_filter);
+		kernel.setArg(9, buffer_segment_sizes[i]);
+		kernel.setArg(10, (unsigned int)segments[i].sizes.size());
+		q.enqueueMigrateMemObjects({subbuf_doc_words[i], buffer_segment_sizes[i]}, 0, &wordWait, &buffDone);
+		wordWait.push_back(buffDone);
+		q.enqueueTask(kernel, &wordWait, &krnlDone);
+		krnlWait.push_back(krnlDone);
+		if (min_score) {
+			q.enqueueMigrateMemObjects({subbuf_kept[i]}, CL_MIGRATE_MEM_OBJECT_HOST, &krnlWait, &scoreDone);
+		} else {
+			q.enqueueMigrateMemObjects({buffer_segment_scores[i]}, CL_MIGRATE_MEM_OBJECT_HOST, &krnlWait, &scoreDone);
+		}
+		scoreWait.push_back(scoreDone);
+	}
+	q.flush();
+
+	// Add up the segment scores of every document as they come back; the
+	// tail segments are scored on the CPU while the FPGA works
+	for (unsigned int doc=0; doc<total_num_docs; doc++)
+	{
+		profile_score[doc] = 0;
+	}
+	for (unsigned int c=num_iter, n=plan.fpga_words; c<segments.size(); c++)
+	{
+		for (unsigned int k=0; k<segments[c].sizes.size(); k++)
+		{
+			unsigned int doc = segments[c].docs[k];
+			if (doc < total_num_docs) profile_score[doc] += scoreSegment(input_doc_words, bloom_filter, profile_weights, n, segments[c].sizes[k], bloom);
+			n += segments[c].sizes[k];
+		}
+	}
+	// Every document before the last one of a chunk is complete when the
+	// chunk is back, and goes to the top-K selection
+	TopK top(top_k);
+	unsigned int next_doc = 0;
+	unsigned long num_kept = 0;
+	cl::Event lastRead = scoreWait.back();
+	for (int iter=0; iter<=num_iter; iter++)
+	{
+		unsigned int done = total_num_docs;
+		if (iter < num_iter) {
+			scoreWait[iter].wait();
+			unsigned long* scores = segment_scores[iter];
+			unsigned long  kept   = scores[0];
+			if (min_score && kept) {
+				// Then only the pairs kept, after their number
+				cl::Event pairsDone;
+				q.enqueueReadBuffer(buffer_segment_scores[iter], CL_FALSE, sizeof(unsigned long),
+				                    2*kept*sizeof(unsigned long), &scores[1], NULL, &pairsDone);
+				pairsDone.wait();
+				lastRead = pairsDone;
+			}
+			for (unsigned int k=0; k<kept; k++)
+			{
+				unsigned int  seg   = min_score ? scores[1 + 2*k] : k;
+				unsigned long score = min_score ? scores[2 + 2*k] : scores[1 + k];
+				unsigned int  doc   = segments[iter].docs[seg];
+				if (doc < total_num_docs) profile_score[doc] += score;
+			}
+			num_kept += kept;
+			done = segments[iter].docs.back();
+		}
+		for (; next_doc < done && next_doc < total_num_docs; next_doc++)
+		{
+			if (profile_score[next_doc] >= min_score) top.push(next_doc, profile_score[next_doc]);
+		}
+	}
+
+	t2 = chrono::high_resolution_clock::now();
+	chrono::duration<double> perf_all_sec  = chrono::duration_cast<duration<double>>(t2-t1);
+
+    cl_ulong f1 = 0;
+    cl_ulong f2 = 0;
+    wordWait.front().getProfilingInfo(CL_PROFILING_COMMAND_QUEUED, &f1);
+    lastRead.getProfilingInfo(CL_PROFILING_COMMAND_END, &f2);
+    double perf_hw_ms = (f2 - f1)/1000000.0;
+
+    if (xcl::is_emulation()) {
+    	if (xcl::is_hw_emulation()) {
+		    printf(" Emulated FPGA accelerated version  | run 'vitis_analyzer xclbin.run_summary' for performance estimates");
+    	} else {
+		    printf(" Emulated FPGA accelerated version  | (performance not relevant in SW emulation)");
+		}
+    } else {
+		    printf(" Executed FPGA accelerated version  | %10.4f ms   ( FPGA %.3f ms )", 1000*perf_all_sec.count(), perf_hw_ms);
+    }
+	printf("\n");
+	printf(" %lu of %lu scores kept by the FPGA\n", num_kept, num_scores);
+
+	if (top_k > 0) {
+		vector<DocScore> best = top.sorted();
+		printf(" Top %u documents:", (unsigned int)best.size());
+		for (unsigned int i=0; i<best.size() && i<5; i++) {
+			printf(" %u (%lu)", best[i].doc, best[i].score);
+		}
+		printf("%s\n", (best.size() > 5) ? " ..." : "");
+	}
+
+	for (int i=0; i<num_iter; i++) {
+		free(segment_sizes[i]);
+		free(segment_scores[i]);
+	}
+}
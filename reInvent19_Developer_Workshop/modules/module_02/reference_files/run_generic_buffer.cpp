@@ -5,13 +5,13 @@
 #include "xcl2.hpp"
 #include "sizes.h"
 #include "common.h"
+#include "chunk_plan.h"
 
 using namespace std;
 using namespace std::chrono;
 
 string kernel_name = "runOnfpga";
 const char* kernel_name_charptr = kernel_name.c_str();
-unsigned int bloom_filter_size = 1L<<bloom_size;
 unsigned int profile_size = 1L<<24;
 unsigned size_per_iter_const=512*1024;
 unsigned size_per_iter;
@@ -25,15 +25,18 @@ void runOnFPGA(
 	unsigned long* profile_score,
 	unsigned int   total_num_docs, 
 	unsigned int   total_doc_size,
-	int            num_iter)
+	int            num_iter,
+	const BloomConfig& bloom)
 {
-	if ((total_doc_size/num_iter)%64!=0) {
+	// Transfers of a multiple of 64 words, the tail is flagged on the CPU
+	TransferPlan plan = planTransfers(total_doc_size, num_iter);
+	if (plan.count() == 0) {
 		printf("--------------------------------------------------------------------\n");
-		printf("ERROR: The number of word per iterations must be a multiple of 64\n");
-		printf("       Total words = %d, Number of iterations = %d, Word per iterations = %d\n", total_doc_size, num_iter, total_doc_size/num_iter);
+		printf("ERROR: At least 64 words are needed for FPGA processing\n");
 		printf("       Skipping FPGA kernel execution\n");
 		exit(-1);
 	}
+	num_iter = plan.count();
 
 	// Boilerplate code to load the FPGA binary, create the kernel and command queue
 	vector<cl::Device> devices = xcl::get_xil_devices();
@@ -52,7 +55,7 @@ void runOnFPGA(
 	bool load_filter = true;
 
 	// Create buffers
-	cl::Buffer buffer_bloom_filter(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom_filter_size*sizeof(uint),bloom_filter);
+	cl::Buffer buffer_bloom_filter(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom.numWords()*sizeof(uint),bloom_filter);
 	cl::Buffer buffer_input_doc_words(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, total_size*sizeof(uint),input_doc_words);
 	cl::Buffer buffer_output_inh_flags(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, total_size*sizeof(char),output_inh_flags);
 
@@ -61,13 +64,20 @@ void runOnFPGA(
 	kernel.setArg(1, buffer_input_doc_words);
 	kernel.setArg(2, buffer_bloom_filter);
 
+	// Bloom filter configuration and bank, the same for every invocation
+	if (!bloom.valid() || bloom.layout != bloom_default_layout || bloom.hash != bloom_default_hash) {
+		printf("ERROR: Bloom filter configuration not supported by the kernel\n");
+		exit(-1);
+	}
+	kernel.setArg(5, bloom.size_log2);
+	kernel.setArg(6, bloom.num_hashes);
+	kernel.setArg(7, bloom.seed_pu);
+	kernel.setArg(8, bloom.seed_lu);
+	kernel.setArg(9, 0u);
+
 	// Make buffers resident in the device
 	q.enqueueMigrateMemObjects({buffer_bloom_filter, buffer_input_doc_words, buffer_output_inh_flags}, CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED);
 
-	// Specify size of sub buffers for each iteration
-	unsigned subbuf_doc_sz = total_doc_size/num_iter;
-	unsigned subbuf_inh_sz = total_doc_size/num_iter;
-
         // Declare sub buffer regions to specify offset and size for each iteration
 	cl_buffer_region subbuf_inh_info[num_iter];
 	cl_buffer_region subbuf_doc_info[num_iter];
@@ -78,19 +88,22 @@ void runOnFPGA(
 
         // Define sub buffers from buffers based on sub-buffer regions
 	for (int i=0; i<num_iter; i++) {
-		subbuf_inh_info[i]={i*subbuf_inh_sz*sizeof(char), subbuf_inh_sz*sizeof(char)};
-		subbuf_doc_info[i]={i*subbuf_doc_sz*sizeof(uint), subbuf_doc_sz*sizeof(uint)};
+		subbuf_inh_info[i]={plan.offset[i]*sizeof(char), plan.size[i]*sizeof(char)};
+		subbuf_doc_info[i]={plan.offset[i]*sizeof(uint), plan.size[i]*sizeof(uint)};
 		subbuf_inh_flags[i] = buffer_output_inh_flags.createSubBuffer(CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &subbuf_inh_info[i]);
 		subbuf_doc_words[i] = buffer_input_doc_words.createSubBuffer (CL_MEM_READ_ONLY,  CL_BUFFER_CREATE_TYPE_REGION, &subbuf_doc_info[i]);
 	}
 
 	printf("\n");
     double mbytes_total  = (double)(total_doc_size * sizeof(int)) / (double)(1000*1000);
-    double mbytes_block  = mbytes_total / num_iter;
+    double mbytes_block  = (double)(plan.size[0] * sizeof(int)) / (double)(1000*1000);
     printf(" Processing %.3f MBytes of data\n", mbytes_total);
     if (num_iter>1) {
     printf(" Splitting data in %d sub-buffers of %.3f MBytes for FPGA processing\n", num_iter, mbytes_block);
     }
+    if (plan.tail_words) {
+    printf(" Flagging the last %u words on the CPU\n", plan.tail_words);
+    }
 
     // Create Events for co-ordinating read,compute and write for each iteration
 	vector<cl::Event> wordWait;
@@ -131,6 +144,9 @@ void runOnFPGA(
 		flagWait.push_back(flagDone);
 	}
 
+	// The tail is flagged on the CPU while the FPGA works
+	computeTailFlags(input_doc_words, bloom_filter, output_inh_flags, plan.fpga_words, total_doc_size, bloom);
+
 	// Wait until all results are copied back to the host before doing the post-processing
 	for (int i=0; i<num_iter; i++) 
 	{
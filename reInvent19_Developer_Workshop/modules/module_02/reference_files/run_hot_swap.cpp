@@ -0,0 +1,285 @@
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "xcl2.hpp"
+#include "sizes.h"
+#include "common.h"
+#include "chunk_plan.h"
+#include "filter_bank.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// sw_overlap with a profile update half way through the corpus. The
+// first half of the chunks is enqueued against the filter in bank 0;
+// while it runs the host builds the new filter and loads it in bank 1,
+// and the second half is enqueued against it without draining the
+// queue. Every chunk is scored on the CPU with the profile of the
+// version it was flagged with.
+//
+// Here the update is the same profile hashed with other seeds, so the
+// scores do not change and main checks them as usual (the words that
+// are not in the profile weigh 0, false positives or not). A real update
+// changes the weights too; the CPU then keeps one table per version in
+// use.
+
+#if !defined(FILTER_BANKS) || FILTER_BANKS < 2
+#error "Build with -DFILTER_BANKS=2, as the xclbin (make run STEP=hot_swap)"
+#endif
+
+string kernel_name = "runOnfpga";
+const char* kernel_name_charptr = kernel_name.c_str();
+unsigned int profile_size = 1L<<24;
+
+
+// Bloom filter of the profile entries (words with a weight)
+static void buildFilter(unsigned int* filter, const unsigned long* profile_weights, const BloomConfig& config)
+{
+	memset(filter, 0, config.numWords()*sizeof(uint));
+	for (unsigned int word_id=0; word_id<profile_size; word_id++) {
+		if (profile_weights[word_id]) config.insert(filter, word_id);
+	}
+}
+
+void runOnFPGA(
+	unsigned int*  doc_sizes,
+	unsigned int*  input_doc_words,
+	unsigned int*  bloom_filter,
+	unsigned long* profile_weights,
+	unsigned long* profile_score,
+	unsigned int   total_num_docs,
+	unsigned int   total_doc_size,
+	int            num_iter,
+	const BloomConfig& bloom)
+{
+	// Transfers of a multiple of 64 words, the tail is flagged on the CPU
+	TransferPlan plan = planTransfers(total_doc_size, num_iter);
+	if (plan.count() < 2) {
+		printf("--------------------------------------------------------------------\n");
+		printf("ERROR: At least 2 sub-buffers of 64 words are needed to swap the filter\n");
+		printf("       Skipping FPGA kernel execution\n");
+		exit(-1);
+	}
+	num_iter = plan.count();
+	int swap_iter = num_iter/2;
+
+	if (!bloom.valid() || bloom.layout != bloom_default_layout || bloom.hash != bloom_default_hash) {
+		printf("ERROR: Bloom filter configuration not supported by the kernel\n");
+		exit(-1);
+	}
+
+	// Boilerplate code to load the FPGA binary, create the kernel and command queue
+	vector<cl::Device> devices = xcl::get_xil_devices();
+	cl::Device device = devices[0];
+	cl::Context context(device);
+	cl::CommandQueue q(context,device, CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE );
+
+	string run_type = xcl::is_emulation()?(xcl::is_hw_emulation()?"hw_emu":"sw_emu"):"hw";
+	string binary_file = kernel_name + "_" + run_type + ".awsxclbin";
+	cl::Program::Binaries bins = xcl::import_binary_file(binary_file);
+	cl::Program program(context, devices, bins);
+	cl::Kernel kernel(program,kernel_name_charptr,NULL);
+
+	unsigned int total_size = total_doc_size;
+	unsigned char* output_inh_flags = (unsigned char*)aligned_alloc(4096, total_size*sizeof(char));
+
+	// Filter, profile weights and bloom filter buffer of every version
+	FilterBanks banks;
+	BloomConfig swap_config = bloom;
+	swap_config.seed_pu = bloom.seed_pu + 2;
+	swap_config.seed_lu = bloom.seed_lu + 2;
+	unsigned int*  version_filter[2]  = { bloom_filter, (unsigned int*)aligned_alloc(4096, swap_config.numWords()*sizeof(uint)) };
+	unsigned long* version_weights[2] = { profile_weights, profile_weights };
+	cl::Buffer     version_buffer[2];
+
+	// Create buffers
+	version_buffer[0] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom.numWords()*sizeof(uint), version_filter[0]);
+	version_buffer[1] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, swap_config.numWords()*sizeof(uint), version_filter[1]);
+	cl::Buffer buffer_input_doc_words(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, total_size*sizeof(uint),input_doc_words);
+	cl::Buffer buffer_output_inh_flags(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, total_size*sizeof(char),output_inh_flags);
+
+	// Set buffer kernel arguments (needed to migrate the buffers in the correct memory)
+	kernel.setArg(0, buffer_output_inh_flags);
+	kernel.setArg(1, buffer_input_doc_words);
+	kernel.setArg(2, version_buffer[0]);
+
+	// Make buffers resident in the device
+	q.enqueueMigrateMemObjects({version_buffer[0], version_buffer[1], buffer_input_doc_words, buffer_output_inh_flags}, CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED);
+
+        // Declare sub-buffer regions which specify offset and size for each iteration
+	cl_buffer_region subbuf_inh_info[num_iter];
+	cl_buffer_region subbuf_doc_info[num_iter];
+
+        // Declare sub-buffers for each iteration
+	cl::Buffer subbuf_inh_flags[num_iter];
+	cl::Buffer subbuf_doc_words[num_iter];
+
+        // Define sub-buffers from buffers based on sub-buffer regions
+	for (int i=0; i<num_iter; i++) {
+		subbuf_inh_info[i]={plan.offset[i]*sizeof(char), plan.size[i]*sizeof(char)};
+		subbuf_doc_info[i]={plan.offset[i]*sizeof(uint), plan.size[i]*sizeof(uint)};
+		subbuf_inh_flags[i] = buffer_output_inh_flags.createSubBuffer(CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &subbuf_inh_info[i]);
+		subbuf_doc_words[i] = buffer_input_doc_words.createSubBuffer (CL_MEM_READ_ONLY,  CL_BUFFER_CREATE_TYPE_REGION, &subbuf_doc_info[i]);
+	}
+
+	printf("\n");
+    double mbytes_total  = (double)(total_doc_size * sizeof(int)) / (double)(1000*1000);
+    double mbytes_block  = (double)(plan.size[0] * sizeof(int)) / (double)(1000*1000);
+    printf(" Processing %.3f MBytes of data\n", mbytes_total);
+    printf(" Splitting data in %d sub-buffers of %.3f MBytes for FPGA processing\n", num_iter, mbytes_block);
+    printf(" Swapping the bloom filter before sub-buffer %d\n", swap_iter);
+    if (plan.tail_words) {
+    printf(" Flagging the last %u words on the CPU\n", plan.tail_words);
+    }
+
+    // Create Events to co-ordinate read,compute and write for each iteration
+	vector<cl::Event> wordWait;
+	vector<cl::Event> krnlWait;
+	vector<cl::Event> flagWait;
+	vector<unsigned int> chunk_version(num_iter);
+	cl::Event loadDone[2];
+
+    printf("--------------------------------------------------------------------\n");
+
+	chrono::high_resolution_clock::time_point t1, t2, b1, b2;
+	t1 = chrono::high_resolution_clock::now();
+
+	for (int i=0; i<num_iter; i++)
+	{
+		// Load a new filter version in the idle bank, then make it active.
+		// The first version before chunk 0, the update before swap_iter.
+		if (i == 0 || i == swap_iter)
+		{
+			if (i == swap_iter) {
+				b1 = chrono::high_resolution_clock::now();
+				buildFilter(version_filter[1], profile_weights, swap_config);
+				b2 = chrono::high_resolution_clock::now();
+			}
+			const FilterVersion& staged = banks.stage(i == 0 ? bloom : swap_config);
+			cl::Event buffDone, krnlDone;
+			kernel.setArg(2, version_buffer[staged.version]);
+			kernel.setArg(3, 0u);
+			kernel.setArg(4, true);
+			kernel.setArg(5, staged.config.size_log2);
+			kernel.setArg(6, staged.config.num_hashes);
+			kernel.setArg(7, staged.config.seed_pu);
+			kernel.setArg(8, staged.config.seed_lu);
+			kernel.setArg(9, staged.bank);
+			q.enqueueMigrateMemObjects({version_buffer[staged.version]}, 0, NULL, &buffDone);
+			wordWait.push_back(buffDone);
+			q.enqueueTask(kernel, &wordWait, &krnlDone);
+			loadDone[staged.version] = krnlDone;
+			banks.activate();
+		}
+
+		// Set Kernel arguments. Read,enqueue the kernel and write, against
+		// the active bank once its filter is loaded
+		const FilterVersion& active = banks.active();
+		cl::Event buffDone, krnlDone, flagDone;
+		kernel.setArg(0, subbuf_inh_flags[i]);
+		kernel.setArg(1, subbuf_doc_words[i]);
+		kernel.setArg(3, plan.size[i]);
+		kernel.setArg(4, false);
+		kernel.setArg(5, active.config.size_log2);
+		kernel.setArg(6, active.config.num_hashes);
+		kernel.setArg(7, active.config.seed_pu);
+		kernel.setArg(8, active.config.seed_lu);
+		kernel.setArg(9, active.bank);
+		q.enqueueMigrateMemObjects({subbuf_doc_words[i]}, 0, &wordWait, &buffDone);
+		wordWait.push_back(buffDone);
+		vector<cl::Event> chunkWait(wordWait);
+		chunkWait.push_back(loadDone[active.version]);
+		q.enqueueTask(kernel, &chunkWait, &krnlDone);
+		krnlWait.push_back(krnlDone);
+		q.enqueueMigrateMemObjects({subbuf_inh_flags[i]}, CL_MIGRATE_MEM_OBJECT_HOST, &krnlWait, &flagDone);
+		flagWait.push_back(flagDone);
+		chunk_version[i] = active.version;
+
+		// Start the first half before the update is built
+		if (i == swap_iter-1) q.flush();
+	}
+
+	// The tail is flagged on the CPU while the FPGA works, with the
+	// version of the last chunk
+	unsigned int tail_version = chunk_version[num_iter-1];
+	const BloomConfig& tail_config = (tail_version == 0) ? bloom : swap_config;
+	computeTailFlags(input_doc_words, version_filter[tail_version], output_inh_flags, plan.fpga_words, total_doc_size, tail_config);
+
+	// Score each sub-buffer as soon as its flags are back from the FPGA,
+	// with the weights of the filter version it was flagged with
+	q.flush();
+
+	unsigned int  doc  = 0;
+	unsigned int  left = (total_num_docs > 0) ? doc_sizes[0] : 0;
+	unsigned long ans  = 0;
+
+	// The tail flagged on the CPU comes last, as one more chunk
+	for (int iter=0; iter<=num_iter; iter++)
+	{
+		if (iter < num_iter) flagWait[iter].wait();
+		unsigned long* weights = version_weights[(iter < num_iter) ? chunk_version[iter] : tail_version];
+
+		unsigned int n   = (iter < num_iter) ? plan.offset[iter] : plan.fpga_words;
+		unsigned int end = (iter < num_iter) ? n + plan.size[iter] : total_doc_size;
+
+		while (n < end && doc < total_num_docs)
+		{
+			unsigned int count = (left < end - n) ? left : end - n;
+			for (unsigned i = 0; i < count; i++, n++)
+			{
+				if (output_inh_flags[n])
+				{
+					unsigned curr_entry = input_doc_words[n];
+					ans += weights[curr_entry >> 8] * (unsigned long)(curr_entry & 0x00ff);
+				}
+			}
+			left -= count;
+
+			// Document complete, move on to the next one
+			if (left == 0) {
+				profile_score[doc++] = ans;
+				ans  = 0;
+				left = (doc < total_num_docs) ? doc_sizes[doc] : 0;
+			}
+		}
+	}
+
+	t2 = chrono::high_resolution_clock::now();
+	chrono::duration<double> perf_all_sec  = chrono::duration_cast<duration<double>>(t2-t1);
+
+    if (xcl::is_emulation()) {
+    	if (xcl::is_hw_emulation()) {
+		    printf(" Emulated FPGA accelerated version  | run 'vitis_analyzer xclbin.run_summary' for performance estimates");
+    	} else {
+		    printf(" Emulated FPGA accelerated version  | (performance not relevant in SW emulation)");
+		}
+    } else {
+		cl_ulong f1 = 0;
+		cl_ulong f2 = 0;
+		wordWait.front().getProfilingInfo(CL_PROFILING_COMMAND_QUEUED, &f1);
+		flagWait.back().getProfilingInfo(CL_PROFILING_COMMAND_END, &f2);
+		cl_ulong l1 = 0;
+		cl_ulong l2 = 0;
+		loadDone[1].getProfilingInfo(CL_PROFILING_COMMAND_START, &l1);
+		loadDone[1].getProfilingInfo(CL_PROFILING_COMMAND_END, &l2);
+
+		    printf(" Executed FPGA accelerated version  | %10.4f ms   ( FPGA %.3f ms )\n", 1000*perf_all_sec.count(), (f2 - f1)/1000000.0);
+		    printf(" Filter update                      | built in %.3f ms on the CPU, loaded in %.3f ms",
+		           1000*chrono::duration<double>(b2-b1).count(), (l2 - l1)/1000000.0);
+    }
+	printf("\n");
+	for (unsigned int v=0; v<banks.numVersions(); v++) {
+		int first = -1, last = -1;
+		for (int i=0; i<num_iter; i++) {
+			if (chunk_version[i] != v) continue;
+			if (first < 0) first = i;
+			last = i;
+		}
+		printf(" Filter version %u : sub-buffers %d to %d\n", v, first, last);
+	}
+
+	free(version_filter[1]);
+	free(output_inh_flags);
+}
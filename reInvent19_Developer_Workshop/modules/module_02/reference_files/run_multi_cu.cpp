@@ -0,0 +1,342 @@
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <ctime>
+
+#include "xcl2.hpp"
+#include "sizes.h"
+#include "common.h"
+#include "chunk_plan.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// The sub-buffers are sharded over every runOnfpga compute unit of every
+// FPGA slot of the instance. Chunk i goes to unit i % num_units, so all
+// units move through the corpus together and the CPU scores the chunks in
+// order as their flags come back, as in sw_overlap.
+//
+// Each CU should have its own DDR bank, e.g. for 4 CUs link with
+//
+//   --nk runOnfpga:4
+//   --sp runOnfpga_1.m_axi_maxiport0:bank0 --sp runOnfpga_1.m_axi_maxiport1:bank0
+//   --sp runOnfpga_2.m_axi_maxiport0:bank1 --sp runOnfpga_2.m_axi_maxiport1:bank1
+//   ...
+//
+// Every CU has its own word and flag buffers over the whole corpus, set as
+// its arguments when it is created, so they are allocated in that CU's
+// bank. The host memory is 4 KB aligned, so XRT uses it without a staging
+// copy. The chunks of a CU are sub-buffers of its buffers, created before
+// the timed region. Every CU holds its own copy of the bloom filter and
+// loads it before its first chunk.
+
+string kernel_name = "runOnfpga";
+
+struct FpgaSlot {
+	cl::Device       device;
+	cl::Context      context;
+	cl::CommandQueue q;
+	cl::Program      program;
+};
+
+struct FpgaUnit {
+	unsigned int      slot;
+	unsigned int      cu;
+	FpgaSlot*         fpga;
+	cl::Kernel        kernel;
+	cl::Buffer        buffer_bloom_filter;
+	cl::Buffer        buffer_words;
+	cl::Buffer        buffer_flags;
+	bool              filter_loaded;
+	cl::Event         krnlDone;
+	vector<cl::Event> chunkDone;
+};
+
+// Processes the corpus on units[0 .. num_units-1]; returns the end-to-end
+// time in seconds
+static double runSharded(
+	vector<FpgaUnit>&  units,
+	unsigned int       num_units,
+	unsigned int*      doc_sizes,
+	unsigned int*      input_doc_words,
+	unsigned int*      bloom_filter,
+	unsigned long*     profile_weights,
+	unsigned long*     profile_score,
+	unsigned char*     output_inh_flags,
+	unsigned int       total_num_docs,
+	unsigned int       total_doc_size,
+	const TransferPlan& plan,
+	const BloomConfig& bloom)
+{
+	int num_iter = plan.count();
+	vector<cl::Buffer> chunk_words(num_iter);
+	vector<cl::Buffer> chunk_flags(num_iter);
+	vector<cl::Event>  flagWait(num_iter);
+
+	for (unsigned int u=0; u<num_units; u++) {
+		units[u].chunkDone.clear();
+	}
+
+	// Chunk i is a sub-buffer of the buffers of unit i % num_units
+	for (int i=0; i<num_iter; i++) {
+		FpgaUnit& unit = units[i % num_units];
+		cl_buffer_region words_info = {plan.offset[i]*sizeof(uint), plan.size[i]*sizeof(uint)};
+		cl_buffer_region flags_info = {plan.offset[i]*sizeof(char), plan.size[i]*sizeof(char)};
+		chunk_words[i] = unit.buffer_words.createSubBuffer(CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &words_info);
+		chunk_flags[i] = unit.buffer_flags.createSubBuffer(CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &flags_info);
+	}
+
+	chrono::high_resolution_clock::time_point t1, t2;
+	t1 = chrono::high_resolution_clock::now();
+
+	for (int i=0; i<num_iter; i++)
+	{
+		FpgaUnit& unit = units[i % num_units];
+		cl::CommandQueue& q = unit.fpga->q;
+
+		// Load the bloom filter in this CU the first time it is used
+		if (!unit.filter_loaded) {
+			cl::Event buffDone, krnlDone;
+			vector<cl::Event> loadWait;
+			unit.kernel.setArg(2, unit.buffer_bloom_filter);
+			unit.kernel.setArg(3, 0u);
+			unit.kernel.setArg(4, true);
+			cl_int err = q.enqueueMigrateMemObjects({unit.buffer_bloom_filter}, 0, NULL, &buffDone);
+			if (err == CL_SUCCESS) {
+				loadWait.push_back(buffDone);
+				err = q.enqueueTask(unit.kernel, &loadWait, &krnlDone);
+			}
+			if (err != CL_SUCCESS) {
+				printf("ERROR: Failed to load the bloom filter in slot %u CU %u (error %d)\n", unit.slot, unit.cu, err);
+				exit(-1);
+			}
+			unit.krnlDone = krnlDone;
+			unit.filter_loaded = true;
+		}
+
+		cl::Event buffDone, krnlDone, flagDone;
+		vector<cl::Event> krnlWait, flagDep;
+		unit.kernel.setArg(0, chunk_flags[i]);
+		unit.kernel.setArg(1, chunk_words[i]);
+		unit.kernel.setArg(3, plan.size[i]);
+		unit.kernel.setArg(4, false);
+		q.enqueueMigrateMemObjects({chunk_words[i]}, 0, NULL, &buffDone);
+		krnlWait.push_back(buffDone);
+		krnlWait.push_back(unit.krnlDone);
+		q.enqueueTask(unit.kernel, &krnlWait, &krnlDone);
+		flagDep.push_back(krnlDone);
+		q.enqueueMigrateMemObjects({chunk_flags[i]}, CL_MIGRATE_MEM_OBJECT_HOST, &flagDep, &flagDone);
+		q.flush();
+
+		unit.krnlDone = krnlDone;
+		unit.chunkDone.push_back(krnlDone);
+		flagWait[i] = flagDone;
+	}
+
+	// The tail is flagged on the CPU while the FPGA works
+	computeTailFlags(input_doc_words, bloom_filter, output_inh_flags, plan.fpga_words, total_doc_size, bloom);
+
+	// Score the chunks in order as their flags come back; a document that
+	// straddles two chunks carries its partial sum over. The tail comes last.
+	unsigned int  doc  = 0;
+	unsigned int  left = (total_num_docs > 0) ? doc_sizes[0] : 0;
+	unsigned long ans  = 0;
+
+	for (int iter=0; iter<=num_iter; iter++)
+	{
+		if (iter < num_iter) flagWait[iter].wait();
+
+		unsigned int n   = (iter < num_iter) ? plan.offset[iter] : plan.fpga_words;
+		unsigned int end = (iter < num_iter) ? n + plan.size[iter] : total_doc_size;
+
+		while (n < end && doc < total_num_docs)
+		{
+			unsigned int count = (left < end - n) ? left : end - n;
+			for (unsigned i = 0; i < count; i++, n++)
+			{
+				if (output_inh_flags[n])
+				{
+					unsigned curr_entry = input_doc_words[n];
+					ans += profile_weights[curr_entry >> 8] * (unsigned long)(curr_entry & 0x00ff);
+				}
+			}
+			left -= count;
+
+			if (left == 0) {
+				profile_score[doc++] = ans;
+				ans  = 0;
+				left = (doc < total_num_docs) ? doc_sizes[doc] : 0;
+			}
+		}
+	}
+
+	t2 = chrono::high_resolution_clock::now();
+	return chrono::duration<double>(t2-t1).count();
+}
+
+// Kernel time of a unit over its chunks of the last run
+static double unitKernelMs(const FpgaUnit& unit)
+{
+	double ms = 0;
+	for (unsigned int c=0; c<unit.chunkDone.size(); c++) {
+		cl_ulong k1 = 0;
+		cl_ulong k2 = 0;
+		unit.chunkDone[c].getProfilingInfo(CL_PROFILING_COMMAND_START, &k1);
+		unit.chunkDone[c].getProfilingInfo(CL_PROFILING_COMMAND_END, &k2);
+		ms += (k2 - k1)/1000000.0;
+	}
+	return ms;
+}
+
+void runOnFPGA(
+	unsigned int*  doc_sizes,
+	unsigned int*  input_doc_words,
+	unsigned int*  bloom_filter,
+	unsigned long* profile_weights,
+	unsigned long* profile_score,
+	unsigned int   total_num_docs,
+	unsigned int   total_doc_size,
+	int            num_iter,
+	const BloomConfig& bloom)
+{
+	// Sub-buffers of a multiple of 64 words, the tail is flagged on the CPU
+	TransferPlan plan = planTransfers(total_doc_size, num_iter);
+	if (plan.count() == 0) {
+		printf("--------------------------------------------------------------------\n");
+		printf("ERROR: At least 64 words are needed for FPGA processing\n");
+		printf("       Skipping FPGA kernel execution\n");
+		exit(-1);
+	}
+	num_iter = plan.count();
+	if (!bloom.valid() || bloom.layout != bloom_default_layout || bloom.hash != bloom_default_hash) {
+		printf("ERROR: Bloom filter configuration not supported by the kernel\n");
+		exit(-1);
+	}
+
+	// One context, queue and program per FPGA slot
+	vector<cl::Device> devices = xcl::get_xil_devices();
+	string run_type = xcl::is_emulation()?(xcl::is_hw_emulation()?"hw_emu":"sw_emu"):"hw";
+	string binary_file = kernel_name + "_" + run_type + ".awsxclbin";
+	cl::Program::Binaries bins = xcl::import_binary_file(binary_file);
+
+	vector<FpgaSlot> slots(devices.size());
+	for (unsigned int s=0; s<devices.size(); s++) {
+		vector<cl::Device> slot_devices(1, devices[s]);
+		slots[s].device  = devices[s];
+		slots[s].context = cl::Context(devices[s]);
+		slots[s].q       = cl::CommandQueue(slots[s].context, devices[s], CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE);
+		slots[s].program = cl::Program(slots[s].context, slot_devices, bins);
+	}
+
+	// The words (from an aligned vector or the page-aligned corpus cache)
+	// and the flags are 4 KB aligned, for the buffers of every unit
+	unsigned char* output_inh_flags = (unsigned char*)aligned_alloc(4096, total_doc_size*sizeof(char));
+
+	// Every compute unit of every slot: runOnfpga_1, runOnfpga_2, ...
+	// A binary with a single, unnamed CU is used as is.
+	vector<FpgaUnit> units;
+	vector<unsigned int> slot_cus(slots.size(), 0);
+	for (unsigned int s=0; s<slots.size(); s++) {
+		for (unsigned int cu=1; ; cu++) {
+			cl_int err = CL_SUCCESS;
+			string cu_name = kernel_name + ":{" + kernel_name + "_" + to_string(cu) + "}";
+			cl::Kernel kernel(slots[s].program, cu_name.c_str(), &err);
+			if (err != CL_SUCCESS && cu == 1) {
+				kernel = cl::Kernel(slots[s].program, kernel_name.c_str(), &err);
+			}
+			if (err != CL_SUCCESS) break;
+
+			FpgaUnit unit;
+			unit.slot   = s;
+			unit.cu     = cu;
+			unit.fpga   = &slots[s];
+			unit.kernel = kernel;
+			unit.filter_loaded = false;
+			unit.buffer_bloom_filter = cl::Buffer(slots[s].context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+			                                      bloom.numWords()*sizeof(uint), bloom_filter);
+			unit.buffer_words = cl::Buffer(slots[s].context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+			                               total_doc_size*sizeof(uint), input_doc_words);
+			unit.buffer_flags = cl::Buffer(slots[s].context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+			                               total_doc_size*sizeof(char), output_inh_flags);
+			unit.kernel.setArg(0, unit.buffer_flags);
+			unit.kernel.setArg(1, unit.buffer_words);
+			unit.kernel.setArg(2, unit.buffer_bloom_filter);
+			unit.kernel.setArg(5, bloom.size_log2);
+			unit.kernel.setArg(6, bloom.num_hashes);
+			unit.kernel.setArg(7, bloom.seed_pu);
+			unit.kernel.setArg(8, bloom.seed_lu);
+			unit.kernel.setArg(9, 0u);
+			units.push_back(unit);
+			slot_cus[s]++;
+		}
+	}
+	if (units.empty()) {
+		printf("ERROR: No %s compute unit found\n", kernel_name.c_str());
+		exit(-1);
+	}
+
+	vector<unsigned long> score(total_num_docs);
+
+	printf("\n");
+    double mbytes_total  = (double)(total_doc_size * sizeof(int)) / (double)(1000*1000);
+    double mbytes_block  = (double)(plan.size[0] * sizeof(int)) / (double)(1000*1000);
+    printf(" Processing %.3f MBytes of data in %d sub-buffers of %.3f MBytes\n", mbytes_total, num_iter, mbytes_block);
+    if (plan.tail_words) {
+    printf(" Flagging the last %u words on the CPU\n", plan.tail_words);
+    }
+    printf(" %u FPGA slots, %u compute units\n", (unsigned int)slots.size(), (unsigned int)units.size());
+    printf("--------------------------------------------------------------------\n");
+
+	// All units; the scores are checked by main
+	double all_sec = runSharded(units, units.size(), doc_sizes, input_doc_words, bloom_filter, profile_weights, profile_score,
+	                            output_inh_flags, total_num_docs, total_doc_size, plan, bloom);
+
+    if (xcl::is_emulation()) {
+		printf(" Emulated FPGA accelerated version  | (performance not relevant in emulation)\n");
+		free(output_inh_flags);
+		return;
+    }
+	printf(" Executed FPGA accelerated version  | %10.4f ms   ( %u CUs )\n", 1000*all_sec, (unsigned int)units.size());
+
+	printf("--------------------------------------------------------------------\n");
+	printf(" Slot | CU | Chunks | Kernel (ms) | MBytes/s\n");
+	for (unsigned int u=0; u<units.size(); u++) {
+		double ms = unitKernelMs(units[u]);
+		double mbytes = 0;
+		for (int i=u; i<num_iter; i+=units.size()) {
+			mbytes += (double)(plan.size[i] * sizeof(int)) / (double)(1000*1000);
+		}
+		printf(" %4u | %2u | %6u | %11.3f | %8.1f\n", units[u].slot, units[u].cu,
+		       (unsigned int)units[u].chunkDone.size(), ms, ms > 0 ? 1000*mbytes/ms : 0.0);
+	}
+
+	// Scaling over the CUs of slot 0, then over the slots with all their
+	// CUs (units are ordered slot by slot). Every run is checked against
+	// the run on all units.
+	double base_sec = 0;
+	unsigned long mismatches = 0;
+	printf("--------------------------------------------------------------------\n");
+	printf(" Slots | CUs | Time (ms) | MBytes/s | Speedup\n");
+	for (unsigned int s=0, num_units=1; s<slots.size(); )
+	{
+		double sec = runSharded(units, num_units, doc_sizes, input_doc_words, bloom_filter, profile_weights, score.data(),
+		                        output_inh_flags, total_num_docs, total_doc_size, plan, bloom);
+		for (unsigned int doc=0; doc<total_num_docs; doc++) {
+			if (score[doc] != profile_score[doc]) mismatches++;
+		}
+		if (num_units == 1) base_sec = sec;
+		printf(" %5u | %3u | %9.3f | %8.1f | %6.2fx\n", s+1, num_units, 1000*sec, mbytes_total/sec, base_sec/sec);
+
+		if (s == 0 && num_units < slot_cus[0]) {
+			num_units++;
+		} else {
+			s++;
+			if (s < slots.size()) num_units += slot_cus[s];
+		}
+	}
+	if (mismatches) {
+		printf(" Scaling runs: FAILED (%lu documents differ from the run on all units)\n", mismatches);
+	}
+
+	free(output_inh_flags);
+}
@@ -0,0 +1,245 @@
+#include <vector>
+#include <cstdio>
+#include <ctime>
+
+#include "xcl2.hpp"
+#include "sizes.h"
+#include "common.h"
+#include "chunk_plan.h"
+#include "corpus_gen.h"
+#include "multi_profile.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// Several profiles scored in one pass over the corpus. The kernel is
+// built with -DBLOOM_PROFILES=P (2 or 4): it holds the filter of every profile in
+// a bank of its own and returns, for every word, the mask of the profiles
+// whose filter contains it. The host adds each flagged word to the score
+// of every profile of its mask. Profile 0 is the profile of the other
+// steps (verified by main.cpp), the others are generated from the same
+// seed; all of them are checked against the batched CPU scoring.
+
+#ifndef BLOOM_PROFILES
+#error "Build with -DBLOOM_PROFILES=P, as the xclbin (make run STEP=multi_profile PROFILES=P)"
+#elif BLOOM_PROFILES != 2 && BLOOM_PROFILES != 4
+#error "The kernel holds 2 or 4 profiles (PROFILES=2 or PROFILES=4)"
+#endif
+
+string kernel_name = "runOnfpga";
+const char* kernel_name_charptr = kernel_name.c_str();
+
+const unsigned int num_profiles = BLOOM_PROFILES;
+
+
+void runOnFPGA(
+	unsigned int*  doc_sizes,
+	unsigned int*  input_doc_words,
+	unsigned int*  bloom_filter,
+	unsigned long* profile_weights,
+	unsigned long* profile_score,
+	unsigned int   total_num_docs,
+	unsigned int   total_doc_size,
+	int            num_iter,
+	const BloomConfig& bloom)
+{
+	// Transfers of a multiple of 64 words, the tail is flagged on the CPU
+	TransferPlan plan = planTransfers(total_doc_size, num_iter);
+	if (plan.count() == 0) {
+		printf("--------------------------------------------------------------------\n");
+		printf("ERROR: At least 64 words are needed for FPGA processing\n");
+		printf("       Skipping FPGA kernel execution\n");
+		exit(-1);
+	}
+	num_iter = plan.count();
+
+	// The batch: the profile of the run and num_profiles-1 generated ones
+	vector<WeightList> profiles(1, nonZeroWeights(profile_weights, 1 << 24));
+	for (unsigned int p = 1; p < num_profiles; p++) {
+		profiles.push_back(entryWeights(genProfile(corpus_seed, profile_entries, p)));
+	}
+	ProfileBatch batch(bloom, profiles);
+
+	// Boilerplate code to load the FPGA binary, create the kernel and command queue
+	vector<cl::Device> devices = xcl::get_xil_devices();
+	cl::Device device = devices[0];
+	cl::Context context(device);
+	cl::CommandQueue q(context,device, CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE );
+
+	string run_type = xcl::is_emulation()?(xcl::is_hw_emulation()?"hw_emu":"sw_emu"):"hw";
+	string binary_file = kernel_name + "_" + run_type + ".awsxclbin";
+	cl::Program::Binaries bins = xcl::import_binary_file(binary_file);
+	cl::Program program(context, devices, bins);
+	cl::Kernel kernel(program,kernel_name_charptr,NULL);
+
+	unsigned int total_size = total_doc_size;
+	unsigned char* output_masks = (unsigned char*)aligned_alloc(4096, total_size*sizeof(char));
+	bool load_filter = true;
+
+	// Create buffers, one bloom filter per profile
+	vector<cl::Buffer> buffer_bloom_filter;
+	for (unsigned int p = 0; p < num_profiles; p++) {
+		buffer_bloom_filter.push_back(cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom.numWords()*sizeof(uint), (void*)batch.filter(p)));
+	}
+	cl::Buffer buffer_input_doc_words(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, total_size*sizeof(uint),input_doc_words);
+	cl::Buffer buffer_output_masks(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, total_size*sizeof(char),output_masks);
+
+	// Set buffer kernel arguments (needed to migrate the buffers in the correct memory)
+	kernel.setArg(0, buffer_output_masks);
+	kernel.setArg(1, buffer_input_doc_words);
+	kernel.setArg(2, buffer_bloom_filter[0]);
+
+	// Bloom filter configuration, the same for every invocation and profile
+	if (!bloom.valid() || bloom.layout != bloom_default_layout || bloom.hash != bloom_default_hash) {
+		printf("ERROR: Bloom filter configuration not supported by the kernel\n");
+		exit(-1);
+	}
+	kernel.setArg(5, bloom.size_log2);
+	kernel.setArg(6, bloom.num_hashes);
+	kernel.setArg(7, bloom.seed_pu);
+	kernel.setArg(8, bloom.seed_lu);
+	kernel.setArg(9, 0u);
+
+	// Make buffers resident in the device
+	q.enqueueMigrateMemObjects({buffer_input_doc_words, buffer_output_masks}, CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED);
+
+	// Sub-buffers of each iteration
+	cl_buffer_region subbuf_mask_info[num_iter];
+	cl_buffer_region subbuf_doc_info[num_iter];
+	cl::Buffer subbuf_masks[num_iter];
+	cl::Buffer subbuf_doc_words[num_iter];
+
+	for (int i=0; i<num_iter; i++) {
+		subbuf_mask_info[i]={plan.offset[i]*sizeof(char), plan.size[i]*sizeof(char)};
+		subbuf_doc_info[i]={plan.offset[i]*sizeof(uint), plan.size[i]*sizeof(uint)};
+		subbuf_masks[i]     = buffer_output_masks.createSubBuffer(CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &subbuf_mask_info[i]);
+		subbuf_doc_words[i] = buffer_input_doc_words.createSubBuffer(CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &subbuf_doc_info[i]);
+	}
+
+	printf("\n");
+    double mbytes_total  = (double)(total_doc_size * sizeof(int)) / (double)(1000*1000);
+    double mbytes_block  = (double)(plan.size[0] * sizeof(int)) / (double)(1000*1000);
+    printf(" Processing %.3f MBytes of data for %u profiles\n", mbytes_total, num_profiles);
+    if (num_iter>1) {
+    printf(" Splitting data in %d sub-buffers of %.3f MBytes for FPGA processing\n", num_iter, mbytes_block);
+    }
+    if (plan.tail_words) {
+    printf(" Flagging the last %u words on the CPU\n", plan.tail_words);
+    }
+
+	vector<cl::Event> wordWait;
+	vector<cl::Event> krnlWait;
+	vector<cl::Event> maskWait;
+
+    printf("--------------------------------------------------------------------\n");
+
+	chrono::high_resolution_clock::time_point t1, t2;
+	t1 = chrono::high_resolution_clock::now();
+
+	// Load the filter of every profile in its bank, one after the other
+	total_size = 0;
+	load_filter = true;
+	kernel.setArg(3, total_size);
+	kernel.setArg(4, load_filter);
+	for (unsigned int p = 0; p < num_profiles; p++)
+	{
+		cl::Event buffDone, krnlDone;
+		kernel.setArg(2, buffer_bloom_filter[p]);
+		kernel.setArg(9, p);
+		q.enqueueMigrateMemObjects({buffer_bloom_filter[p]}, 0, &krnlWait, &buffDone);
+		wordWait.push_back(buffDone);
+		q.enqueueTask(kernel, &wordWait, &krnlDone);
+		krnlWait.push_back(krnlDone);
+	}
+
+	// Set Kernel arguments. Read, enqueue the kernel and write for each iteration
+	for (int i=0; i<num_iter; i++)
+	{
+		cl::Event buffDone, krnlDone, maskDone;
+		total_size = subbuf_doc_info[i].size / sizeof(uint);
+		load_filter = false;
+		kernel.setArg(0, subbuf_masks[i]);
+		kernel.setArg(1, subbuf_doc_words[i]);
+		kernel.setArg(3, total_size);
+		kernel.setArg(4, load_filter);
+		q.enqueueMigrateMemObjects({subbuf_doc_words[i]}, 0, &wordWait, &buffDone);
+		wordWait.push_back(buffDone);
+		q.enqueueTask(kernel, &wordWait, &krnlDone);
+		krnlWait.push_back(krnlDone);
+		q.enqueueMigrateMemObjects({subbuf_masks[i]}, CL_MIGRATE_MEM_OBJECT_HOST, &krnlWait, &maskDone);
+		maskWait.push_back(maskDone);
+	}
+	q.flush();
+
+	// The tail is flagged on the CPU while the FPGA works
+	for (unsigned int n = plan.fpga_words; n < total_doc_size; n++) {
+		unsigned int word_id = input_doc_words[n] >> 8;
+		output_masks[n] = (word_id != docTag) ? batch.match(word_id) : 0;
+	}
+
+	// Score each sub-buffer as soon as its masks are back, as in
+	// sw_overlap, num_profiles scores per document
+	vector<unsigned long> scores((unsigned long)total_num_docs*num_profiles, 0);
+	unsigned int  doc  = 0;
+	unsigned int  left = (total_num_docs > 0) ? doc_sizes[0] : 0;
+	double        cpu_sec = 0;
+
+	// The tail flagged on the CPU comes last, as one more chunk
+	for (int iter=0; iter<=num_iter; iter++)
+	{
+		if (iter < num_iter) maskWait[iter].wait();
+		chrono::high_resolution_clock::time_point c1 = chrono::high_resolution_clock::now();
+
+		unsigned int n   = (iter < num_iter) ? subbuf_doc_info[iter].origin / sizeof(uint) : plan.fpga_words;
+		unsigned int end = (iter < num_iter) ? n + subbuf_doc_info[iter].size / sizeof(uint) : total_doc_size;
+
+		while (n < end && doc < total_num_docs)
+		{
+			unsigned int count = (left < end - n) ? left : end - n;
+			batch.scoreMasks(input_doc_words, output_masks, n, n + count, &scores[(unsigned long)doc*num_profiles]);
+			n    += count;
+			left -= count;
+
+			// Document complete, move on to the next one
+			if (left == 0) {
+				profile_score[doc] = scores[(unsigned long)doc*num_profiles];
+				doc++;
+				left = (doc < total_num_docs) ? doc_sizes[doc] : 0;
+			}
+		}
+		cpu_sec += chrono::duration<double>(chrono::high_resolution_clock::now() - c1).count();
+	}
+
+	t2 = chrono::high_resolution_clock::now();
+	chrono::duration<double> perf_all_sec  = chrono::duration_cast<duration<double>>(t2-t1);
+
+    cl_ulong f1 = 0;
+    cl_ulong f2 = 0;
+    wordWait.front().getProfilingInfo(CL_PROFILING_COMMAND_QUEUED, &f1);
+    maskWait.back().getProfilingInfo(CL_PROFILING_COMMAND_END, &f2);
+    double perf_hw_ms = (f2 - f1)/1000000.0;
+
+    if (xcl::is_emulation()) {
+    	if (xcl::is_hw_emulation()) {
+		    printf(" Emulated FPGA accelerated version  | run 'vitis_analyzer xclbin.run_summary' for performance estimates");
+    	} else {
+		    printf(" Emulated FPGA accelerated version  | (performance not relevant in SW emulation)");
+		}
+    } else {
+		    printf(" Executed FPGA accelerated version  | %10.4f ms   ( FPGA %.3f ms, CPU %.3f ms, %u profiles )",
+		           1000*perf_all_sec.count(), perf_hw_ms, 1000*cpu_sec, num_profiles);
+    }
+	printf("\n");
+
+	// Every profile against the batched CPU scoring
+	vector<unsigned long> cpu_scores((unsigned long)total_num_docs*num_profiles);
+	batch.scoreDocs(doc_sizes, input_doc_words, total_num_docs, cpu_scores.data());
+	for (unsigned long i = 0; i < cpu_scores.size(); i++) {
+		if (scores[i] != cpu_scores[i]) {
+			printf(" Verification: FAILED, doc[%lu] profile %lu: CPU = %lu, FPGA = %lu\n",
+			       i / num_profiles, i % num_profiles, cpu_scores[i], scores[i]);
+			exit(-1);
+		}
+	}
+	printf(" Verification of the %u profiles: PASS\n", num_profiles);
+}
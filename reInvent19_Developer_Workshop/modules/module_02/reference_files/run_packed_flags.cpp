@@ -0,0 +1,216 @@
+#include <vector>
+#include <cstdio>
+#include <ctime>
+
+#include "xcl2.hpp"
+#include "sizes.h"
+#include "common.h"
+#include "packed_flags.h"
+#include "chunk_plan.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// sw_overlap with the flags packed one bit per word: the xclbin must be
+// built from compute_score_fpga.cpp with -DFLAGS_PACKED. The flag readback
+// is 1/32 of the input words and the CPU only visits the flagged words.
+
+string kernel_name = "runOnfpga";
+const char* kernel_name_charptr = kernel_name.c_str();
+unsigned int profile_size = 1L<<24;
+unsigned size_per_iter_const=512*1024;
+unsigned size_per_iter;
+
+
+
+void runOnFPGA(	
+	unsigned int*  doc_sizes,
+	unsigned int*  input_doc_words,
+	unsigned int*  bloom_filter,
+	unsigned long* profile_weights,
+	unsigned long* profile_score,
+	unsigned int   total_num_docs, 
+	unsigned int   total_doc_size,
+	int            num_iter,
+	const BloomConfig& bloom)
+{
+	// Sub-buffers of a multiple of 512 words, the tail is flagged on the CPU
+	TransferPlan plan = planTransfers(total_doc_size, num_iter, packed_flags_block);
+	if (plan.count() == 0) {
+		printf("--------------------------------------------------------------------\n");
+		printf("ERROR: At least %u words are needed for FPGA processing\n", packed_flags_block);
+		printf("       Skipping FPGA kernel execution\n");
+		exit(-1);
+	}
+	num_iter = plan.count();
+
+	// Boilerplate code to load the FPGA binary, create the kernel and command queue
+	vector<cl::Device> devices = xcl::get_xil_devices();
+	cl::Device device = devices[0];
+	cl::Context context(device);
+	cl::CommandQueue q(context,device, CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE );
+
+	string run_type = xcl::is_emulation()?(xcl::is_hw_emulation()?"hw_emu":"sw_emu"):"hw";
+	string binary_file = kernel_name + "_" + run_type + ".awsxclbin";
+	cl::Program::Binaries bins = xcl::import_binary_file(binary_file);
+	cl::Program program(context, devices, bins);
+	cl::Kernel kernel(program,kernel_name_charptr,NULL);
+
+	unsigned int total_size = total_doc_size;
+	unsigned int   flag_bytes = (total_size + packed_flags_block - 1) / packed_flags_block * packed_flags_block / 8;
+	unsigned long* output_inh_flags = (unsigned long*)aligned_alloc(4096, flag_bytes);
+	bool load_filter = true;
+
+	// Create buffers
+	cl::Buffer buffer_bloom_filter(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom.numWords()*sizeof(uint),bloom_filter);
+	cl::Buffer buffer_input_doc_words(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, total_size*sizeof(uint),input_doc_words);
+	cl::Buffer buffer_output_inh_flags(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, flag_bytes,output_inh_flags);
+
+	// Set buffer kernel arguments (needed to migrate the buffers in the correct memory) 
+	kernel.setArg(0, buffer_output_inh_flags);
+	kernel.setArg(1, buffer_input_doc_words);
+	kernel.setArg(2, buffer_bloom_filter);
+
+	// Bloom filter configuration and bank, the same for every invocation
+	if (!bloom.valid() || bloom.layout != bloom_default_layout || bloom.hash != bloom_default_hash) {
+		printf("ERROR: Bloom filter configuration not supported by the kernel\n");
+		exit(-1);
+	}
+	kernel.setArg(5, bloom.size_log2);
+	kernel.setArg(6, bloom.num_hashes);
+	kernel.setArg(7, bloom.seed_pu);
+	kernel.setArg(8, bloom.seed_lu);
+	kernel.setArg(9, 0u);
+
+	// Make buffers resident in the device
+	q.enqueueMigrateMemObjects({buffer_bloom_filter, buffer_input_doc_words, buffer_output_inh_flags}, CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED);
+
+        // Declare sub-buffer regions which specify offset and size for each iteration
+	cl_buffer_region subbuf_inh_info[num_iter];
+	cl_buffer_region subbuf_doc_info[num_iter];
+
+        // Declare sub-buffers for each iteration
+	cl::Buffer subbuf_inh_flags[num_iter];
+	cl::Buffer subbuf_doc_words[num_iter];
+
+        // Define sub-buffers from buffers based on sub-buffer regions
+	for (int i=0; i<num_iter; i++) {
+		subbuf_inh_info[i]={plan.offset[i]/8, plan.size[i]/8};
+		subbuf_doc_info[i]={plan.offset[i]*sizeof(uint), plan.size[i]*sizeof(uint)};
+		subbuf_inh_flags[i] = buffer_output_inh_flags.createSubBuffer(CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &subbuf_inh_info[i]);
+		subbuf_doc_words[i] = buffer_input_doc_words.createSubBuffer (CL_MEM_READ_ONLY,  CL_BUFFER_CREATE_TYPE_REGION, &subbuf_doc_info[i]);
+	}
+
+	printf("\n");
+    double mbytes_total  = (double)(total_doc_size * sizeof(int)) / (double)(1000*1000);
+    double mbytes_block  = (double)(plan.size[0] * sizeof(int)) / (double)(1000*1000);
+    printf(" Processing %.3f MBytes of data\n", mbytes_total);
+    if (num_iter>1) {
+    printf(" Splitting data in %d sub-buffers of %.3f MBytes for FPGA processing\n", num_iter, mbytes_block);
+    }
+    if (plan.tail_words) {
+    printf(" Flagging the last %u words on the CPU\n", plan.tail_words);
+    }
+    printf(" Reading back %.3f MBytes of packed flags\n", mbytes_total / 32);
+
+    // Create Events to co-ordinate read,compute and write for each iteration 
+	vector<cl::Event> wordWait;
+	vector<cl::Event> krnlWait;
+	vector<cl::Event> flagWait;
+
+    printf("--------------------------------------------------------------------\n");
+
+	chrono::high_resolution_clock::time_point t1, t2;
+	t1 = chrono::high_resolution_clock::now();
+
+	// Set Kernel arguments and load bloom filter coefficients
+	cl::Event buffDone, krnlDone;
+	total_size = 0;
+	load_filter = true;
+	kernel.setArg(3, total_size);
+	kernel.setArg(4, load_filter);
+	q.enqueueMigrateMemObjects({buffer_bloom_filter}, 0, NULL, &buffDone);
+	wordWait.push_back(buffDone);
+	q.enqueueTask(kernel, &wordWait, &krnlDone);
+	krnlWait.push_back(krnlDone);
+ 
+        // Set Kernel arguments. Read,enqueue the kernel and write for each iteration
+	for (int i=0; i<num_iter; i++) 
+	{
+		cl::Event buffDone, krnlDone, flagDone;
+		total_size = subbuf_doc_info[i].size / sizeof(uint);
+		load_filter = false;
+		kernel.setArg(0, subbuf_inh_flags[i]);
+		kernel.setArg(1, subbuf_doc_words[i]);
+		kernel.setArg(3, total_size);
+		kernel.setArg(4, load_filter);
+		q.enqueueMigrateMemObjects({subbuf_doc_words[i]}, 0, &wordWait, &buffDone); 
+		wordWait.push_back(buffDone);
+		q.enqueueTask(kernel, &wordWait, &krnlDone);
+		krnlWait.push_back(krnlDone);
+		q.enqueueMigrateMemObjects({subbuf_inh_flags[i]}, CL_MIGRATE_MEM_OBJECT_HOST, &krnlWait, &flagDone);
+		flagWait.push_back(flagDone);
+	}
+
+	// The tail is flagged on the CPU while the FPGA works
+	computeTailPackedFlags(input_doc_words, bloom_filter, output_inh_flags, plan.fpga_words, total_doc_size, bloom);
+
+
+	// Score each sub-buffer as soon as its flags are back from the FPGA. A
+	// document that straddles a boundary carries its partial sum into the
+	// next chunk. Only the words whose flag bit is set are visited.
+	q.flush();
+
+	unsigned int  doc  = 0;
+	unsigned int  left = (total_num_docs > 0) ? doc_sizes[0] : 0;
+	unsigned long ans  = 0;
+	double        cpu_sec = 0;
+
+	for (int iter=0; iter<=num_iter; iter++)
+	{
+		if (iter < num_iter) flagWait[iter].wait();
+		chrono::high_resolution_clock::time_point c1 = chrono::high_resolution_clock::now();
+
+		unsigned int n   = (iter < num_iter) ? subbuf_doc_info[iter].origin / sizeof(uint) : plan.fpga_words;
+		unsigned int end = (iter < num_iter) ? n + subbuf_doc_info[iter].size / sizeof(uint) : total_doc_size;
+
+		while (n < end && doc < total_num_docs)
+		{
+			unsigned int count = (left < end - n) ? left : end - n;
+			ans  += scorePackedFlags(output_inh_flags, input_doc_words, profile_weights, n, n + count);
+			n    += count;
+			left -= count;
+
+			// Document complete, move on to the next one
+			if (left == 0) {
+				profile_score[doc++] = ans;
+				ans  = 0;
+				left = (doc < total_num_docs) ? doc_sizes[doc] : 0;
+			}
+		}
+		cpu_sec += chrono::duration<double>(chrono::high_resolution_clock::now() - c1).count();
+	}
+	t2 = chrono::high_resolution_clock::now();
+	chrono::duration<double> perf_all_sec  = chrono::duration_cast<duration<double>>(t2-t1);
+	unsigned long flagged = countPackedFlags(output_inh_flags, (total_doc_size + 63) / 64 * 64);
+
+    cl_ulong f1 = 0;
+    cl_ulong f2 = 0;
+    wordWait.front().getProfilingInfo(CL_PROFILING_COMMAND_QUEUED, &f1);
+    flagWait.back().getProfilingInfo(CL_PROFILING_COMMAND_END, &f2);
+    double perf_hw_ms = (f2 - f1)/1000000.0;
+
+    if (xcl::is_emulation()) {
+    	if (xcl::is_hw_emulation()) {
+		    printf(" Emulated FPGA accelerated version  | run 'vitis_analyzer xclbin.run_summary' for performance estimates");
+    	} else {
+		    printf(" Emulated FPGA accelerated version  | (performance not relevant in SW emulation)");
+		}
+    } else {
+		    printf(" Executed FPGA accelerated version  | %10.4f ms   ( FPGA %.3f ms, CPU %.3f ms )", 1000*perf_all_sec.count(), perf_hw_ms, 1000*cpu_sec);    	
+    }
+	printf("\n");
+    printf(" Words in the profile               | %10lu (%.2f%%)\n", flagged, 100.0*flagged/total_doc_size);
+	free(output_inh_flags);
+}
+
@@ -5,13 +5,13 @@
 #include "xcl2.hpp"
 #include "sizes.h"
 #include "common.h"
+#include "chunk_plan.h"
 
 using namespace std;
 using namespace std::chrono;
 
 string kernel_name = "runOnfpga";
 const char* kernel_name_charptr = kernel_name.c_str();
-unsigned int bloom_filter_size = 1L<<bloom_size;
 unsigned int profile_size = 1L<<24;
 unsigned size_per_iter_const=512*1024;
 unsigned size_per_iter;
@@ -25,12 +25,14 @@ void runOnFPGA(
 	unsigned long* profile_score,
 	unsigned int   total_num_docs, 
 	unsigned int   total_doc_size,
-	int            num_iter)
+	int            num_iter,
+	const BloomConfig& bloom)
 {
-	if ((total_doc_size)%64!=0) {
+	// The FPGA processes a multiple of 64 words, the tail is flagged on the CPU
+	TransferPlan plan = planTransfers(total_doc_size, 1);
+	if (plan.count() == 0) {
 		printf("--------------------------------------------------------------------\n");
-		printf("ERROR: The number of word per iterations must be a multiple of 64\n");
-		printf("       Total words = %d, Number of iterations = 1, Word per iterations = %d\n", total_doc_size, total_doc_size);
+		printf("ERROR: At least 64 words are needed for FPGA processing\n");
 		printf("       Skipping FPGA kernel execution\n");
 		exit(-1);
 	}
@@ -52,7 +54,7 @@ void runOnFPGA(
 	bool load_filter = true;
 
 	// Create buffers
-	cl::Buffer buffer_bloom_filter(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom_filter_size*sizeof(uint),bloom_filter);
+	cl::Buffer buffer_bloom_filter(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom.numWords()*sizeof(uint),bloom_filter);
 	cl::Buffer buffer_input_doc_words(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, total_size*sizeof(uint),input_doc_words);
 	cl::Buffer buffer_output_inh_flags(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, total_size*sizeof(char),output_inh_flags);
 
@@ -61,6 +63,17 @@ void runOnFPGA(
 	kernel.setArg(1, buffer_input_doc_words);
 	kernel.setArg(2, buffer_bloom_filter);
 
+	// Bloom filter configuration and bank, the same for every invocation
+	if (!bloom.valid() || bloom.layout != bloom_default_layout || bloom.hash != bloom_default_hash) {
+		printf("ERROR: Bloom filter configuration not supported by the kernel\n");
+		exit(-1);
+	}
+	kernel.setArg(5, bloom.size_log2);
+	kernel.setArg(6, bloom.num_hashes);
+	kernel.setArg(7, bloom.seed_pu);
+	kernel.setArg(8, bloom.seed_lu);
+	kernel.setArg(9, 0u);
+
     double mbytes_total  = (double)(total_doc_size * sizeof(int)) / (double)(1000*1000);
     printf(" Processing %.3f MBytes of data\n", mbytes_total);
     printf("Running with a single buffer of %.3f MBytes for FPGA processing\n",mbytes_total); 
@@ -85,7 +98,7 @@ void runOnFPGA(
 
 	// Start the FPGA compute
 	load_filter = true;
-	kernel.setArg(3, total_size);
+	kernel.setArg(3, plan.fpga_words);
 	kernel.setArg(4, load_filter);
 	q.enqueueTask(kernel,&wordWait,&krnlDone);
         krnlWait.push_back(krnlDone);
@@ -93,6 +106,9 @@ void runOnFPGA(
         // Read back the results from FPGA to host  
 	q.enqueueMigrateMemObjects({buffer_output_inh_flags}, CL_MIGRATE_MEM_OBJECT_HOST,&krnlWait,&flagDone);
         flagWait.push_back(flagDone);
+
+	// The tail is flagged on the CPU while the FPGA works
+	computeTailFlags(input_doc_words, bloom_filter, output_inh_flags, plan.fpga_words, total_doc_size, bloom);
         flagWait[0].wait(); 
 
 	// Compute the profile score the CPU using the in-hash flags computed on the FPGA
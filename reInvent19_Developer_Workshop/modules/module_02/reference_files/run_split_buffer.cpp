@@ -5,13 +5,13 @@
 #include "xcl2.hpp"
 #include "sizes.h"
 #include "common.h"
+#include "chunk_plan.h"
 
 using namespace std;
 using namespace std::chrono;
 
 string kernel_name = "runOnfpga";
 const char* kernel_name_charptr = kernel_name.c_str();
-unsigned int bloom_filter_size = 1L<<bloom_size;
 unsigned int profile_size = 1L<<24;
 unsigned size_per_iter_const=512*1024;
 unsigned size_per_iter;
@@ -25,12 +25,14 @@ void runOnFPGA(
 	unsigned long* profile_score,
 	unsigned int   total_num_docs, 
 	unsigned int   total_doc_size,
-        int   num_iter) 
+        int   num_iter,
+	const BloomConfig& bloom) 
 {
-	if ((total_doc_size/2)%64!=0) {
+	// Two transfers of a multiple of 64 words, the tail is flagged on the CPU
+	TransferPlan plan = planTransfers(total_doc_size, 2);
+	if (plan.count() != 2) {
 		printf("--------------------------------------------------------------------\n");
-		printf("ERROR: The number of word per iterations must be a multiple of 64\n");
-		printf("       Total words = %d, Number of iterations = 2, Word per iterations = %d\n", total_doc_size,total_doc_size/2);
+		printf("ERROR: At least 128 words are needed to split the data in 2 sub-buffers\n");
 		printf("       Skipping FPGA kernel execution\n");
 		exit(-1);
 	}
@@ -52,7 +54,7 @@ void runOnFPGA(
 	bool load_filter = true;
 
 	// Create buffers
-	cl::Buffer buffer_bloom_filter(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom_filter_size*sizeof(uint),bloom_filter);
+	cl::Buffer buffer_bloom_filter(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom.numWords()*sizeof(uint),bloom_filter);
 	cl::Buffer buffer_input_doc_words(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, total_size*sizeof(uint),input_doc_words);
 	cl::Buffer buffer_output_inh_flags(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, total_size*sizeof(char),output_inh_flags);
 
@@ -61,13 +63,20 @@ void runOnFPGA(
 	kernel.setArg(1, buffer_input_doc_words);
 	kernel.setArg(2, buffer_bloom_filter);
 
+	// Bloom filter configuration and bank, the same for every invocation
+	if (!bloom.valid() || bloom.layout != bloom_default_layout || bloom.hash != bloom_default_hash) {
+		printf("ERROR: Bloom filter configuration not supported by the kernel\n");
+		exit(-1);
+	}
+	kernel.setArg(5, bloom.size_log2);
+	kernel.setArg(6, bloom.num_hashes);
+	kernel.setArg(7, bloom.seed_pu);
+	kernel.setArg(8, bloom.seed_lu);
+	kernel.setArg(9, 0u);
+
 	// Make buffers resident in the device
 	q.enqueueMigrateMemObjects({buffer_bloom_filter, buffer_input_doc_words, buffer_output_inh_flags}, CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED);
 
-	// Specify size of sub-buffers, one for each transaction 
-	unsigned subbuf_doc_sz = total_doc_size/2;
-	unsigned subbuf_inh_sz = total_doc_size/2;
- 
         // Declare sub-buffer regions to specify offset and size of sub-buffer   
 	cl_buffer_region subbuf_inh_info[2];
 	cl_buffer_region subbuf_doc_info[2];
@@ -78,10 +87,10 @@ void runOnFPGA(
 
         
         // Specify offset and size of sub-buffers 
-        subbuf_inh_info[0]={0, subbuf_inh_sz*sizeof(char)};
-        subbuf_inh_info[1]={subbuf_inh_sz*sizeof(char), subbuf_inh_sz*sizeof(char)};
-        subbuf_doc_info[0]={0, subbuf_doc_sz*sizeof(uint)};
-        subbuf_doc_info[1]={subbuf_doc_sz*sizeof(uint), subbuf_doc_sz*sizeof(uint)};
+        subbuf_inh_info[0]={0, plan.size[0]*sizeof(char)};
+        subbuf_inh_info[1]={plan.offset[1]*sizeof(char), plan.size[1]*sizeof(char)};
+        subbuf_doc_info[0]={0, plan.size[0]*sizeof(uint)};
+        subbuf_doc_info[1]={plan.offset[1]*sizeof(uint), plan.size[1]*sizeof(uint)};
 
         // Create sub-buffers from buffers based on sub-buffer regions
 	subbuf_inh_flags[0] = buffer_output_inh_flags.createSubBuffer(CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &subbuf_inh_info[0]);
@@ -92,9 +101,12 @@ void runOnFPGA(
           
 	printf("\n");
     double mbytes_total  = (double)(total_doc_size * sizeof(int)) / (double)(1000*1000);
-    double mbytes_block  = mbytes_total / 2;
+    double mbytes_block  = (double)(plan.size[0] * sizeof(int)) / (double)(1000*1000);
     printf(" Processing %.3f MBytes of data\n", mbytes_total);
     printf(" Splitting data in 2 sub-buffers of %.3f MBytes for FPGA processing\n", mbytes_block);
+    if (plan.tail_words) {
+    printf(" Flagging the last %u words on the CPU\n", plan.tail_words);
+    }
 
     // Create Events to co-ordinate read,compute and write for each iteration
 	vector<cl::Event> wordWait;
@@ -119,7 +131,7 @@ void runOnFPGA(
  
 	//  Set Kernel Arguments, Read, Enqueue Kernel and Write for first iteration
 		
-                total_size = total_doc_size/2;
+                total_size = plan.size[0];
                 load_filter=false;
 		kernel.setArg(3, total_size);
 		kernel.setArg(4, load_filter);
@@ -133,6 +145,8 @@ void runOnFPGA(
 		flagWait.push_back(flagDone);
 
 	//  Set Kernel Arguments, Read, Enqueue Kernel and Write for second iteration
+		total_size = plan.size[1];
+		kernel.setArg(3, total_size);
 		kernel.setArg(0, subbuf_inh_flags[1]);
 		kernel.setArg(1, subbuf_doc_words[1]);
 		q.enqueueMigrateMemObjects({subbuf_doc_words[1]}, 0, &wordWait, &buffDone); 
@@ -142,6 +156,9 @@ void runOnFPGA(
 		q.enqueueMigrateMemObjects({subbuf_inh_flags[1]}, CL_MIGRATE_MEM_OBJECT_HOST, &krnlWait, &flagDone);
 		flagWait.push_back(flagDone);
 
+	// The tail is flagged on the CPU while the FPGA works
+		computeTailFlags(input_doc_words, bloom_filter, output_inh_flags, plan.fpga_words, total_doc_size, bloom);
+
 	// Wait until all results are copied back to the host before doing the post-processing
 		flagWait[0].wait();
 		flagWait[1].wait();
@@ -5,13 +5,13 @@
 #include "xcl2.hpp"
 #include "sizes.h"
 #include "common.h"
+#include "chunk_plan.h"
 
 using namespace std;
 using namespace std::chrono;
 
 string kernel_name = "runOnfpga";
 const char* kernel_name_charptr = kernel_name.c_str();
-unsigned int bloom_filter_size = 1L<<bloom_size;
 unsigned int profile_size = 1L<<24;
 unsigned size_per_iter_const=512*1024;
 unsigned size_per_iter;
@@ -26,15 +26,18 @@ void runOnFPGA(
 	unsigned long* profile_score,
 	unsigned int   total_num_docs, 
 	unsigned int   total_doc_size,
-	int            num_iter)
+	int            num_iter,
+	const BloomConfig& bloom)
 {
-	if ((total_doc_size/num_iter)%64!=0) {
+	// Transfers of a multiple of 64 words, the tail is flagged on the CPU
+	TransferPlan plan = planTransfers(total_doc_size, num_iter);
+	if (plan.count() == 0) {
 		printf("--------------------------------------------------------------------\n");
-		printf("ERROR: The number of word per iterations must be a multiple of 64\n");
-		printf("       Total words = %d, Number of iterations = %d, Word per iterations = %d\n", total_doc_size, num_iter, total_doc_size/num_iter);
+		printf("ERROR: At least 64 words are needed for FPGA processing\n");
 		printf("       Skipping FPGA kernel execution\n");
 		exit(-1);
 	}
+	num_iter = plan.count();
 
 	// Boilerplate code to load the FPGA binary, create the kernel and command queue
 	vector<cl::Device> devices = xcl::get_xil_devices();
@@ -53,7 +56,7 @@ void runOnFPGA(
 	bool load_filter = true;
 
 	// Create buffers
-	cl::Buffer buffer_bloom_filter(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom_filter_size*sizeof(uint),bloom_filter);
+	cl::Buffer buffer_bloom_filter(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom.numWords()*sizeof(uint),bloom_filter);
 	cl::Buffer buffer_input_doc_words(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, total_size*sizeof(uint),input_doc_words);
 	cl::Buffer buffer_output_inh_flags(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, total_size*sizeof(char),output_inh_flags);
 
@@ -62,13 +65,20 @@ void runOnFPGA(
 	kernel.setArg(1, buffer_input_doc_words);
 	kernel.setArg(2, buffer_bloom_filter);
 
+	// Bloom filter configuration and bank, the same for every invocation
+	if (!bloom.valid() || bloom.layout != bloom_default_layout || bloom.hash != bloom_default_hash) {
+		printf("ERROR: Bloom filter configuration not supported by the kernel\n");
+		exit(-1);
+	}
+	kernel.setArg(5, bloom.size_log2);
+	kernel.setArg(6, bloom.num_hashes);
+	kernel.setArg(7, bloom.seed_pu);
+	kernel.setArg(8, bloom.seed_lu);
+	kernel.setArg(9, 0u);
+
 	// Make buffers resident in the device
 	q.enqueueMigrateMemObjects({buffer_bloom_filter, buffer_input_doc_words, buffer_output_inh_flags}, CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED);
 
-	// Specify size of sub-buffers for each iteration 
-	unsigned subbuf_doc_sz = total_doc_size/num_iter;
-	unsigned subbuf_inh_sz = total_doc_size/num_iter;
-
         // Declare sub-buffer regions which specify offset and size for each iteration
 	cl_buffer_region subbuf_inh_info[num_iter];
 	cl_buffer_region subbuf_doc_info[num_iter];
@@ -79,19 +89,22 @@ void runOnFPGA(
 
         // Define sub-buffers from buffers based on sub-buffer regions
 	for (int i=0; i<num_iter; i++) {
-		subbuf_inh_info[i]={i*subbuf_inh_sz*sizeof(char), subbuf_inh_sz*sizeof(char)};
-		subbuf_doc_info[i]={i*subbuf_doc_sz*sizeof(uint), subbuf_doc_sz*sizeof(uint)};
+		subbuf_inh_info[i]={plan.offset[i]*sizeof(char), plan.size[i]*sizeof(char)};
+		subbuf_doc_info[i]={plan.offset[i]*sizeof(uint), plan.size[i]*sizeof(uint)};
 		subbuf_inh_flags[i] = buffer_output_inh_flags.createSubBuffer(CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &subbuf_inh_info[i]);
 		subbuf_doc_words[i] = buffer_input_doc_words.createSubBuffer (CL_MEM_READ_ONLY,  CL_BUFFER_CREATE_TYPE_REGION, &subbuf_doc_info[i]);
 	}
 
 	printf("\n");
     double mbytes_total  = (double)(total_doc_size * sizeof(int)) / (double)(1000*1000);
-    double mbytes_block  = mbytes_total / num_iter;
+    double mbytes_block  = (double)(plan.size[0] * sizeof(int)) / (double)(1000*1000);
     printf(" Processing %.3f MBytes of data\n", mbytes_total);
     if (num_iter>1) {
     printf(" Splitting data in %d sub-buffers of %.3f MBytes for FPGA processing\n", num_iter, mbytes_block);
     }
+    if (plan.tail_words) {
+    printf(" Flagging the last %u words on the CPU\n", plan.tail_words);
+    }
 
     // Create Events to co-ordinate read,compute and write for each iteration 
 	vector<cl::Event> wordWait;
@@ -132,43 +145,59 @@ void runOnFPGA(
 		flagWait.push_back(flagDone);
 	}
 
+	// The tail is flagged on the CPU while the FPGA works
+	computeTailFlags(input_doc_words, bloom_filter, output_inh_flags, plan.fpga_words, total_doc_size, bloom);
+
 
-	// Create variables to keep track of number of words needed by CPU to compute score and number of words processed by FPGA such that CPU processing can overlap with FPGA
-        unsigned int curr_entry;
+	// Score each sub-buffer as soon as its flags are back from the FPGA, so
+	// the CPU works on chunk i while the FPGA processes chunk i+1. Documents
+	// are not aligned on sub-buffers: a document that straddles a boundary
+	// carries its partial sum (and the number of words it still needs) into
+	// the next chunk.
+	q.flush();
+
+	unsigned int  curr_entry;
 	unsigned char inh_flags;
-	unsigned int  available = 0;
-	unsigned int  needed = 0;
-	unsigned int  iter = 0;
-			
-	for(unsigned int doc=0, n=0; doc<total_num_docs;doc++) 
+	unsigned int  doc  = 0;
+	unsigned int  left = (total_num_docs > 0) ? doc_sizes[0] : 0;
+	unsigned long ans  = 0;
+	double        cpu_sec = 0;
+
+	// The tail flagged on the CPU comes last, as one more chunk
+	for (int iter=0; iter<=num_iter; iter++)
 	{
-		unsigned long ans = 0;
-		unsigned int size = doc_sizes[doc];
-		
-                // Calculate size by needed by CPU for processing next document score
-		needed += size;
-		if (needed > available) {
-			flagWait[iter].wait();
-			available += subbuf_doc_info[iter].size / sizeof(uint);
-			iter++;
-		}
- 
-	        // Check if flgas processed by FPGA is greater than needed by CPU. Else, block CPU
-                // Update the number of available words and sub-buffer count(iter)
-		for (unsigned i = 0; i < size ; i++, n++)
-		  { 
-			curr_entry = input_doc_words[n];
-			inh_flags  = output_inh_flags[n];
-
-			if (inh_flags) 
+		if (iter < num_iter) flagWait[iter].wait();
+		chrono::high_resolution_clock::time_point c1 = chrono::high_resolution_clock::now();
+
+		unsigned int n   = (iter < num_iter) ? subbuf_doc_info[iter].origin / sizeof(uint) : plan.fpga_words;
+		unsigned int end = (iter < num_iter) ? n + subbuf_doc_info[iter].size / sizeof(uint) : total_doc_size;
+
+		while (n < end && doc < total_num_docs)
+		{
+			unsigned int count = (left < end - n) ? left : end - n;
+			for (unsigned i = 0; i < count; i++, n++)
 			{
-				unsigned frequency = curr_entry & 0x00ff;
-				unsigned word_id = curr_entry >> 8;
+				curr_entry = input_doc_words[n];
+				inh_flags  = output_inh_flags[n];
 
-				ans += profile_weights[word_id] * (unsigned long)frequency;
+				if (inh_flags)
+				{
+					unsigned frequency = curr_entry & 0x00ff;
+					unsigned word_id = curr_entry >> 8;
+
+					ans += profile_weights[word_id] * (unsigned long)frequency;
+				}
+			}
+			left -= count;
+
+			// Document complete, move on to the next one
+			if (left == 0) {
+				profile_score[doc++] = ans;
+				ans  = 0;
+				left = (doc < total_num_docs) ? doc_sizes[doc] : 0;
 			}
-		 }
-		profile_score[doc] = ans;
+		}
+		cpu_sec += chrono::duration<double>(chrono::high_resolution_clock::now() - c1).count();
 	}
 
 	t2 = chrono::high_resolution_clock::now();
@@ -187,7 +216,7 @@ void runOnFPGA(
 		    printf(" Emulated FPGA accelerated version  | (performance not relevant in SW emulation)");
 		}
     } else {
-		    printf(" Executed FPGA accelerated version  | %10.4f ms   ( FPGA %.3f ms )", 1000*perf_all_sec.count(), perf_hw_ms);    	
+		    printf(" Executed FPGA accelerated version  | %10.4f ms   ( FPGA %.3f ms, CPU %.3f ms )", 1000*perf_all_sec.count(), perf_hw_ms, 1000*cpu_sec);    	
     }
 	printf("\n");
 }
@@ -0,0 +1,238 @@
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <ctime>
+#include <sys/resource.h>
+
+#include "xcl2.hpp"
+#include "sizes.h"
+#include "common.h"
+#include "corpus_file.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// Streaming mode: the corpus is read from a file one chunk of whole
+// documents at a time and fed through a small ring of device buffers.
+// Every chunk is written, processed by runOnfpga and read back on its own
+// events; the host scores a chunk as soon as its flags are back and then
+// refills the slot with the next chunk. Memory is bounded by the ring
+// (num_slots x chunk_words) whatever the size of the corpus.
+
+struct StreamSlot {
+	unsigned int*  words;
+	unsigned char* flags;
+	cl::Buffer     buffer_words;
+	cl::Buffer     buffer_flags;
+	CorpusChunk    chunk;
+	cl::Event      flagDone;
+};
+
+void runOnFPGAStream(
+	const char*        corpus_path,
+	unsigned int*      bloom_filter,
+	unsigned long*     profile_weights,
+	const BloomConfig& bloom,
+	unsigned int       chunk_words,
+	unsigned int       num_slots,
+	const char*        scores_path)
+{
+	if (chunk_words == 0 || chunk_words%64 != 0 || num_slots == 0) {
+		printf("ERROR: The chunk size must be a non-zero multiple of 64 words and the ring must have a slot\n");
+		exit(-1);
+	}
+
+#ifdef FLAGS_PACKED
+	printf("ERROR: The streaming mode reads a byte per word, build it without -DFLAGS_PACKED\n");
+	exit(-1);
+#endif
+
+	CorpusReader corpus(corpus_path);
+	FILE* scores_file = NULL;
+	if (scores_path) {
+		scores_file = fopen(scores_path, "wb");
+		if (!scores_file) {
+			printf("ERROR: Could not create scores file %s\n", scores_path);
+			exit(-1);
+		}
+	}
+
+	// Boilerplate code to load the FPGA binary, create the kernel and command queue
+	vector<cl::Device> devices = xcl::get_xil_devices();
+	cl::Device device = devices[0];
+	cl::Context context(device);
+	cl::CommandQueue q(context,device, CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE );
+
+	string run_type = xcl::is_emulation()?(xcl::is_hw_emulation()?"hw_emu":"sw_emu"):"hw";
+	string binary_file = string("runOnfpga_") + run_type + ".awsxclbin";
+	cl::Program::Binaries bins = xcl::import_binary_file(binary_file);
+	cl::Program program(context, devices, bins);
+	cl::Kernel kernel(program,"runOnfpga",NULL);
+
+	// Ring of device buffers, each holding one chunk
+	vector<StreamSlot> slots(num_slots);
+	for (unsigned int s=0; s<num_slots; s++) {
+		slots[s].words = (unsigned int*) aligned_alloc(4096, chunk_words*sizeof(uint));
+		slots[s].flags = (unsigned char*)aligned_alloc(4096, chunk_words*sizeof(char));
+		slots[s].buffer_words = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,  chunk_words*sizeof(uint), slots[s].words);
+		slots[s].buffer_flags = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, chunk_words*sizeof(char), slots[s].flags);
+		slots[s].chunk.words  = slots[s].words;
+	}
+	cl::Buffer buffer_bloom_filter(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, bloom.numWords()*sizeof(uint),bloom_filter);
+
+	if (!bloom.valid() || bloom.layout != bloom_default_layout || bloom.hash != bloom_default_hash) {
+		printf("ERROR: Bloom filter configuration not supported by the kernel\n");
+		exit(-1);
+	}
+	kernel.setArg(0, slots[0].buffer_flags);
+	kernel.setArg(1, slots[0].buffer_words);
+	kernel.setArg(2, buffer_bloom_filter);
+	kernel.setArg(5, bloom.size_log2);
+	kernel.setArg(6, bloom.num_hashes);
+	kernel.setArg(7, bloom.seed_pu);
+	kernel.setArg(8, bloom.seed_lu);
+	kernel.setArg(9, 0u);
+
+	printf("\n");
+	printf(" Streaming %u documents (%.3f MBytes) from %s\n", corpus.numDocs(),
+	       corpus.numWords()*sizeof(uint)/1000000.0, corpus_path);
+	printf(" Ring of %u device buffers of %.3f MBytes\n", num_slots, chunk_words*sizeof(uint)/1000000.0);
+	printf("--------------------------------------------------------------------\n");
+
+	chrono::high_resolution_clock::time_point t1, t2;
+	t1 = chrono::high_resolution_clock::now();
+
+	// Load the bloom filter coefficients
+	unsigned int total_size = 0;
+	bool load_filter = true;
+	cl::Event buffDone, krnlDone, firstDone;
+	vector<cl::Event> loadWait;
+	kernel.setArg(3, total_size);
+	kernel.setArg(4, load_filter);
+	q.enqueueMigrateMemObjects({buffer_bloom_filter}, 0, NULL, &buffDone);
+	loadWait.push_back(buffDone);
+	q.enqueueTask(kernel, &loadWait, &krnlDone);
+	firstDone = buffDone;
+
+	deque<unsigned int> inflight;
+	unsigned long num_chunks = 0;
+	unsigned long scored_docs = 0;
+	unsigned long checksum = 0;
+	unsigned long mismatches = 0;
+	double verify_sec = 0;
+	cl::Event lastFlag;
+	bool more = true;
+
+	while (more || !inflight.empty())
+	{
+		// Score the oldest chunk once the ring is full or the corpus is exhausted
+		if (!inflight.empty() && (inflight.size() == num_slots || !more))
+		{
+			StreamSlot& slot = slots[inflight.front()];
+			inflight.pop_front();
+			slot.flagDone.wait();
+			lastFlag = slot.flagDone;
+
+			vector<unsigned long> score(slot.chunk.doc_sizes.size());
+			for (unsigned int doc=0, n=0; doc<slot.chunk.doc_sizes.size(); doc++)
+			{
+				unsigned long ans = 0;
+				for (unsigned int i=0; i<slot.chunk.doc_sizes[doc]; i++, n++)
+				{
+					if (slot.flags[n])
+					{
+						unsigned curr_entry = slot.words[n];
+						ans += profile_weights[curr_entry >> 8] * (unsigned long)(curr_entry & 0x00ff);
+					}
+				}
+				score[doc] = ans;
+				checksum += ans;
+			}
+
+			// Check the chunk against the CPU, outside of the scoring time
+			chrono::high_resolution_clock::time_point v1 = chrono::high_resolution_clock::now();
+			for (unsigned int doc=0, n=0; doc<slot.chunk.doc_sizes.size(); doc++)
+			{
+				unsigned long ans = 0;
+				for (unsigned int i=0; i<slot.chunk.doc_sizes[doc]; i++, n++)
+				{
+					unsigned curr_entry = slot.words[n];
+					unsigned word_id = curr_entry >> 8;
+					if (word_id != docTag && bloom.contains(bloom_filter, word_id)) {
+						ans += profile_weights[word_id] * (unsigned long)(curr_entry & 0x00ff);
+					}
+				}
+				if (ans != score[doc]) mismatches++;
+			}
+			verify_sec += chrono::duration<double>(chrono::high_resolution_clock::now() - v1).count();
+
+			if (scores_file) fwrite(score.data(), sizeof(unsigned long), score.size(), scores_file);
+			scored_docs += score.size();
+			continue;
+		}
+
+		// Refill a free slot with the next chunk and queue it
+		unsigned int s = num_chunks % num_slots;
+		StreamSlot& slot = slots[s];
+		more = corpus.next(slot.chunk, chunk_words);
+		if (!more) continue;
+
+		cl::Event wordDone, execDone, flagDone;
+		vector<cl::Event> writeWait, execWait, readWait;
+		total_size = slot.chunk.num_words;
+		load_filter = false;
+		kernel.setArg(0, slot.buffer_flags);
+		kernel.setArg(1, slot.buffer_words);
+		kernel.setArg(3, total_size);
+		kernel.setArg(4, load_filter);
+		q.enqueueMigrateMemObjects({slot.buffer_words}, 0, NULL, &wordDone);
+		execWait.push_back(wordDone);
+		execWait.push_back(krnlDone);
+		q.enqueueTask(kernel, &execWait, &execDone);
+		readWait.push_back(execDone);
+		q.enqueueMigrateMemObjects({slot.buffer_flags}, CL_MIGRATE_MEM_OBJECT_HOST, &readWait, &flagDone);
+		q.flush();
+
+		krnlDone = execDone;
+		slot.flagDone = flagDone;
+		inflight.push_back(s);
+		num_chunks++;
+	}
+	q.finish();
+
+	t2 = chrono::high_resolution_clock::now();
+	chrono::duration<double> perf_all_sec  = chrono::duration_cast<duration<double>>(t2-t1);
+
+	for (unsigned int s=0; s<num_slots; s++) {
+		free(slots[s].words);
+		free(slots[s].flags);
+	}
+	if (scores_file) fclose(scores_file);
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	printf(" Chunks processed                   | %10lu\n", num_chunks);
+	printf(" Documents scored                   | %10lu (checksum %lu)\n", scored_docs, checksum);
+	printf(" Peak resident memory               | %10.3f MBytes\n", usage.ru_maxrss/1000.0);
+
+	if (num_chunks > 0 && !xcl::is_emulation()) {
+		cl_ulong f1 = 0;
+		cl_ulong f2 = 0;
+		firstDone.getProfilingInfo(CL_PROFILING_COMMAND_QUEUED, &f1);
+		lastFlag.getProfilingInfo(CL_PROFILING_COMMAND_END, &f2);
+		double perf_hw_ms = (f2 - f1)/1000000.0;
+		double stream_sec = perf_all_sec.count() - verify_sec;
+		printf(" Executed FPGA accelerated version  | %10.4f ms   ( FPGA %.3f ms )\n", 1000*stream_sec, perf_hw_ms);
+		printf(" Streaming throughput               | %10.3f MBytes/s\n", corpus.numWords()*sizeof(uint)/1000000.0/stream_sec);
+	} else if (xcl::is_emulation()) {
+		printf(" Emulated FPGA accelerated version  | (performance not relevant in emulation)\n");
+	}
+	printf("--------------------------------------------------------------------\n");
+
+	if (mismatches || scored_docs != corpus.numDocs()) {
+		printf(" Verification: FAILED (%lu documents differ from the CPU)\n", mismatches);
+	} else {
+		printf(" Verification: PASS\n");
+	}
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include<vector>
+#include<utility>
+#include<algorithm>
+#include<cstddef>
+
+// Profile weight stores. Every store maps a 24-bit word id to its weight
+// (0 for words that are not in the profile) through
+//
+//   unsigned long weight(unsigned int word_id) const;
+//   size_t        bytes() const;     // memory footprint
+//   const char*   name() const;
+//
+// and is built from the non-zero (word_id, weight) pairs of the profile.
+// The scoring code is templated on the store, see computeScore in common.h.
+
+typedef std::vector<std::pair<unsigned int, unsigned long>> WeightList;
+
+// Collects the non-zero entries of a dense weight array
+inline WeightList nonZeroWeights(const unsigned long* profile_weights, unsigned int num_words)
+{
+    WeightList list;
+    for (unsigned int word_id = 0; word_id < num_words; word_id++) {
+        if (profile_weights[word_id] != 0) {
+            list.push_back(std::make_pair(word_id, profile_weights[word_id]));
+        }
+    }
+    return list;
+}
+
+// The original layout: one entry per possible word id (128 MB)
+class DenseWeightStore
+{
+    const unsigned long* m_weights;
+    unsigned int         m_num_words;
+
+public:
+    DenseWeightStore(const unsigned long* profile_weights, unsigned int num_words = 1 << 24) :
+        m_weights(profile_weights), m_num_words(num_words) {}
+
+    unsigned long weight(unsigned int word_id) const { return m_weights[word_id]; }
+    size_t        bytes() const { return (size_t)m_num_words * sizeof(unsigned long); }
+    const char*   name() const  { return "dense"; }
+};
+
+// Open addressing with linear probing, at most half full. Keys and values
+// are kept apart so a probe sequence only walks the 4-byte keys.
+class HashWeightStore
+{
+    static const unsigned int empty_key = 0xffffffff;
+
+    std::vector<unsigned int>  m_keys;
+    std::vector<unsigned long> m_values;
+    unsigned int               m_mask;
+    unsigned int               m_shift;
+
+    unsigned int slot(unsigned int word_id) const {
+        return (word_id * 0x9e3779b1u) >> m_shift;
+    }
+
+public:
+    HashWeightStore(const WeightList& list)
+    {
+        unsigned int log2 = 4;
+        while ((1u << log2) < 2 * list.size()) log2++;
+        m_keys.assign(1u << log2, (unsigned int)empty_key);
+        m_values.assign(1u << log2, 0);
+        m_mask  = (1u << log2) - 1;
+        m_shift = 32 - log2;
+
+        for (unsigned int i = 0; i < list.size(); i++) {
+            unsigned int s = slot(list[i].first);
+            while (m_keys[s] != empty_key && m_keys[s] != list[i].first) s = (s + 1) & m_mask;
+            m_keys[s]   = list[i].first;
+            m_values[s] = list[i].second;
+        }
+    }
+
+    unsigned long weight(unsigned int word_id) const {
+        for (unsigned int s = slot(word_id); ; s = (s + 1) & m_mask) {
+            unsigned int key = m_keys[s];
+            if (key == word_id)   return m_values[s];
+            if (key == empty_key) return 0;
+        }
+    }
+    size_t      bytes() const { return m_keys.size() * sizeof(unsigned int) + m_values.size() * sizeof(unsigned long); }
+    const char* name() const  { return "hash"; }
+};
+
+// Sorted keys with a directory on the top 12 bits of the word id. The
+// directory narrows a lookup to a handful of keys (about 4 for the 16K
+// entry profile), which are then searched linearly.
+class SortedWeightStore
+{
+    static const unsigned int dir_bits = 12;
+
+    std::vector<unsigned int>  m_dir;
+    std::vector<unsigned int>  m_keys;
+    std::vector<unsigned long> m_values;
+
+public:
+    SortedWeightStore(WeightList list)
+    {
+        std::sort(list.begin(), list.end());
+        m_dir.assign((1u << dir_bits) + 1, 0);
+        for (unsigned int i = 0; i < list.size(); i++) {
+            m_keys.push_back(list[i].first);
+            m_values.push_back(list[i].second);
+            m_dir[(list[i].first >> (24 - dir_bits)) + 1]++;
+        }
+        for (unsigned int b = 0; b < (1u << dir_bits); b++) {
+            m_dir[b + 1] += m_dir[b];
+        }
+    }
+
+    unsigned long weight(unsigned int word_id) const {
+        unsigned int b = word_id >> (24 - dir_bits);
+        for (unsigned int i = m_dir[b]; i < m_dir[b + 1]; i++) {
+            if (m_keys[i] >= word_id) return (m_keys[i] == word_id) ? m_values[i] : 0;
+        }
+        return 0;
+    }
+    size_t      bytes() const {
+        return m_dir.size() * sizeof(unsigned int) + m_keys.size() * sizeof(unsigned int)
+             + m_values.size() * sizeof(unsigned long);
+    }
+    const char* name() const  { return "sorted"; }
+};